@@ -0,0 +1,350 @@
+#include "bar_container.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <cerrno>
+#include <limits>
+#include <set>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// One column with only the rows where it has a value
+struct SparseColumn {
+    std::string name;
+    std::vector<uint64_t> timestamps;
+    std::vector<double> values;
+};
+
+std::string column_series(const std::string& column_name) {
+    return column_name.substr(0, column_name.find('.'));
+}
+
+bool read_all(int fd, std::vector<char>& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = pread(fd, data.data() + done, data.size() - done, static_cast<off_t>(done));
+        if (n <= 0) return false;
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool write_all(int fd, const std::vector<char>& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = pwrite(fd, data.data() + done, data.size() - done, static_cast<off_t>(done));
+        if (n <= 0) return false;
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Checks the header and directory of a container image; returns false with error set if invalid
+bool parse_container(const char* data, size_t size, BarContainerHeader& header,
+                     std::vector<const BarContainerColumn*>& columns, std::string& error) {
+    if (size < sizeof(header)) {
+        error = "too small for a bar container header";
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != BAR_CONTAINER_MAGIC) {
+        error = "not a bar container";
+        return false;
+    }
+    if (header.version != BAR_CONTAINER_VERSION) {
+        error = "unsupported bar container version " + std::to_string(header.version);
+        return false;
+    }
+    uint64_t column_bytes = header.num_rows * sizeof(double);
+    uint64_t timestamps_end = sizeof(header) + static_cast<uint64_t>(header.num_columns) * sizeof(BarContainerColumn) + column_bytes;
+    if (header.num_rows > size / sizeof(double) || timestamps_end > size) {
+        error = "truncated bar container";
+        return false;
+    }
+    columns.clear();
+    for (uint32_t c = 0; c < header.num_columns; ++c) {
+        const BarContainerColumn* column = reinterpret_cast<const BarContainerColumn*>(data + sizeof(header) + c * sizeof(BarContainerColumn));
+        if (strnlen(column->name, BAR_CONTAINER_NAME_SIZE) == BAR_CONTAINER_NAME_SIZE ||
+            column->offset % sizeof(double) != 0 || column->offset < timestamps_end ||
+            column->offset > size || size - column->offset < column_bytes) {
+            error = "bad directory entry " + std::to_string(c);
+            return false;
+        }
+        columns.push_back(column);
+    }
+    return true;
+}
+
+} // namespace
+
+std::string bar_container_path(const std::string& output_file_path_base, const std::string& symbol) {
+    return output_file_path_base + "bars." + symbol + ".bin";
+}
+
+bool write_bar_series(const std::string& path, const std::vector<BarSeries>& series, std::string& error,
+                      uint64_t keep_before_sec) {
+    std::set<std::string> replaced_series;
+    std::vector<SparseColumn> columns;
+    for (const BarSeries& s : series) {
+        if (s.fields.size() != s.columns.size()) {
+            error = "series " + s.name + " has " + std::to_string(s.fields.size()) + " fields but " +
+                    std::to_string(s.columns.size()) + " columns";
+            return false;
+        }
+        if (std::adjacent_find(s.timestamps.begin(), s.timestamps.end(), std::greater_equal<uint64_t>()) != s.timestamps.end()) {
+            error = "series " + s.name + " is not in strictly increasing bar second order";
+            return false;
+        }
+        replaced_series.insert(s.name);
+        for (size_t f = 0; f < s.fields.size(); ++f) {
+            std::string name = s.name + "." + s.fields[f];
+            if (name.size() >= BAR_CONTAINER_NAME_SIZE || s.columns[f].size() != s.timestamps.size()) {
+                error = "bad column " + name;
+                return false;
+            }
+            SparseColumn column{name, {}, {}};
+            for (size_t i = 0; i < s.timestamps.size(); ++i) {
+                if (!std::isnan(s.columns[f][i])) {
+                    column.timestamps.push_back(s.timestamps[i]);
+                    column.values.push_back(s.columns[f][i]);
+                }
+            }
+            columns.push_back(std::move(column));
+        }
+    }
+
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        error = "Could not open bar container: " + path;
+        return false;
+    }
+    // Held until close; the other bar tool of the same symbol waits here
+    if (flock(fd, LOCK_EX) != 0) {
+        error = "Could not lock bar container: " + path;
+        close(fd);
+        return false;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) == -1) {
+        error = "Could not stat bar container: " + path;
+        close(fd);
+        return false;
+    }
+    if (sb.st_size > 0) {
+        std::vector<char> existing(static_cast<size_t>(sb.st_size));
+        BarContainerHeader header;
+        std::vector<const BarContainerColumn*> existing_columns;
+        std::string parse_error;
+        if (!read_all(fd, existing)) {
+            error = "Could not read bar container: " + path;
+            close(fd);
+            return false;
+        }
+        if (!parse_container(existing.data(), existing.size(), header, existing_columns, parse_error)) {
+            std::cerr << "Warning: Replacing invalid bar container (" << parse_error << "): " << path << std::endl;
+        } else {
+            const char* timestamps_data = existing.data() + sizeof(header) + header.num_columns * sizeof(BarContainerColumn);
+            for (const BarContainerColumn* existing_column : existing_columns) {
+                std::string name(existing_column->name);
+                bool replaced = replaced_series.count(column_series(name)) > 0;
+                if (replaced && keep_before_sec == 0) {
+                    continue;
+                }
+                SparseColumn column{name, {}, {}};
+                for (uint64_t i = 0; i < header.num_rows; ++i) {
+                    double value;
+                    uint64_t ts;
+                    std::memcpy(&value, existing.data() + existing_column->offset + i * sizeof(double), sizeof(double));
+                    std::memcpy(&ts, timestamps_data + i * sizeof(uint64_t), sizeof(uint64_t));
+                    if (replaced && ts >= keep_before_sec) {
+                        break;
+                    }
+                    if (!std::isnan(value)) {
+                        column.timestamps.push_back(ts);
+                        column.values.push_back(value);
+                    }
+                }
+                if (!replaced) {
+                    columns.push_back(std::move(column));
+                    continue;
+                }
+                // Kept rows go in front of the new ones of the same column
+                auto fresh = std::find_if(columns.begin(), columns.end(),
+                                          [&name](const SparseColumn& c) { return c.name == name; });
+                if (fresh != columns.end()) {
+                    fresh->timestamps.insert(fresh->timestamps.begin(), column.timestamps.begin(), column.timestamps.end());
+                    fresh->values.insert(fresh->values.begin(), column.values.begin(), column.values.end());
+                }
+            }
+        }
+    }
+    // The dense walk below needs every column in strictly increasing time order; kept rows can still
+    // overlap the new ones of their series
+    for (const SparseColumn& column : columns) {
+        for (size_t i = 1; i < column.timestamps.size(); ++i) {
+            if (column.timestamps[i] <= column.timestamps[i - 1]) {
+                error = "Column " + column.name + " has bar second " + std::to_string(column.timestamps[i]) +
+                        " after " + std::to_string(column.timestamps[i - 1]) + ", not writing bar container: " + path;
+                close(fd);
+                return false;
+            }
+        }
+    }
+    std::sort(columns.begin(), columns.end(),
+              [](const SparseColumn& a, const SparseColumn& b) { return a.name < b.name; });
+
+    // Rows are every second with a bar in any series
+    std::vector<uint64_t> timestamps;
+    for (const SparseColumn& column : columns) {
+        timestamps.insert(timestamps.end(), column.timestamps.begin(), column.timestamps.end());
+    }
+    std::sort(timestamps.begin(), timestamps.end());
+    timestamps.erase(std::unique(timestamps.begin(), timestamps.end()), timestamps.end());
+
+    BarContainerHeader header = {BAR_CONTAINER_MAGIC, BAR_CONTAINER_VERSION, static_cast<uint32_t>(columns.size()), timestamps.size()};
+    size_t column_bytes = timestamps.size() * sizeof(double);
+    size_t data_start = sizeof(header) + columns.size() * sizeof(BarContainerColumn) + column_bytes;
+    std::vector<char> image(data_start + columns.size() * column_bytes);
+    std::memcpy(image.data(), &header, sizeof(header));
+    std::memcpy(image.data() + data_start - column_bytes, timestamps.data(), column_bytes);
+
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    std::vector<double> dense(timestamps.size());
+    for (size_t c = 0; c < columns.size(); ++c) {
+        const SparseColumn& column = columns[c];
+        BarContainerColumn entry = {};
+        std::memcpy(entry.name, column.name.data(), column.name.size());
+        entry.offset = data_start + c * column_bytes;
+        entry.value_count = column.values.size();
+        std::memcpy(image.data() + sizeof(header) + c * sizeof(entry), &entry, sizeof(entry));
+
+        // Both timestamp lists are sorted, so one forward walk places every value
+        std::fill(dense.begin(), dense.end(), nan);
+        size_t row = 0;
+        for (size_t i = 0; i < column.timestamps.size(); ++i) {
+            while (timestamps[row] != column.timestamps[i]) ++row;
+            dense[row] = column.values[i];
+        }
+        std::memcpy(image.data() + entry.offset, dense.data(), column_bytes);
+    }
+
+    bool ok = write_all(fd, image) && ftruncate(fd, static_cast<off_t>(image.size())) == 0;
+    if (!ok) {
+        error = "Could not write bar container: " + path;
+    }
+    close(fd);
+    return ok;
+}
+
+BarContainer::~BarContainer() {
+    if (data_) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+bool BarContainer::open(const std::string& path, std::string& error) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        error = "Could not open bar container: " + path;
+        return false;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) == -1 || sb.st_size == 0) {
+        error = "Empty or unreadable bar container: " + path;
+        close(fd);
+        return false;
+    }
+    size_ = static_cast<size_t>(sb.st_size);
+    void* mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        error = "Could not map bar container: " + path;
+        return false;
+    }
+    data_ = static_cast<const char*>(mapped);
+
+    BarContainerHeader header;
+    if (!parse_container(data_, size_, header, columns_, error)) {
+        error += ": " + path;
+        return false;
+    }
+    num_rows_ = header.num_rows;
+    timestamps_ = reinterpret_cast<const uint64_t*>(data_ + sizeof(header) + header.num_columns * sizeof(BarContainerColumn));
+    return true;
+}
+
+const double* BarContainer::column(const std::string& name) const {
+    for (const BarContainerColumn* entry : columns_) {
+        if (name == entry->name) {
+            return reinterpret_cast<const double*>(data_ + entry->offset);
+        }
+    }
+    return nullptr;
+}
+
+std::vector<double> BarContainer::series_values(const std::string& name) const {
+    std::vector<double> values;
+    const double* column_data = column(name);
+    if (!column_data) {
+        return values;
+    }
+    values.reserve(num_rows_);
+    for (uint64_t i = 0; i < num_rows_; ++i) {
+        if (!std::isnan(column_data[i])) {
+            values.push_back(column_data[i]);
+        }
+    }
+    return values;
+}
+
+bool last_bar_timestamp(const std::string& path, size_t record_size, uint64_t& timestamp) {
+    timestamp = 0;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return errno == ENOENT;
+    }
+    struct stat sb;
+    bool ok = fstat(fd, &sb) == 0 && static_cast<size_t>(sb.st_size) % record_size == 0;
+    if (ok && sb.st_size > 0) {
+        ok = pread(fd, &timestamp, sizeof(timestamp), sb.st_size - static_cast<off_t>(record_size)) == sizeof(timestamp);
+    }
+    close(fd);
+    return ok;
+}
+
+bool drop_bars_from(const std::string& path, size_t record_size, uint64_t from_sec, std::string& error) {
+    int fd = open(path.c_str(), O_RDWR);
+    if (fd == -1) {
+        if (errno == ENOENT) return true;
+        error = "Could not open bar file: " + path;
+        return false;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || static_cast<size_t>(sb.st_size) % record_size != 0) {
+        error = "Bar file is not a whole number of records: " + path;
+        close(fd);
+        return false;
+    }
+    // Only the last bars can be at or after from_sec, so walk back from the end
+    size_t kept = static_cast<size_t>(sb.st_size) / record_size;
+    uint64_t timestamp = 0;
+    while (kept > 0 && pread(fd, &timestamp, sizeof(timestamp), static_cast<off_t>((kept - 1) * record_size)) == sizeof(timestamp) &&
+           timestamp >= from_sec) {
+        --kept;
+    }
+    bool ok = ftruncate(fd, static_cast<off_t>(kept * record_size)) == 0;
+    if (!ok) {
+        error = "Could not truncate bar file: " + path;
+    }
+    close(fd);
+    return ok;
+}
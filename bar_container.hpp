@@ -0,0 +1,100 @@
+#ifndef BAR_CONTAINER_HPP
+#define BAR_CONTAINER_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// --- Constants ---
+// One file per symbol holding every per-second bar series of a venue: <FEED>.bars.<SYMBOL>.bin
+const uint64_t BAR_CONTAINER_MAGIC = 0x3130544E43524142ULL; // "BARCNT01"
+const uint32_t BAR_CONTAINER_VERSION = 1;
+const size_t BAR_CONTAINER_HEADER_SIZE = 24;
+const size_t BAR_CONTAINER_COLUMN_SIZE = 48;
+const size_t BAR_CONTAINER_NAME_SIZE = 32;
+
+#pragma pack(push, 1)
+
+// Layout: header, num_columns directory entries, the shared timestamp column (uint64 bar seconds,
+// ascending, num_rows of them), then one double column of num_rows values per directory entry.
+// Every column starts on an 8-byte boundary, so the file can be used in place through one mmap.
+struct BarContainerHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t num_columns;
+    uint64_t num_rows;
+};
+static_assert(sizeof(BarContainerHeader) == BAR_CONTAINER_HEADER_SIZE, "BarContainerHeader size mismatch");
+
+// Column "<series>.<field>", e.g. "bid_L1.close" or "fills.volume". A series has a bar at the
+// rows where its columns are not NaN; value_count is the number of such rows.
+struct BarContainerColumn {
+    char name[BAR_CONTAINER_NAME_SIZE];
+    uint64_t offset;
+    uint64_t value_count;
+};
+static_assert(sizeof(BarContainerColumn) == BAR_CONTAINER_COLUMN_SIZE, "BarContainerColumn size mismatch");
+
+#pragma pack(pop)
+
+// <bars folder>/<PREFIX>.bars.<SYMBOL>.bin, next to the per-series bar files
+std::string bar_container_path(const std::string& output_file_path_base, const std::string& symbol);
+
+// The bars one tool produced for one former bar file, e.g. series "bid_L1" with fields
+// open/high/low/close. columns[f][i] is field f of the bar at timestamps[i].
+struct BarSeries {
+    std::string name;
+    std::vector<std::string> fields;
+    std::vector<uint64_t> timestamps;
+    std::vector<std::vector<double>> columns;
+};
+
+// Stores series in the container at path, creating it if needed. Columns of other series already in
+// the file are kept, so parse_book_tops and parse_book_fills can each add their part of the same
+// symbol, in either order and at the same time: the file is locked for the read-merge-write.
+// The stored rows of a series being written are dropped, except those before keep_before_sec, which
+// lets an append run add only its new bars. Every series, and every column after the merge, must be in
+// strictly increasing bar second order; otherwise nothing is written. Returns false with error set on failure.
+bool write_bar_series(const std::string& path, const std::vector<BarSeries>& series, std::string& error,
+                      uint64_t keep_before_sec = 0);
+
+// Per-series bar files, whose records all start with the uint64 bar second
+// Timestamp of the last record, 0 if the file is missing or empty. Returns false if the file
+// cannot be read or is not a whole number of records.
+bool last_bar_timestamp(const std::string& path, size_t record_size, uint64_t& timestamp);
+
+// Truncates the file to the bars before from_sec; a missing file is left alone. Returns false with
+// error set if the file is not a whole number of records or cannot be truncated.
+bool drop_bars_from(const std::string& path, size_t record_size, uint64_t from_sec, std::string& error);
+
+// Read-only view of a container through one mmap
+class BarContainer {
+public:
+    BarContainer() = default;
+    BarContainer(const BarContainer&) = delete;
+    BarContainer& operator=(const BarContainer&) = delete;
+    ~BarContainer();
+
+    // Returns false with error set if the file cannot be mapped or is not a valid container
+    bool open(const std::string& path, std::string& error);
+
+    uint64_t num_rows() const { return num_rows_; }
+    const uint64_t* timestamps() const { return timestamps_; }
+
+    // num_rows() values, NaN where the series has no bar; nullptr if the column is not in the file
+    const double* column(const std::string& name) const;
+
+    // Values of the column at the rows where it is not NaN, in time order
+    std::vector<double> series_values(const std::string& name) const;
+
+    const std::vector<const BarContainerColumn*>& columns() const { return columns_; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    uint64_t num_rows_ = 0;
+    const uint64_t* timestamps_ = nullptr;
+    std::vector<const BarContainerColumn*> columns_;
+};
+
+#endif
@@ -0,0 +1,68 @@
+import struct
+import numpy as np
+
+# Per-symbol bar container written by parse_book_tops and parse_book_fills: <FEED>.bars.<SYMBOL>.bin
+# Layout as in bar_container.hpp: header, column directory, uint64 timestamp column, then one
+# double column "<series>.<field>" per directory entry, NaN where the series has no bar.
+CONTAINER_MAGIC = 0x3130544E43524142  # "BARCNT01"
+CONTAINER_VERSION = 1
+
+CONTAINER_HEADER_FORMAT = "<QIIQ"
+CONTAINER_HEADER_SIZE = struct.calcsize(CONTAINER_HEADER_FORMAT)
+
+CONTAINER_COLUMN_FORMAT = "<32sQQ"
+CONTAINER_COLUMN_SIZE = struct.calcsize(CONTAINER_COLUMN_FORMAT)
+
+def bar_container_path(output_file_path_base, symbol):
+    """<bars folder>/<PREFIX>.bars.<SYMBOL>.bin, output_file_path_base being e.g. .../bars/IEX."""
+    return f"{output_file_path_base}bars.{symbol.upper()}.bin"
+
+def read_bar_container(file_path):
+    """Maps a bar container. Returns (timestamps, {column name: values}), or None if the file is
+    missing or not a valid container."""
+    try:
+        data = np.memmap(file_path, dtype=np.uint8, mode="r")
+    except FileNotFoundError:
+        return None
+    except (OSError, ValueError) as e:
+        print(f"Error reading bar container {file_path}: {e}")
+        return None
+
+    if len(data) < CONTAINER_HEADER_SIZE:
+        print(f"Error: Bar container is too small to contain a valid header: {file_path}")
+        return None
+    magic, version, num_columns, num_rows = struct.unpack_from(CONTAINER_HEADER_FORMAT, data, 0)
+    if magic != CONTAINER_MAGIC or version != CONTAINER_VERSION:
+        print(f"Error: Not a bar container of version {CONTAINER_VERSION}: {file_path}")
+        return None
+
+    timestamps_offset = CONTAINER_HEADER_SIZE + num_columns * CONTAINER_COLUMN_SIZE
+    column_bytes = num_rows * 8
+    if timestamps_offset + column_bytes > len(data):
+        print(f"Error: Truncated bar container: {file_path}")
+        return None
+    timestamps = data[timestamps_offset:timestamps_offset + column_bytes].view("<u8")
+
+    columns = {}
+    for c in range(num_columns):
+        raw_name, offset, _ = struct.unpack_from(CONTAINER_COLUMN_FORMAT, data, CONTAINER_HEADER_SIZE + c * CONTAINER_COLUMN_SIZE)
+        if offset % 8 != 0 or offset < timestamps_offset + column_bytes or offset + column_bytes > len(data):
+            print(f"Error: Bad directory entry {c} in bar container: {file_path}")
+            return None
+        name = raw_name.split(b"\0", 1)[0].decode()
+        columns[name] = data[offset:offset + column_bytes].view("<f8")
+    return timestamps, columns
+
+def read_container_series(file_path, series, fields):
+    """Bars of one series, e.g. "bid_L1" with fields ["open", "close"]. Returns (timestamps, [values per
+    field]) for the rows where the series has a bar, or None if the container or the series is missing."""
+    container = read_bar_container(file_path)
+    if container is None:
+        return None
+    timestamps, columns = container
+    names = [f"{series}.{field}" for field in fields]
+    if any(name not in columns for name in names):
+        return None
+    # A row holds a bar of the series if any of its columns is set there
+    has_bar = np.logical_or.reduce([~np.isnan(columns[name]) for name in names])
+    return timestamps[has_bar], [columns[name][has_bar] for name in names]
@@ -12,11 +12,15 @@
 #include <deque>
 #include <thread>
 
+#include "provenance.hpp"
+
 const std::string HISTBOOK_EXECUTABLE = "/home/vir/histbook/build/bin/HistBook";
 const std::string PARSE_FILLS_EXECUTABLE = "./parse_book_fills"; 
 const std::string PROCESS_TOPS_EXECUTABLE = "./process_tops";
 const std::string PARSE_MERGED_TOPS_EXECUTABLE = "./parse_merged_tops";
 const unsigned int MAX_CONCURRENT_TASKS = std::max(1u, std::thread::hardware_concurrency());
+const std::string PROVENANCE_FOLDER = ".provenance";
+const int NUM_TOPS_BAR_LEVELS = 3;
 namespace fs = std::filesystem;
 
 // Helper function to convert string to lowercase
@@ -60,8 +64,22 @@ bool run_command(const std::string& command, std::mutex& console_mutex, const st
 }
 
 // Worker task for process_to_books
-bool histbook_task(const fs::path& input_file_path, const fs::path& output_folder, std::mutex& console_mutex) {
+// A raw file is converted again only if it, or the HistBook binary, changed since the stamp was recorded.
+// HistBook's outputs depend on the symbols in the file, so only the inputs are stamped.
+bool histbook_task(const fs::path& input_file_path, const fs::path& output_folder, bool force_rebuild, std::mutex& console_mutex) {
     std::string file_name = input_file_path.filename().string();
+    fs::path provenance_path = output_folder / PROVENANCE_FOLDER / (file_name + ".histbook" + PROVENANCE_SUFFIX);
+    std::vector<fs::path> inputs = {input_file_path, HISTBOOK_EXECUTABLE};
+    if (!force_rebuild) {
+        std::optional<Provenance> current = make_provenance("HistBook", "", output_folder.string(), inputs, {});
+        if (current && provenance_is_current(provenance_path, *current)) {
+            std::lock_guard<std::mutex> lock(console_mutex);
+            std::cout << "Up to date, skipping raw file: " << file_name << std::endl;
+            return true;
+        }
+    }
+    remove_provenance(provenance_path);
+
     {
         std::lock_guard<std::mutex> lock(console_mutex);
         std::cout << "Processing raw file into book: " << file_name << std::endl;
@@ -77,10 +95,16 @@ bool histbook_task(const fs::path& input_file_path, const fs::path& output_folde
         std::cerr << "Failed to process raw file with HistBook: " << file_name << std::endl;
         return false;
     }
+
+    std::optional<Provenance> provenance = make_provenance("HistBook", "", output_folder.string(), inputs, {});
+    if (!provenance || !write_provenance(provenance_path, *provenance)) {
+        std::lock_guard<std::mutex> lock(console_mutex);
+        std::cerr << "Warning: Could not record provenance for raw file: " << file_name << std::endl;
+    }
     return true;
 }
 
-void process_to_books(const fs::path& base_folder_path) {
+void process_to_books(const fs::path& base_folder_path, bool force_rebuild) {
     std::cout << "\n--- Processing raw files to books ---" << std::endl;
     fs::path input_folder = base_folder_path;
     fs::path output_folder = base_folder_path / "books";
@@ -90,7 +114,7 @@ void process_to_books(const fs::path& base_folder_path) {
     int failure_count = 0;
 
     try {
-        fs::create_directories(output_folder);
+        fs::create_directories(output_folder / PROVENANCE_FOLDER);
     } catch (const fs::filesystem_error& e) {
         std::lock_guard<std::mutex> lock(console_mutex);
         std::cerr << "Error creating directory " << output_folder << ": " << e.what() << std::endl;
@@ -122,7 +146,7 @@ void process_to_books(const fs::path& base_folder_path) {
                     futures.pop_front();
                 }
                 futures.push_back(
-                    std::async(std::launch::async, histbook_task, entry.path(), output_folder, std::ref(console_mutex))
+                    std::async(std::launch::async, histbook_task, entry.path(), output_folder, force_rebuild, std::ref(console_mutex))
                 );
             }
         }
@@ -138,19 +162,70 @@ void process_to_books(const fs::path& base_folder_path) {
     std::cout << "--- Finished processing raw files to books. Success: " << success_count << ", Failed: " << failure_count << " ---" << std::endl;
 }
 
-// Generic worker task for generating bars
+// Per-series bar files a bar executable writes for one book file, named as in
+// parse_book_fills/parse_book_tops/parse_merged_tops. The feed tools write them only with --legacy-files;
+// parse_merged_tops always does.
+std::vector<fs::path> expected_bar_outputs(
+    const fs::path& output_bars_folder,
+    const std::string& file_prefix,
+    const std::string& book_type,
+    const std::string& symbol) {
+    std::vector<fs::path> outputs;
+    if (book_type == "book_fills") {
+        outputs.push_back(output_bars_folder / (file_prefix + ".fills_bars." + symbol + ".bin"));
+        outputs.push_back(output_bars_folder / (file_prefix + ".fills_vwap_bars." + symbol + ".bin"));
+        outputs.push_back(output_bars_folder / (file_prefix + ".fills_liquidity_bars." + symbol + ".bin"));
+    } else {
+        for (int level = 1; level <= NUM_TOPS_BAR_LEVELS; ++level) {
+            outputs.push_back(output_bars_folder / (file_prefix + ".bid_bars_L" + std::to_string(level) + "." + symbol + ".bin"));
+            outputs.push_back(output_bars_folder / (file_prefix + ".ask_bars_L" + std::to_string(level) + "." + symbol + ".bin"));
+        }
+        outputs.push_back(output_bars_folder / (file_prefix + ".quote_bars." + symbol + ".bin"));
+    }
+    return outputs;
+}
+
+// <PREFIX>.bars.<SYMBOL>.bin, the bar container both feed tools of a symbol write into
+fs::path expected_bar_container(const fs::path& output_bars_folder, const std::string& file_prefix, const std::string& symbol) {
+    return output_bars_folder / (file_prefix + ".bars." + symbol + ".bin");
+}
+
+// Generic worker task for generating bars. Skipped when the book file, the executable and
+// every expected bar file still match the stamp recorded by the last successful run.
+// shared_outputs are only required to exist: the tops and fills tasks of a symbol both rewrite the
+// bar container, so a stamp of it would always be stale for one of them.
+// extra_flags are passed to the executable and are part of the recorded parameters.
 bool generate_bars_for_file_task(
     const fs::path& input_file_to_process,
     const std::string& bar_executable_path,
     const std::string& date_str,
     const std::string& symbol_str,
     const std::optional<std::string>& feed_for_executable,
+    const std::string& extra_flags,
     const std::string& log_file_type_description,
+    const std::vector<fs::path>& expected_outputs,
+    const std::vector<fs::path>& shared_outputs,
+    const fs::path& provenance_path,
+    bool force_rebuild,
     std::mutex& console_mutex) {
     
     std::string processing_file_name = input_file_to_process.filename().string();
     std::ostringstream command_stream;
     std::string task_description_log;
+    std::vector<fs::path> inputs = {input_file_to_process, bar_executable_path};
+    std::string params = date_str + " " + feed_for_executable.value_or("") + " " + symbol_str + extra_flags;
+
+    if (!force_rebuild) {
+        std::optional<Provenance> current = make_provenance(bar_executable_path, "", params, inputs, expected_outputs);
+        bool shared_present = std::all_of(shared_outputs.begin(), shared_outputs.end(),
+                                          [](const fs::path& output) { return fs::is_regular_file(output); });
+        if (current && shared_present && provenance_is_current(provenance_path, *current)) {
+            std::lock_guard<std::mutex> lock(console_mutex);
+            std::cout << "Up to date, skipping bars for " << log_file_type_description << " file: " << processing_file_name << std::endl;
+            return true;
+        }
+    }
+    remove_provenance(provenance_path);
 
     // Initial log output
     {
@@ -164,21 +239,31 @@ bool generate_bars_for_file_task(
     if (feed_for_executable) {
         command_stream << " " << *feed_for_executable;
     }
-    command_stream << " " << symbol_str;
+    command_stream << " " << symbol_str << extra_flags;
     
     if (!run_command(command_stream.str(), console_mutex, task_description_log)) {
         std::lock_guard<std::mutex> lock(console_mutex);
         std::cerr << "Failed to generate bars from " << log_file_type_description << " file: " << processing_file_name << std::endl;
         return false;
     }
+
+    std::optional<Provenance> provenance = make_provenance(bar_executable_path, "", params, inputs, expected_outputs);
+    if (!provenance || !write_provenance(provenance_path, *provenance)) {
+        std::lock_guard<std::mutex> lock(console_mutex);
+        std::cerr << "Warning: Could not record provenance for bars from: " << processing_file_name << std::endl;
+    }
     return true;
 }
 
-// Processes files (either from 'books' or 'mergedbooks') to generate bars
+// Processes files (either from 'books' or 'mergedbooks') to generate bars. The feed tools write the
+// bar container, and the per-series files too with legacy_files set; parse_merged_tops writes only the
+// per-series files.
 void process_files_to_bars(
     const fs::path& context_path,
     const std::string& date_str,
-    const std::string& feed_or_mode_str
+    const std::string& feed_or_mode_str,
+    bool legacy_files,
+    bool force_rebuild
 ) {
     bool is_merged_flow = (to_lower(feed_or_mode_str) == "mergedbooks");
     fs::path input_data_folder;
@@ -205,7 +290,7 @@ void process_files_to_bars(
     int failure_count = 0;
 
     try {
-        fs::create_directories(output_bars_folder);
+        fs::create_directories(output_bars_folder / PROVENANCE_FOLDER);
     } catch (const fs::filesystem_error& e) {
         std::lock_guard<std::mutex> lock(console_mutex);
         std::cerr << "Error creating bars output directory " << output_bars_folder << ": " << e.what() << std::endl;
@@ -228,6 +313,9 @@ void process_files_to_bars(
         std::string current_bar_exe;
         std::string log_desc_prefix;
         std::optional<std::string> feed_arg_for_task;
+        std::string extra_flags;
+        std::vector<fs::path> expected_outputs;
+        std::vector<fs::path> shared_outputs;
 
         if (is_merged_flow) {
             if (name_parts.size() == 3 && name_parts[2] == "bin") {
@@ -235,6 +323,7 @@ void process_files_to_bars(
                     symbol = name_parts[1];
                     current_bar_exe = tops_executable;
                     log_desc_prefix = "merged tops";
+                    expected_outputs = expected_bar_outputs(output_bars_folder, "MERGEDBOOKS", "book_tops", symbol);
                 } else if (name_parts[0] == "merged_fills") {
                     {
                         std::lock_guard<std::mutex> lock(console_mutex);
@@ -260,6 +349,11 @@ void process_files_to_bars(
                 } else {
                     continue;
                 }
+                if (legacy_files) {
+                    extra_flags = " --legacy-files";
+                    expected_outputs = expected_bar_outputs(output_bars_folder, name_parts[0], name_parts[1], symbol);
+                }
+                shared_outputs.push_back(expected_bar_container(output_bars_folder, name_parts[0], symbol));
             } else {
                 continue;
             }
@@ -283,8 +377,9 @@ void process_files_to_bars(
             futures.push_back(
                 std::async(std::launch::async, generate_bars_for_file_task,
                            entry.path(), current_bar_exe, date_str, symbol,
-                           feed_arg_for_task, log_desc_prefix,
-                           std::ref(console_mutex))
+                           feed_arg_for_task, extra_flags, log_desc_prefix, expected_outputs, shared_outputs,
+                           output_bars_folder / PROVENANCE_FOLDER / (file_name + PROVENANCE_SUFFIX),
+                           force_rebuild, std::ref(console_mutex))
             );
         }
     }
@@ -308,8 +403,19 @@ void process_files_to_bars(
               << ". Bar files should be in " << output_bars_folder.string() << " ---" << std::endl;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     std::string date_str, feed_str;
+    // Outputs whose provenance stamp still matches their inputs are skipped unless --force is given.
+    // --legacy-files makes the feed bar tools also write the per-series bar files next to the bar container.
+    bool force_rebuild = false;
+    bool legacy_files = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--force") {
+            force_rebuild = true;
+        } else if (std::string(argv[i]) == "--legacy-files") {
+            legacy_files = true;
+        }
+    }
 
     std::cout << "Enter file date (yearMonthDay): ";
     std::cin >> date_str;
@@ -322,7 +428,7 @@ int main() {
         fs::path mergedbooks_input_dir = top_level_date_path / "mergedbooks";
         if (fs::is_directory(mergedbooks_input_dir)) {
             std::cout << "Mode: Processing 'mergedbooks'. Skipping HistBook stage." << std::endl;
-            process_files_to_bars(top_level_date_path, date_str, "mergedbooks");
+            process_files_to_bars(top_level_date_path, date_str, "mergedbooks", legacy_files, force_rebuild);
         } else {
             std::cerr << "Error: Merged books directory " << mergedbooks_input_dir.string() << " not found." << std::endl;
             return 1;
@@ -331,12 +437,12 @@ int main() {
         fs::path specific_feed_path = top_level_date_path / to_lower(feed_str);
         if (fs::is_directory(specific_feed_path)) {
             // Step 1: Process raw files into books using HistBook
-            process_to_books(specific_feed_path);
+            process_to_books(specific_feed_path, force_rebuild);
             
             // Step 2: Process books into bars
             fs::path books_dir_for_feed = specific_feed_path / "books";
             if (fs::is_directory(books_dir_for_feed)) {
-                process_files_to_bars(specific_feed_path, date_str, feed_str);
+                process_files_to_bars(specific_feed_path, date_str, feed_str, legacy_files, force_rebuild);
             } else {
                 std::cerr << "Books directory (" << books_dir_for_feed << ") not found for feed " << feed_str 
                           << ". Skipping bar generation from books." << std::endl;
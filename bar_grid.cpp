@@ -0,0 +1,436 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <regex>
+#include <set>
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bar_container.hpp"
+
+// --- Constants ---
+const uint64_t BAR_GRID_MAGIC = 0x3144495247524142ULL; // "BARGRID1"
+const uint32_t BAR_GRID_VERSION = 1;
+const size_t BAR_GRID_SYMBOL_SIZE = 16;
+const size_t BAR_GRID_SERIES_SIZE = 32;
+const std::string MERGED_BOOKS_FEED = "mergedbooks";
+// Both legacy bar records (fills_bars and bid/ask_bars) keep the close right after timestamp and three prices
+const size_t LEGACY_CLOSE_OFFSET = 32;
+const size_t LEGACY_FILLS_BAR_SIZE = 44;
+const size_t LEGACY_TOPS_BAR_SIZE = 40;
+// Default grid span: the regular session on the date, in New York time
+const uint64_t SESSION_OPEN_LOCAL_SEC = 9 * 3600 + 30 * 60;
+const uint64_t SESSION_CLOSE_LOCAL_SEC = 16 * 3600;
+
+// Close series of the grid, in bit order of the activity mask, with their legacy bar file names
+struct GridSeries {
+    const char* name;
+    const char* legacy_file;
+    size_t legacy_record_size;
+};
+const GridSeries GRID_SERIES[] = {
+    {"fills", "fills_bars", LEGACY_FILLS_BAR_SIZE},
+    {"bid_L1", "bid_bars_L1", LEGACY_TOPS_BAR_SIZE},
+    {"ask_L1", "ask_bars_L1", LEGACY_TOPS_BAR_SIZE},
+    {"bid_L2", "bid_bars_L2", LEGACY_TOPS_BAR_SIZE},
+    {"ask_L2", "ask_bars_L2", LEGACY_TOPS_BAR_SIZE},
+    {"bid_L3", "bid_bars_L3", LEGACY_TOPS_BAR_SIZE},
+    {"ask_L3", "ask_bars_L3", LEGACY_TOPS_BAR_SIZE},
+};
+const size_t NUM_GRID_SERIES = sizeof(GRID_SERIES) / sizeof(GRID_SERIES[0]);
+static_assert(NUM_GRID_SERIES <= 8, "the activity mask has one bit per series");
+
+#pragma pack(push, 1)
+
+// <bars folder>/<FEED>.bar_grid_<interval>s.bin:
+//   header
+//   char symbol[num_symbols][16], char series[num_series][32]   (NUL padded)
+//   double close[num_series][num_symbols][num_steps]
+//   uint8  activity[num_symbols][num_steps]
+// Step t covers [start_sec + t * interval_sec, start_sec + (t + 1) * interval_sec). close is the close of
+// the last bar at or before the end of the step, forward-filled across steps without bars (and from bars
+// before start_sec); NaN until a series has its first bar. Bit k of activity is set when series k had a
+// bar inside the step, so filled values can be told apart from fresh ones.
+struct BarGridHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t num_symbols;
+    uint32_t num_series;
+    uint32_t reserved;
+    uint64_t start_sec;
+    uint64_t interval_sec;
+    uint64_t num_steps;
+};
+static_assert(sizeof(BarGridHeader) == 48, "BarGridHeader size mismatch");
+
+#pragma pack(pop)
+
+// Per-second closes of one series of one symbol
+struct SeriesBars {
+    std::vector<uint64_t> timestamps;
+    std::vector<double> closes;
+};
+
+void print_usage(const char* prog_name) {
+    std::cerr << "Usage: " << prog_name << " <date> <venue|mergedbooks> [--interval <seconds, default 1>]"
+              << " [--start <epoch seconds>] [--end <epoch seconds>] [--data-span] [--jobs <worker threads>]" << std::endl;
+    std::cerr << "  Aligns the close of every bar series of every symbol on one forward-filled grid, written to" << std::endl;
+    std::cerr << "  <bars folder>/<FEED>.bar_grid_<interval>s.bin. The grid spans the 09:30-16:00 New York session of the date" << std::endl;
+    std::cerr << "  unless --start/--end (exclusive) are given; with --data-span, a missing bound is taken from the first or" << std::endl;
+    std::cerr << "  last bar of any symbol instead, which reads every symbol once more before the grid is built." << std::endl;
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date
+int64_t days_from_civil(int64_t year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    unsigned year_of_era = static_cast<unsigned>(year - era * 400);
+    unsigned day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    unsigned day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + static_cast<int64_t>(day_of_era) - 719468;
+}
+
+// Epoch second of seconds_of_day New York time on date (YYYYMMDD). Daylight saving time is taken from
+// the US rule in force since 2007, from the second Sunday of March to the first Sunday of November,
+// so the result does not depend on the zone database of the host. Returns false for a malformed date.
+bool new_york_time_to_epoch(const std::string& date, uint64_t seconds_of_day, uint64_t& epoch_sec) {
+    if (date.size() != 8 || !std::all_of(date.begin(), date.end(), ::isdigit)) {
+        return false;
+    }
+    int64_t year = std::stoll(date.substr(0, 4));
+    unsigned month = static_cast<unsigned>(std::stoul(date.substr(4, 2)));
+    unsigned day = static_cast<unsigned>(std::stoul(date.substr(6, 2)));
+    if (month < 1 || month > 12 || day < 1 || day > 31) {
+        return false;
+    }
+    // 1970-01-01 was a Thursday; Sunday is weekday 0
+    auto first_sunday = [&](unsigned sunday_month) {
+        int64_t first = days_from_civil(year, sunday_month, 1);
+        return first + (7 - (first + 4) % 7) % 7;
+    };
+    int64_t days = days_from_civil(year, month, day);
+    bool daylight_saving = days >= first_sunday(3) + 7 && days < first_sunday(11);
+    epoch_sec = static_cast<uint64_t>(days * 86400) + seconds_of_day + (daylight_saving ? 4 : 5) * 3600;
+    return true;
+}
+
+// Reads (timestamp, close) of a legacy per-series bar file; a missing file is an empty series
+bool read_legacy_series(const std::string& path, size_t record_size, SeriesBars& bars) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return true;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) == -1) {
+        close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(sb.st_size);
+    if (size == 0) {
+        close(fd);
+        return true;
+    }
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    const char* data = static_cast<const char*>(mapped);
+    size_t count = size / record_size;
+    bars.timestamps.resize(count);
+    bars.closes.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        std::memcpy(&bars.timestamps[i], data + i * record_size, sizeof(uint64_t));
+        std::memcpy(&bars.closes[i], data + i * record_size + LEGACY_CLOSE_OFFSET, sizeof(double));
+    }
+    munmap(mapped, size);
+    return true;
+}
+
+// Loads every grid series of a symbol: from its bar container where the container has the series,
+// otherwise from the legacy bar file. Returns false with error set on a read failure.
+bool load_symbol_series(const std::string& prefix, const std::string& symbol, std::vector<SeriesBars>& series, std::string& error) {
+    series.assign(NUM_GRID_SERIES, SeriesBars());
+    BarContainer container;
+    std::string container_path = bar_container_path(prefix, symbol);
+    bool has_container = access(container_path.c_str(), F_OK) == 0;
+    if (has_container && !container.open(container_path, error)) {
+        return false;
+    }
+    for (size_t k = 0; k < NUM_GRID_SERIES; ++k) {
+        const double* closes = has_container ? container.column(std::string(GRID_SERIES[k].name) + ".close") : nullptr;
+        if (closes) {
+            for (uint64_t i = 0; i < container.num_rows(); ++i) {
+                if (!std::isnan(closes[i])) {
+                    series[k].timestamps.push_back(container.timestamps()[i]);
+                    series[k].closes.push_back(closes[i]);
+                }
+            }
+            continue;
+        }
+        std::string path = prefix + GRID_SERIES[k].legacy_file + "." + symbol + ".bin";
+        if (!read_legacy_series(path, GRID_SERIES[k].legacy_record_size, series[k])) {
+            error = "Could not read bar file: " + path;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Forward-fills one series onto the grid and sets its bit in activity
+void fill_grid_row(const SeriesBars& bars, const BarGridHeader& header, uint8_t bit, std::vector<double>& row,
+                   std::vector<uint8_t>& activity) {
+    double last = std::numeric_limits<double>::quiet_NaN();
+    size_t b = 0;
+    for (uint64_t t = 0; t < header.num_steps; ++t) {
+        uint64_t step_start = header.start_sec + t * header.interval_sec;
+        uint64_t step_end = step_start + header.interval_sec;
+        for (; b < bars.timestamps.size() && bars.timestamps[b] < step_end; ++b) {
+            if (bars.timestamps[b] >= step_start) {
+                activity[t] |= bit;
+            }
+            last = bars.closes[b];
+        }
+        row[t] = last;
+    }
+}
+
+bool pwrite_all(int fd, const void* data, size_t size, uint64_t offset) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = pwrite(fd, bytes, size, static_cast<off_t>(offset));
+        if (n <= 0) return false;
+        bytes += n;
+        size -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    std::string date = argv[1];
+    std::string feed = argv[2];
+    uint64_t interval_sec = 1;
+    uint64_t start_sec = 0, end_sec = 0;
+    bool has_start = false, has_end = false;
+    bool data_span = false;
+    unsigned int max_jobs = std::max(1u, std::thread::hardware_concurrency());
+
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--data-span") {
+            data_span = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        uint64_t value = 0;
+        try {
+            size_t used = 0;
+            value = std::stoull(argv[i + 1], &used);
+            if (used != std::string(argv[i + 1]).size()) throw std::invalid_argument(argv[i + 1]);
+        } catch (const std::exception&) {
+            std::cerr << "Error: " << arg << " needs a non-negative integer, got '" << argv[i + 1] << "'." << std::endl;
+            return 1;
+        }
+        ++i;
+        if (arg == "--interval") {
+            interval_sec = value;
+        } else if (arg == "--start") {
+            start_sec = value;
+            has_start = true;
+        } else if (arg == "--end") {
+            end_sec = value;
+            has_end = true;
+        } else if (arg == "--jobs") {
+            max_jobs = static_cast<unsigned int>(value);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (interval_sec == 0 || max_jobs == 0) {
+        std::cerr << "Error: --interval and --jobs must be positive." << std::endl;
+        return 1;
+    }
+
+    bool merged = feed == MERGED_BOOKS_FEED;
+    std::string upper_feed = feed;
+    std::transform(upper_feed.begin(), upper_feed.end(), upper_feed.begin(), ::toupper);
+    std::string bars_dir_path = "/home/vir/" + date + "/" + feed + "/bars";
+    std::string prefix = bars_dir_path + "/" + upper_feed + ".";
+    std::string output_path = prefix + "bar_grid_" + std::to_string(interval_sec) + "s.bin";
+
+    // Symbols with any bar output, as in correlation_generation
+    std::regex symbol_pattern("^" + upper_feed + "\\.(?:bars|fills_bars|bid_bars_L[0-9]|ask_bars_L[0-9])\\.([A-Z0-9_]+)\\.bin$");
+    std::set<std::string> symbol_set;
+    DIR* dir = opendir(bars_dir_path.c_str());
+    if (dir == NULL) {
+        std::cerr << "Error: Could not open bars directory: " << bars_dir_path << std::endl;
+        return 1;
+    }
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        std::string filename = ent->d_name;
+        std::smatch match;
+        if (!std::regex_match(filename, match, symbol_pattern)) {
+            continue;
+        }
+        if (match[1].length() >= static_cast<long>(BAR_GRID_SYMBOL_SIZE)) {
+            std::cerr << "Warning: Skipping symbol longer than " << BAR_GRID_SYMBOL_SIZE - 1 << " characters: " << match[1] << std::endl;
+            continue;
+        }
+        symbol_set.insert(match[1]);
+    }
+    closedir(dir);
+    std::vector<std::string> symbols(symbol_set.begin(), symbol_set.end());
+    if (symbols.empty()) {
+        std::cerr << "Error: No bar files in " << bars_dir_path << std::endl;
+        return 1;
+    }
+    if (merged) {
+        std::cout << "Note: mergedbooks has no fills bars; that series stays NaN." << std::endl;
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+
+    // Without explicit bounds, the grid spans the session of the date, or with --data-span the first to
+    // the last bar of any symbol
+    if (!data_span && (!has_start || !has_end)) {
+        uint64_t session_open = 0, session_close = 0;
+        if (!new_york_time_to_epoch(date, SESSION_OPEN_LOCAL_SEC, session_open) ||
+            !new_york_time_to_epoch(date, SESSION_CLOSE_LOCAL_SEC, session_close)) {
+            std::cerr << "Error: Cannot take the session from date '" << date << "'; give --start and --end or --data-span." << std::endl;
+            return 1;
+        }
+        if (!has_start) start_sec = session_open / interval_sec * interval_sec;
+        if (!has_end) end_sec = session_close;
+    }
+    if (data_span && (!has_start || !has_end)) {
+        uint64_t first_bar = UINT64_MAX, last_bar = 0;
+        for (const std::string& symbol : symbols) {
+            std::vector<SeriesBars> series;
+            std::string error;
+            if (!load_symbol_series(prefix, symbol, series, error)) {
+                std::cerr << "Error: " << error << std::endl;
+                return 1;
+            }
+            for (const SeriesBars& bars : series) {
+                if (!bars.timestamps.empty()) {
+                    first_bar = std::min(first_bar, bars.timestamps.front());
+                    last_bar = std::max(last_bar, bars.timestamps.back());
+                }
+            }
+        }
+        if (first_bar == UINT64_MAX) {
+            std::cerr << "Error: No bars in " << bars_dir_path << std::endl;
+            return 1;
+        }
+        if (!has_start) start_sec = first_bar / interval_sec * interval_sec;
+        if (!has_end) end_sec = last_bar + 1;
+    }
+    if (end_sec <= start_sec) {
+        std::cerr << "Error: The grid end must be after its start." << std::endl;
+        return 1;
+    }
+
+    BarGridHeader header = {};
+    header.magic = BAR_GRID_MAGIC;
+    header.version = BAR_GRID_VERSION;
+    header.num_symbols = static_cast<uint32_t>(symbols.size());
+    header.num_series = static_cast<uint32_t>(NUM_GRID_SERIES);
+    header.start_sec = start_sec;
+    header.interval_sec = interval_sec;
+    header.num_steps = (end_sec - start_sec + interval_sec - 1) / interval_sec;
+
+    std::vector<char> names(symbols.size() * BAR_GRID_SYMBOL_SIZE + NUM_GRID_SERIES * BAR_GRID_SERIES_SIZE, 0);
+    for (size_t s = 0; s < symbols.size(); ++s) {
+        std::memcpy(names.data() + s * BAR_GRID_SYMBOL_SIZE, symbols[s].data(), symbols[s].size());
+    }
+    for (size_t k = 0; k < NUM_GRID_SERIES; ++k) {
+        std::memcpy(names.data() + symbols.size() * BAR_GRID_SYMBOL_SIZE + k * BAR_GRID_SERIES_SIZE,
+                    GRID_SERIES[k].name, std::strlen(GRID_SERIES[k].name));
+    }
+    uint64_t row_bytes = header.num_steps * sizeof(double);
+    uint64_t closes_offset = sizeof(header) + names.size();
+    uint64_t activity_offset = closes_offset + NUM_GRID_SERIES * symbols.size() * row_bytes;
+    uint64_t file_size = activity_offset + symbols.size() * header.num_steps;
+
+    int fd = open(output_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        std::cerr << "Error: Could not open output file: " << output_path << std::endl;
+        return 1;
+    }
+    if (ftruncate(fd, static_cast<off_t>(file_size)) != 0 || !pwrite_all(fd, &header, sizeof(header), 0) ||
+        !pwrite_all(fd, names.data(), names.size(), sizeof(header))) {
+        std::cerr << "Error: Could not write output file: " << output_path << std::endl;
+        close(fd);
+        return 1;
+    }
+
+    unsigned int num_workers = static_cast<unsigned int>(std::min<size_t>(max_jobs, symbols.size()));
+    std::cout << "Building a " << symbols.size() << " x " << NUM_GRID_SERIES << " x " << header.num_steps
+              << " grid (" << interval_sec << " s steps from " << start_sec << ") with " << num_workers << " workers" << std::endl;
+
+    // Every symbol owns disjoint rows of the file, so workers write without coordination
+    std::atomic<size_t> next_symbol{0};
+    std::atomic<size_t> failed_count{0};
+    std::mutex console_mutex;
+    std::vector<std::thread> workers;
+    for (unsigned int w = 0; w < num_workers; ++w) {
+        workers.emplace_back([&]() {
+            std::vector<SeriesBars> series;
+            std::vector<double> row(header.num_steps);
+            std::vector<uint8_t> activity(header.num_steps);
+            for (size_t s = next_symbol++; s < symbols.size(); s = next_symbol++) {
+                std::string error;
+                bool ok = load_symbol_series(prefix, symbols[s], series, error);
+                std::fill(activity.begin(), activity.end(), 0);
+                for (size_t k = 0; ok && k < NUM_GRID_SERIES; ++k) {
+                    fill_grid_row(series[k], header, static_cast<uint8_t>(1u << k), row, activity);
+                    ok = pwrite_all(fd, row.data(), row_bytes, closes_offset + (k * symbols.size() + s) * row_bytes);
+                    if (!ok) error = "Could not write output file: " + output_path;
+                }
+                if (ok) {
+                    ok = pwrite_all(fd, activity.data(), activity.size(), activity_offset + s * header.num_steps);
+                    if (!ok) error = "Could not write output file: " + output_path;
+                }
+                if (!ok) {
+                    failed_count++;
+                    std::lock_guard<std::mutex> lock(console_mutex);
+                    std::cerr << "  Error for " << symbols[s] << ": " << error << std::endl;
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    close(fd);
+
+    double elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    if (failed_count > 0) {
+        std::cerr << "Failed: " << failed_count << " symbols; " << output_path << " is incomplete." << std::endl;
+        return 1;
+    }
+    std::cout << "Grid written to " << output_path << " in " << elapsed_seconds << " s." << std::endl;
+    return 0;
+}
@@ -0,0 +1,278 @@
+#include "compact_results.hpp"
+
+#include <iterator>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+#include <cstddef>
+
+// Largest encoding of one record: tag, two 10-byte varints per delta and per price, two bytes per side
+const size_t COMPACT_RECORD_MAX_SIZE = 1 + 10 + 10 + 2 * (10 + 1 + 1);
+
+static uint64_t zigzag_encode(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+static int64_t zigzag_decode(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+static size_t put_varint(uint8_t* out, uint64_t value) {
+    size_t size = 0;
+    while (value >= 0x80) {
+        out[size++] = static_cast<uint8_t>(value) | 0x80;
+        value >>= 7;
+    }
+    out[size++] = static_cast<uint8_t>(value);
+    return size;
+}
+
+// Returns false if the varint runs past end
+static bool get_varint(const uint8_t*& in, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && in < end; shift += 7) {
+        uint8_t byte = *in++;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint8_t clamp_to_byte(uint32_t value) {
+    return static_cast<uint8_t>(std::min<uint32_t>(value, UINT8_MAX));
+}
+
+CompactResultsWriter::SideState CompactResultsWriter::side_state(double exec_price, uint32_t levels, uint32_t venues) {
+    SideState side;
+    side.fillable = !std::isnan(exec_price);
+    side.price_nanos = side.fillable ? std::llround(exec_price * 1e9) : 0;
+    side.levels = clamp_to_byte(levels);
+    side.venues = clamp_to_byte(venues);
+    return side;
+}
+
+bool CompactResultsWriter::open(const std::string& path, uint32_t target_quantity, bool has_venues) {
+    path_ = path;
+    target_quantity_ = target_quantity;
+    flags_ = has_venues ? COMPACT_RESULTS_HAS_VENUES : 0;
+    file_.open(path, std::ios::binary | std::ios::trunc);
+    if (!file_.is_open()) {
+        return false;
+    }
+    CompactResultsHeader header = {COMPACT_RESULTS_MAGIC, COMPACT_RESULTS_VERSION, flags_, target_quantity_, 0};
+    file_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    buffer_.reserve(COMPACT_RESULTS_BLOCK_SIZE + COMPACT_RECORD_MAX_SIZE);
+    return static_cast<bool>(file_);
+}
+
+uint8_t CompactResultsWriter::encode_side(const SideState& current, SideState& last, uint8_t* fields, size_t& fields_size) {
+    uint8_t tag = 0;
+    if (!current.fillable && last.fillable) {
+        tag |= COMPACT_TAG_NAN;
+    } else if (current.fillable && (!last.fillable || current.price_nanos != last.price_nanos)) {
+        tag |= COMPACT_TAG_PRICE;
+        fields_size += put_varint(fields + fields_size, zigzag_encode(current.price_nanos - last.price_nanos));
+    }
+    if (current.levels != last.levels) {
+        tag |= COMPACT_TAG_LEVELS;
+        fields[fields_size++] = current.levels;
+    }
+    if (current.venues != last.venues) {
+        tag |= COMPACT_TAG_VENUES;
+        fields[fields_size++] = current.venues;
+    }
+    // The last price is kept through unfillable stretches; it is the base of the next delta
+    int64_t price_base = current.fillable ? current.price_nanos : last.price_nanos;
+    last = current;
+    last.price_nanos = price_base;
+    return tag;
+}
+
+bool CompactResultsWriter::write_state(uint64_t ts, uint64_t seqno, const SideState& bid, const SideState& ask) {
+    auto same_side = [](const SideState& a, const SideState& b) {
+        return a.fillable == b.fillable && (!a.fillable || a.price_nanos == b.price_nanos) &&
+               a.levels == b.levels && a.venues == b.venues;
+    };
+    if (!first_record_to_write_ && same_side(bid, last_bid_) && same_side(ask, last_ask_)) {
+        return true;
+    }
+
+    uint8_t record[COMPACT_RECORD_MAX_SIZE];
+    size_t size = 1;
+    size += put_varint(record + size, zigzag_encode(static_cast<int64_t>(ts - last_ts_)));
+    size += put_varint(record + size, zigzag_encode(static_cast<int64_t>(seqno - last_seqno_)));
+    uint8_t bid_tag = encode_side(bid, last_bid_, record, size);
+    uint8_t ask_tag = encode_side(ask, last_ask_, record, size);
+    record[0] = static_cast<uint8_t>(bid_tag | (ask_tag << COMPACT_TAG_ASK_SHIFT));
+
+    buffer_.insert(buffer_.end(), reinterpret_cast<const char *>(record), reinterpret_cast<const char *>(record) + size);
+    if (buffer_.size() >= COMPACT_RESULTS_BLOCK_SIZE) {
+        file_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+        buffer_.clear();
+    }
+    last_ts_ = ts;
+    last_seqno_ = seqno;
+    first_record_to_write_ = false;
+    records_written_++;
+    return static_cast<bool>(file_);
+}
+
+bool CompactResultsWriter::write_if_changed(const ExecutionResult& result) {
+    return write_state(result.timestamp, result.seqno,
+                       side_state(result.bid_exec_price, result.bid_levels_consumed, 0),
+                       side_state(result.ask_exec_price, result.ask_levels_consumed, 0));
+}
+
+bool CompactResultsWriter::write_if_changed(const ConsolidatedExecutionResult& result) {
+    return write_state(result.timestamp, result.seqno,
+                       side_state(result.bid_exec_price, result.bid_levels_consumed, result.bid_venues_touched),
+                       side_state(result.ask_exec_price, result.ask_levels_consumed, result.ask_venues_touched));
+}
+
+bool CompactResultsWriter::close() {
+    if (!file_.is_open()) {
+        return false;
+    }
+    file_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    buffer_.clear();
+    uint32_t record_count = static_cast<uint32_t>(records_written_);
+    file_.seekp(offsetof(CompactResultsHeader, record_count));
+    file_.write(reinterpret_cast<const char *>(&record_count), sizeof(record_count));
+    bool ok = static_cast<bool>(file_);
+    file_.close();
+    return ok;
+}
+
+static void reserve_columns(ExecutionResultColumns& columns, size_t count, bool has_venues) {
+    columns.timestamp.reserve(count);
+    columns.seqno.reserve(count);
+    columns.bid_exec_price.reserve(count);
+    columns.bid_levels_consumed.reserve(count);
+    columns.ask_exec_price.reserve(count);
+    columns.ask_levels_consumed.reserve(count);
+    if (has_venues) {
+        columns.bid_venues_touched.reserve(count);
+        columns.ask_venues_touched.reserve(count);
+    }
+}
+
+template <typename Result>
+static bool read_v1_results(const std::vector<char>& data, ExecutionResultColumns& columns, std::string& error) {
+    constexpr bool has_venues = std::is_same<Result, ConsolidatedExecutionResult>::value;
+    if (data.size() % sizeof(Result) != 0) {
+        error = "size is not a multiple of the v1 record size";
+        return false;
+    }
+    size_t count = data.size() / sizeof(Result);
+    reserve_columns(columns, count, has_venues);
+    for (size_t i = 0; i < count; ++i) {
+        Result result;
+        std::memcpy(&result, data.data() + i * sizeof(Result), sizeof(Result));
+        columns.timestamp.push_back(result.timestamp);
+        columns.seqno.push_back(result.seqno);
+        columns.bid_exec_price.push_back(result.bid_exec_price);
+        columns.bid_levels_consumed.push_back(clamp_to_byte(result.bid_levels_consumed));
+        columns.ask_exec_price.push_back(result.ask_exec_price);
+        columns.ask_levels_consumed.push_back(clamp_to_byte(result.ask_levels_consumed));
+        if constexpr (has_venues) {
+            columns.bid_venues_touched.push_back(clamp_to_byte(result.bid_venues_touched));
+            columns.ask_venues_touched.push_back(clamp_to_byte(result.ask_venues_touched));
+        }
+    }
+    return true;
+}
+
+// Applies the fields of one side from a v2 record; returns false on truncated input
+static bool decode_side(uint8_t tag, const uint8_t*& in, const uint8_t* end, bool& fillable, int64_t& price_nanos,
+                        uint8_t& levels, uint8_t& venues) {
+    if (tag & COMPACT_TAG_NAN) {
+        fillable = false;
+    } else if (tag & COMPACT_TAG_PRICE) {
+        uint64_t delta;
+        if (!get_varint(in, end, delta)) return false;
+        price_nanos += zigzag_decode(delta);
+        fillable = true;
+    }
+    if (tag & COMPACT_TAG_LEVELS) {
+        if (in >= end) return false;
+        levels = *in++;
+    }
+    if (tag & COMPACT_TAG_VENUES) {
+        if (in >= end) return false;
+        venues = *in++;
+    }
+    return true;
+}
+
+bool read_execution_results(const std::string& path, ResultsV1Layout v1_layout, ExecutionResultColumns& columns,
+                            std::string& error) {
+    columns = ExecutionResultColumns();
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        error = "Could not open results file: " + path;
+        return false;
+    }
+    std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    CompactResultsHeader header = {};
+    if (data.size() >= sizeof(header)) {
+        std::memcpy(&header, data.data(), sizeof(header));
+    }
+    if (header.magic != COMPACT_RESULTS_MAGIC) {
+        bool read = v1_layout == ResultsV1Layout::ConsolidatedExecution
+                        ? read_v1_results<ConsolidatedExecutionResult>(data, columns, error)
+                        : read_v1_results<ExecutionResult>(data, columns, error);
+        if (!read) {
+            error = "Not a v2 results file and not a v1 one (" + error + "): " + path;
+            return false;
+        }
+        return true;
+    }
+    if (header.version != COMPACT_RESULTS_VERSION) {
+        error = "Unsupported results version " + std::to_string(header.version) + ": " + path;
+        return false;
+    }
+
+    bool has_venues = (header.flags & COMPACT_RESULTS_HAS_VENUES) != 0;
+    columns.target_quantity = header.target_quantity;
+    reserve_columns(columns, header.record_count, has_venues);
+
+    const uint8_t* in = reinterpret_cast<const uint8_t *>(data.data()) + sizeof(header);
+    const uint8_t* end = reinterpret_cast<const uint8_t *>(data.data()) + data.size();
+    uint64_t ts = 0, seqno = 0;
+    bool bid_fillable = false, ask_fillable = false;
+    int64_t bid_nanos = 0, ask_nanos = 0;
+    uint8_t bid_levels = 0, ask_levels = 0, bid_venues = 0, ask_venues = 0;
+    for (uint32_t i = 0; i < header.record_count; ++i) {
+        uint64_t ts_delta, seqno_delta;
+        if (in >= end) break;
+        uint8_t tag = *in++;
+        if (!get_varint(in, end, ts_delta) || !get_varint(in, end, seqno_delta) ||
+            !decode_side(tag & 0x0f, in, end, bid_fillable, bid_nanos, bid_levels, bid_venues) ||
+            !decode_side(tag >> COMPACT_TAG_ASK_SHIFT, in, end, ask_fillable, ask_nanos, ask_levels, ask_venues)) {
+            error = "Truncated record " + std::to_string(i) + " in: " + path;
+            return false;
+        }
+        ts += static_cast<uint64_t>(zigzag_decode(ts_delta));
+        seqno += static_cast<uint64_t>(zigzag_decode(seqno_delta));
+
+        columns.timestamp.push_back(ts);
+        columns.seqno.push_back(seqno);
+        columns.bid_exec_price.push_back(bid_fillable ? static_cast<double>(bid_nanos) / 1e9 : NAN);
+        columns.bid_levels_consumed.push_back(bid_levels);
+        columns.ask_exec_price.push_back(ask_fillable ? static_cast<double>(ask_nanos) / 1e9 : NAN);
+        columns.ask_levels_consumed.push_back(ask_levels);
+        if (has_venues) {
+            columns.bid_venues_touched.push_back(bid_venues);
+            columns.ask_venues_touched.push_back(ask_venues);
+        }
+    }
+    if (columns.size() != header.record_count) {
+        error = "Expected " + std::to_string(header.record_count) + " records, found " + std::to_string(columns.size()) + ": " + path;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,113 @@
+#ifndef COMPACT_RESULTS_HPP
+#define COMPACT_RESULTS_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+
+#include "impact_kernels.hpp"
+
+// --- Constants ---
+const uint32_t COMPACT_RESULTS_MAGIC = 0x32525049; // "IPR2"
+const uint16_t COMPACT_RESULTS_VERSION = 2;
+const std::string COMPACT_RESULTS_SUFFIX = ".results.v2.bin";
+const uint16_t COMPACT_RESULTS_HAS_VENUES = 1;
+const size_t COMPACT_RESULTS_BLOCK_SIZE = 1 << 20;
+
+#pragma pack(push, 1)
+
+// Followed by record_count variable-length records. Each record is a tag byte, the zigzag varint
+// deltas of ts and seqno from the previous record, then only the fields the tag marks as changed:
+// a price as a zigzag varint delta (in nanos) from the last price of that side, levels and venues
+// as one byte each. Fields not marked keep their previous value.
+struct CompactResultsHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+    uint32_t target_quantity;
+    uint32_t record_count;
+};
+static_assert(sizeof(CompactResultsHeader) == 16, "CompactResultsHeader size mismatch");
+
+#pragma pack(pop)
+
+// Tag bits of one side; the ask side uses the same bits shifted left by 4
+const uint8_t COMPACT_TAG_PRICE = 1 << 0;   // price delta follows, side is fillable
+const uint8_t COMPACT_TAG_NAN = 1 << 1;     // side is not fillable any more
+const uint8_t COMPACT_TAG_LEVELS = 1 << 2;  // levels byte follows
+const uint8_t COMPACT_TAG_VENUES = 1 << 3;  // venues byte follows
+const int COMPACT_TAG_ASK_SHIFT = 4;
+
+// Drop-in for ExecutionOutput that writes the v2 encoding. Prices are rounded to whole nanos
+// and a record is only written when the rounded state changes, so small float noise costs nothing.
+class CompactResultsWriter {
+public:
+    // Returns false if the file cannot be opened. has_venues is set for consolidated results.
+    bool open(const std::string& path, uint32_t target_quantity, bool has_venues);
+
+    bool write_if_changed(const ExecutionResult& result);
+    bool write_if_changed(const ConsolidatedExecutionResult& result);
+
+    // Flushes and stores the record count in the header; returns false on a write error
+    bool close();
+
+    uint32_t target_quantity() const { return target_quantity_; }
+    const std::string& path() const { return path_; }
+    long records_written() const { return records_written_; }
+
+private:
+    struct SideState {
+        bool fillable = false;
+        int64_t price_nanos = 0;
+        uint8_t levels = 0;
+        uint8_t venues = 0;
+    };
+
+    static SideState side_state(double exec_price, uint32_t levels, uint32_t venues);
+    bool write_state(uint64_t ts, uint64_t seqno, const SideState& bid, const SideState& ask);
+    uint8_t encode_side(const SideState& current, SideState& last, uint8_t* fields, size_t& fields_size);
+
+    std::ofstream file_;
+    std::string path_;
+    std::vector<char> buffer_;
+    uint32_t target_quantity_ = 0;
+    uint16_t flags_ = 0;
+    long records_written_ = 0;
+    bool first_record_to_write_ = true;
+    uint64_t last_ts_ = 0;
+    uint64_t last_seqno_ = 0;
+    SideState last_bid_;
+    SideState last_ask_;
+};
+
+// A results file decoded into one array per field. Prices are NaN where the side was not fillable;
+// the venue columns are empty unless the file has them.
+struct ExecutionResultColumns {
+    uint32_t target_quantity = 0;
+    std::vector<uint64_t> timestamp;
+    std::vector<uint64_t> seqno;
+    std::vector<double> bid_exec_price;
+    std::vector<uint8_t> bid_levels_consumed;
+    std::vector<uint8_t> bid_venues_touched;
+    std::vector<double> ask_exec_price;
+    std::vector<uint8_t> ask_levels_consumed;
+    std::vector<uint8_t> ask_venues_touched;
+
+    size_t size() const { return timestamp.size(); }
+};
+
+// Record type of a v1 results file. Both are 48 bytes and v1 files have no header, so the file
+// cannot tell which one it holds: the consolidated-depth mode writes ConsolidatedExecutionResult.
+enum class ResultsV1Layout {
+    Execution,
+    ConsolidatedExecution
+};
+
+// Reads a v2 file, or a v1 file of raw v1_layout records (which has no header and no target quantity).
+// v1_layout is ignored for v2 files, whose header flags say whether they have venues.
+// Returns false with error set if the file is unreadable or malformed.
+bool read_execution_results(const std::string& path, ResultsV1Layout v1_layout, ExecutionResultColumns& columns,
+                            std::string& error);
+
+#endif
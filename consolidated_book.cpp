@@ -0,0 +1,765 @@
+#include "consolidated_book.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <iomanip>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <limits>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+// --- Constants ---
+const size_t OUTPUT_BLOCK_SIZE = 1 << 20;
+
+struct VenueData {
+    uint32_t quantity;
+    uint64_t feed_id;
+    uint8_t slot;
+
+    bool operator<(const VenueData& other) const {
+        if (feed_id != other.feed_id) return feed_id < other.feed_id;
+        return quantity < other.quantity;
+    }
+};
+
+// Venue storage for every level of one snapshot. A venue row contributes at most VENUE_LEVELS
+// entries per side, so the capacity is fixed; reset() rewinds it before each snapshot is built.
+struct VenueArena {
+    std::array<VenueData, 2 * VENUE_LEVELS * MAX_VENUES> storage;
+    size_t used = 0;
+
+    void reset() { used = 0; }
+};
+
+// venues points into the arena of the snapshot holding the level
+struct SnapshotLevel {
+    int64_t price = 0;
+    const VenueData* venues = nullptr;
+    size_t num_venues = 0;
+};
+
+// Consolidated levels of one side, best first. Depth is a compile-time constant so every level
+// loop below has a fixed trip count and can be unrolled.
+template <int Depth>
+struct SnapshotSide {
+    std::array<SnapshotLevel, Depth> levels;
+    int count = 0;
+};
+
+// Rebuilt in place for every record; levels reference the snapshot's own arena, so it is not copyable.
+template <int Depth>
+struct ConsolidatedSnapshot {
+    SnapshotSide<Depth> bids;
+    SnapshotSide<Depth> asks;
+    VenueArena arena;
+
+    ConsolidatedSnapshot() = default;
+    ConsolidatedSnapshot(const ConsolidatedSnapshot&) = delete;
+    ConsolidatedSnapshot& operator=(const ConsolidatedSnapshot&) = delete;
+
+    bool empty() const { return bids.count == 0 && asks.count == 0; }
+};
+
+void build_depth_ladder(const VenueQuoteTable& table, bool is_bid, DepthLadder& ladder) {
+    const auto& prices = is_bid ? table.bid_price : table.ask_price;
+    const auto& quantities = is_bid ? table.bid_qty : table.ask_qty;
+
+    struct Quote {
+        int64_t price;
+        uint32_t quantity;
+        size_t slot;
+    };
+    std::array<Quote, VENUE_LEVELS * MAX_VENUES> quotes;
+    size_t num_quotes = 0;
+    for (int level = 0; level < VENUE_LEVELS; ++level) {
+        for (size_t v = 0; v < table.num_venues; ++v) {
+            if (prices[level][v] != 0 && quantities[level][v] > 0) {
+                quotes[num_quotes++] = {prices[level][v], quantities[level][v], v};
+            }
+        }
+    }
+    std::sort(quotes.begin(), quotes.begin() + num_quotes, [is_bid](const Quote& a, const Quote& b) {
+        return is_bid ? a.price > b.price : a.price < b.price;
+    });
+
+    ladder.count = 0;
+    for (size_t i = 0; i < num_quotes; ++i) {
+        const Quote& quote = quotes[i];
+        if (ladder.count == 0 || ladder.price[ladder.count - 1] != quote.price) {
+            ladder.price[ladder.count] = quote.price;
+            ladder.quantity[ladder.count] = 0;
+            ladder.venue_mask[ladder.count] = 0;
+            ladder.count++;
+        }
+        ladder.quantity[ladder.count - 1] += quote.quantity;
+        ladder.venue_mask[ladder.count - 1] |= uint64_t(1) << quote.slot;
+    }
+}
+
+// Builds up to Depth consolidated levels for one side. Each pass is a branch-free max (bids) or
+// min (asks) over the contiguous price rows below/above the previously chosen price, followed by
+// a compare pass that gathers the venues quoting exactly that price.
+template <bool IsBid, int Depth>
+void build_side_levels(const VenueQuoteTable& table,
+                       const int64_t (&prices)[VENUE_LEVELS][MAX_VENUES],
+                       const uint32_t (&quantities)[VENUE_LEVELS][MAX_VENUES],
+                       SnapshotSide<Depth>& side, VenueArena& arena) {
+    // Every venue row is scanned even for small Depth: feeds do publish an empty L1 above a live L2,
+    // or the same price on two levels, and a depth-1 view must still match the top of the depth-3 one.
+    const size_t num_venues = table.num_venues;
+    int64_t bound = IsBid ? std::numeric_limits<int64_t>::max() : std::numeric_limits<int64_t>::min();
+
+    side.count = 0;
+    for (int depth_index = 0; depth_index < Depth; ++depth_index) {
+        int64_t best = IsBid ? std::numeric_limits<int64_t>::min() : std::numeric_limits<int64_t>::max();
+        bool found = false;
+        for (int level = 0; level < VENUE_LEVELS; ++level) {
+            const int64_t* row_prices = prices[level];
+            const uint32_t* row_quantities = quantities[level];
+            for (size_t v = 0; v < num_venues; ++v) {
+                int64_t price = row_prices[v];
+                bool eligible = price != 0 && row_quantities[v] > 0 && (IsBid ? price < bound : price > bound);
+                bool better = IsBid ? price > best : price < best;
+                best = (eligible && better) ? price : best;
+                found |= eligible;
+            }
+        }
+        if (!found) break;
+
+        SnapshotLevel& snapshot_level = side.levels[depth_index];
+        VenueData* level_venues = arena.storage.data() + arena.used;
+        size_t level_venue_count = 0;
+        for (size_t v = 0; v < num_venues; ++v) {
+            for (int level = 0; level < VENUE_LEVELS; ++level) {
+                if (prices[level][v] == best && quantities[level][v] > 0) {
+                    level_venues[level_venue_count++] = {quantities[level][v], table.feed_ids[v], static_cast<uint8_t>(v)};
+                }
+            }
+        }
+        std::sort(level_venues, level_venues + level_venue_count);
+        arena.used += level_venue_count;
+
+        snapshot_level.price = best;
+        snapshot_level.venues = level_venues;
+        snapshot_level.num_venues = level_venue_count;
+        side.count = depth_index + 1;
+        bound = best;
+    }
+}
+
+template <int Depth>
+void create_snapshot(const VenueQuoteTable& table, ConsolidatedSnapshot<Depth>& snapshot) {
+    snapshot.arena.reset();
+    build_side_levels<true, Depth>(table, table.bid_price, table.bid_qty, snapshot.bids, snapshot.arena);
+    build_side_levels<false, Depth>(table, table.ask_price, table.ask_qty, snapshot.asks, snapshot.arena);
+}
+
+// Largest encoded snapshot: every level header plus every venue the arena can hold
+template <int Depth>
+constexpr size_t max_encoded_snapshot_size() {
+    return sizeof(SnapshotHeaderWrite) + 2 * Depth * sizeof(LevelHeaderWrite) +
+           2 * VENUE_LEVELS * MAX_VENUES * sizeof(VenueAtLevelWrite);
+}
+
+template <typename T>
+void append_bytes(std::vector<char>& buffer, const T& value) {
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+// Accumulates encoded output and hands it to the stream in OUTPUT_BLOCK_SIZE blocks,
+// one write call per block. A null stream discards everything.
+class BlockWriter {
+public:
+    explicit BlockWriter(std::ofstream* out) : out_(out) {
+        if (out_) buffer_.reserve(OUTPUT_BLOCK_SIZE);
+    }
+
+    void append(const char* data, size_t size) {
+        if (!out_) return;
+        buffer_.insert(buffer_.end(), data, data + size);
+        if (buffer_.size() >= OUTPUT_BLOCK_SIZE) flush();
+    }
+
+    void flush() {
+        if (out_ && !buffer_.empty()) {
+            out_->write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+        }
+        buffer_.clear();
+    }
+
+private:
+    std::ofstream* out_;
+    std::vector<char> buffer_;
+};
+
+template <int Depth>
+void encode_side_levels(std::vector<char>& buffer, const SnapshotSide<Depth>& side) {
+    for (int i = 0; i < side.count; ++i) {
+        const SnapshotLevel& level_data = side.levels[i];
+        LevelHeaderWrite lh_write;
+        lh_write.price_at_level = level_data.price;
+        lh_write.num_venues = static_cast<uint8_t>(level_data.num_venues);
+        append_bytes(buffer, lh_write);
+        for (size_t v = 0; v < level_data.num_venues; ++v) {
+            VenueAtLevelWrite val_write;
+            val_write.quantity_from_venue = level_data.venues[v].quantity;
+            val_write.feed_id_of_original_venue = level_data.venues[v].feed_id;
+            append_bytes(buffer, val_write);
+        }
+    }
+}
+
+// Replaces the contents of buffer with the processed_tops encoding of one snapshot
+template <int Depth>
+void encode_snapshot(std::vector<char>& buffer, uint64_t snapshot_ts, const ConsolidatedSnapshot<Depth>& snapshot) {
+    buffer.clear();
+    SnapshotHeaderWrite sh_write;
+    sh_write.timestamp = snapshot_ts;
+    sh_write.num_bid_levels = static_cast<uint8_t>(snapshot.bids.count);
+    sh_write.num_ask_levels = static_cast<uint8_t>(snapshot.asks.count);
+    append_bytes(buffer, sh_write);
+    encode_side_levels(buffer, snapshot.bids);
+    encode_side_levels(buffer, snapshot.asks);
+}
+
+// Two encoded snapshots describe the same book when everything after the timestamp matches
+bool same_encoded_book(const std::vector<char>& a, const std::vector<char>& b) {
+    const size_t ts_size = sizeof(uint64_t);
+    return a.size() == b.size() && a.size() >= ts_size &&
+           std::equal(a.begin() + ts_size, a.end(), b.begin() + ts_size);
+}
+
+// Fills one side of an NBBO record from the best consolidated level
+template <int Depth>
+void fill_nbbo_side(const SnapshotSide<Depth>& side, int64_t& price, uint64_t& total_qty,
+                    uint64_t& venue_mask, uint8_t& venue_count) {
+    price = 0;
+    total_qty = 0;
+    venue_mask = 0;
+    venue_count = 0;
+    if (side.count == 0) return;
+
+    const SnapshotLevel& best = side.levels[0];
+    price = best.price;
+    for (size_t v = 0; v < best.num_venues; ++v) {
+        total_qty += best.venues[v].quantity;
+        venue_mask |= uint64_t(1) << best.venues[v].slot;
+    }
+    venue_count = static_cast<uint8_t>(best.num_venues);
+}
+
+template <int Depth>
+NbboRecordWrite make_nbbo_record(uint64_t ts, const ConsolidatedSnapshot<Depth>& snapshot) {
+    NbboRecordWrite nbbo = {};
+    nbbo.timestamp = ts;
+    fill_nbbo_side(snapshot.bids, nbbo.best_bid_price, nbbo.bid_total_qty, nbbo.bid_venue_mask, nbbo.bid_venue_count);
+    fill_nbbo_side(snapshot.asks, nbbo.best_ask_price, nbbo.ask_total_qty, nbbo.ask_venue_mask, nbbo.ask_venue_count);
+    return nbbo;
+}
+
+bool nbbo_changed(const NbboRecordWrite& a, const NbboRecordWrite& b) {
+    return a.best_bid_price != b.best_bid_price || a.best_ask_price != b.best_ask_price ||
+           a.bid_total_qty != b.bid_total_qty || a.ask_total_qty != b.ask_total_qty ||
+           a.bid_venue_mask != b.bid_venue_mask || a.ask_venue_mask != b.ask_venue_mask;
+}
+
+bool nbbo_price_changed(const NbboRecordWrite& a, const NbboRecordWrite& b) {
+    return a.best_bid_price != b.best_bid_price || a.best_ask_price != b.best_ask_price;
+}
+
+// Price and total quantity of the first FEATURE_LEVELS consolidated levels of each side.
+// An empty bid level has price 0, an empty ask level the largest price, so the OFI
+// comparisons treat a side that disappears as having moved away.
+struct BookTopLevels {
+    int64_t bid_price[FEATURE_LEVELS];
+    int64_t ask_price[FEATURE_LEVELS];
+    uint64_t bid_qty[FEATURE_LEVELS];
+    uint64_t ask_qty[FEATURE_LEVELS];
+};
+
+template <int Depth>
+void fill_top_levels(const SnapshotSide<Depth>& side, int64_t empty_price, int64_t (&prices)[FEATURE_LEVELS],
+                     uint64_t (&quantities)[FEATURE_LEVELS]) {
+    for (int k = 0; k < FEATURE_LEVELS; ++k) {
+        prices[k] = empty_price;
+        quantities[k] = 0;
+        if (k < side.count) {
+            const SnapshotLevel& level = side.levels[k];
+            prices[k] = level.price;
+            for (size_t v = 0; v < level.num_venues; ++v) {
+                quantities[k] += level.venues[v].quantity;
+            }
+        }
+    }
+}
+
+template <int Depth>
+BookTopLevels make_top_levels(const ConsolidatedSnapshot<Depth>& snapshot) {
+    BookTopLevels top;
+    fill_top_levels(snapshot.bids, 0, top.bid_price, top.bid_qty);
+    fill_top_levels(snapshot.asks, std::numeric_limits<int64_t>::max(), top.ask_price, top.ask_qty);
+    return top;
+}
+
+// Aggregates consecutive book states into BookFeatureBarRecords of a fixed width. A state holds
+// from its ts until the next one, including across bar boundaries.
+class BookFeatureBuilder {
+public:
+    BookFeatureBuilder(std::ofstream* out, uint64_t bar_ns) : writer_(out), bar_ns_(bar_ns) {}
+
+    void add(uint64_t ts, const BookTopLevels& top) {
+        uint64_t bar_start = ts / bar_ns_ * bar_ns_;
+        if (has_bar_ && bar_start != bar_.bar_start_ns) {
+            close_bar();
+        }
+        if (!has_bar_) {
+            bar_ = BookFeatureBarRecord();
+            bar_.bar_start_ns = bar_start;
+            microprice_sum_ = 0.0;
+            microprice_weight_ = 0.0;
+            has_bar_ = true;
+        }
+        if (has_previous_) {
+            accumulate_microprice(ts);
+            for (int k = 0; k < FEATURE_LEVELS; ++k) {
+                bar_.ofi[k] += level_ofi(previous_, top, k);
+            }
+        }
+        bar_.update_count++;
+        previous_ = top;
+        previous_ts_ = ts;
+        has_previous_ = true;
+    }
+
+    // Writes the last bar, whose final state is taken to hold until the bar's end
+    void finish() {
+        if (has_bar_) {
+            close_bar();
+        }
+        writer_.flush();
+    }
+
+    uint32_t bars_written() const { return bars_written_; }
+
+private:
+    static int64_t level_ofi(const BookTopLevels& before, const BookTopLevels& after, int k) {
+        int64_t flow = 0;
+        if (after.bid_price[k] >= before.bid_price[k]) flow += static_cast<int64_t>(after.bid_qty[k]);
+        if (after.bid_price[k] <= before.bid_price[k]) flow -= static_cast<int64_t>(before.bid_qty[k]);
+        if (after.ask_price[k] <= before.ask_price[k]) flow -= static_cast<int64_t>(after.ask_qty[k]);
+        if (after.ask_price[k] >= before.ask_price[k]) flow += static_cast<int64_t>(before.ask_qty[k]);
+        return flow;
+    }
+
+    static double microprice(const BookTopLevels& top) {
+        if (top.bid_qty[0] == 0 || top.ask_qty[0] == 0) {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        double bid = static_cast<double>(top.bid_price[0]) / 1e9;
+        double ask = static_cast<double>(top.ask_price[0]) / 1e9;
+        double bid_qty = static_cast<double>(top.bid_qty[0]);
+        double ask_qty = static_cast<double>(top.ask_qty[0]);
+        return (ask * bid_qty + bid * ask_qty) / (bid_qty + ask_qty);
+    }
+
+    // Weights the previous state's microprice by the part of [previous_ts_, until) inside the bar
+    void accumulate_microprice(uint64_t until) {
+        uint64_t from = std::max(previous_ts_, bar_.bar_start_ns);
+        if (until <= from) return;
+        double value = microprice(previous_);
+        if (!std::isnan(value)) {
+            double weight = static_cast<double>(until - from);
+            microprice_sum_ += value * weight;
+            microprice_weight_ += weight;
+        }
+    }
+
+    void close_bar() {
+        accumulate_microprice(bar_.bar_start_ns + bar_ns_);
+        for (int k = 0; k < FEATURE_LEVELS; ++k) {
+            uint64_t total = previous_.bid_qty[k] + previous_.ask_qty[k];
+            bar_.depth_imbalance[k] = total == 0 ? std::numeric_limits<double>::quiet_NaN()
+                : (static_cast<double>(previous_.bid_qty[k]) - static_cast<double>(previous_.ask_qty[k])) / static_cast<double>(total);
+        }
+        bar_.microprice = microprice(previous_);
+        bar_.microprice_twap = microprice_weight_ > 0.0 ? microprice_sum_ / microprice_weight_
+                                                        : std::numeric_limits<double>::quiet_NaN();
+        writer_.append(reinterpret_cast<const char*>(&bar_), sizeof(BookFeatureBarRecord));
+        bars_written_++;
+        has_bar_ = false;
+    }
+
+    BlockWriter writer_;
+    uint64_t bar_ns_;
+    BookFeatureBarRecord bar_ = {};
+    bool has_bar_ = false;
+    double microprice_sum_ = 0.0;
+    double microprice_weight_ = 0.0;
+    BookTopLevels previous_ = {};
+    uint64_t previous_ts_ = 0;
+    bool has_previous_ = false;
+    uint32_t bars_written_ = 0;
+};
+
+struct ConsolidationResult {
+    uint32_t input_records = 0;
+    uint32_t snapshots_written = 0;
+    uint32_t nbbo_records_written = 0;
+    uint32_t feature_bars_written = 0;
+    std::vector<uint64_t> venue_feed_ids;
+    std::vector<SnapshotIndexEntry> index_entries;
+    std::vector<std::string> warnings;
+};
+
+// Consolidates every remaining merged_tops entry of f_in into Depth-level snapshots.
+// Any output may be null: snapshot_out receives the variable-length processed_tops stream,
+// nbbo_out the fixed-width NbboRecordWrite stream, features_out the BookFeatureBarRecords.
+template <int Depth>
+ConsolidationResult consolidate_tops_stream(std::ifstream& f_in, std::ofstream* snapshot_out, std::ofstream* nbbo_out,
+                                            std::ofstream* features_out,
+                                            const std::string& input_filepath, const ConsolidationOptions& options) {
+    VenueQuoteTable latest_venue_quotes;
+    ConsolidatedSnapshot<Depth> current_snapshot;
+    BlockWriter snapshot_writer(snapshot_out);
+    BlockWriter nbbo_writer(nbbo_out);
+    BookFeatureBuilder feature_builder(features_out, options.feature_bar_ns);
+    // Encoding of the current snapshot and of the last one written; swapped on every write
+    std::vector<char> encoded_snapshot;
+    std::vector<char> last_written_encoded;
+    encoded_snapshot.reserve(max_encoded_snapshot_size<Depth>());
+    last_written_encoded.reserve(max_encoded_snapshot_size<Depth>());
+    NbboRecordWrite last_written_snapshot_nbbo = {};
+    NbboRecordWrite last_written_nbbo = {};
+    ConsolidationResult result;
+
+    uint32_t total_input_records_read = 0;
+    bool venue_overflow_reported = false;
+    uint64_t snapshot_file_offset = OUTPUT_FILE_HEADER_SIZE;
+
+    // Conflation state: the table has changed since the last emit, as of pending_ts, within pending_interval
+    bool has_pending = false;
+    uint64_t pending_ts = 0;
+    uint64_t pending_interval = 0;
+
+    // Every record counts for the features, an emptied book included, and conflation does not apply
+    // to them: current_snapshot is then rebuilt on every update and already holds the latest state
+    // when a snapshot is emitted
+    auto apply_record = [&](int venue_slot, const VenueTopsRecord& record) {
+        latest_venue_quotes.update(venue_slot, record);
+        if (features_out) {
+            create_snapshot(latest_venue_quotes, current_snapshot);
+            feature_builder.add(record.ts, make_top_levels(current_snapshot));
+        }
+    };
+
+    auto emit_state = [&](uint64_t snapshot_ts) {
+        if (!features_out) {
+            create_snapshot(latest_venue_quotes, current_snapshot);
+        }
+        if (current_snapshot.empty()) return;
+
+        NbboRecordWrite nbbo = make_nbbo_record(snapshot_ts, current_snapshot);
+
+        if (snapshot_out) {
+            bool changed;
+            if (options.nbbo_price_changes_only) {
+                changed = result.snapshots_written == 0 || nbbo_price_changed(nbbo, last_written_snapshot_nbbo);
+                if (changed) encode_snapshot(encoded_snapshot, snapshot_ts, current_snapshot);
+            } else {
+                encode_snapshot(encoded_snapshot, snapshot_ts, current_snapshot);
+                changed = !same_encoded_book(encoded_snapshot, last_written_encoded);
+            }
+            if (changed) {
+                if (options.index_interval != 0 && result.snapshots_written % options.index_interval == 0) {
+                    result.index_entries.push_back({snapshot_ts, snapshot_file_offset, result.snapshots_written});
+                }
+                snapshot_writer.append(encoded_snapshot.data(), encoded_snapshot.size());
+                snapshot_file_offset += encoded_snapshot.size();
+                result.snapshots_written++;
+                encoded_snapshot.swap(last_written_encoded);
+                last_written_snapshot_nbbo = nbbo;
+            }
+        }
+
+        if (nbbo_out) {
+            bool changed = result.nbbo_records_written == 0 ||
+                (options.nbbo_price_changes_only ? nbbo_price_changed(nbbo, last_written_nbbo)
+                                                 : nbbo_changed(nbbo, last_written_nbbo));
+            if (changed) {
+                nbbo_writer.append(reinterpret_cast<const char*>(&nbbo), sizeof(NbboRecordWrite));
+                result.nbbo_records_written++;
+                last_written_nbbo = nbbo;
+            }
+        }
+    };
+
+    char entry_buffer[MERGED_TOPS_FULL_ENTRY_SIZE];
+
+    while (f_in.read(entry_buffer, MERGED_TOPS_FULL_ENTRY_SIZE)) {
+        total_input_records_read++;
+        if (options.report_progress && total_input_records_read % 10000 == 0) {
+            std::cout << "  Processed " << total_input_records_read << " input records..." << std::endl;
+        }
+
+        uint64_t original_source_feed_id = *reinterpret_cast<uint64_t*>(entry_buffer);
+        VenueTopsRecord* current_tops_record = reinterpret_cast<VenueTopsRecord*>(entry_buffer + MERGED_ENTRY_PREFIX_FEED_ID_SIZE);
+
+        int venue_slot = latest_venue_quotes.slot_for(original_source_feed_id);
+        if (venue_slot < 0) {
+            if (!venue_overflow_reported) {
+                result.warnings.push_back("More than " + std::to_string(MAX_VENUES) + " venues in '" + input_filepath +
+                                          "'. Skipping records from additional feed_ids.");
+                venue_overflow_reported = true;
+            }
+            continue;
+        }
+
+        if (options.conflation_interval_ns == 0) {
+            apply_record(venue_slot, *current_tops_record);
+            emit_state(current_tops_record->ts);
+            continue;
+        }
+
+        // Conflated: the snapshot is only built once per interval, from the state at the interval's end
+        uint64_t record_interval = current_tops_record->ts / options.conflation_interval_ns;
+        if (has_pending && record_interval != pending_interval) {
+            emit_state(pending_ts);
+            has_pending = false;
+        }
+        apply_record(venue_slot, *current_tops_record);
+        has_pending = true;
+        pending_ts = current_tops_record->ts;
+        pending_interval = record_interval;
+    }
+
+    if (has_pending) {
+        emit_state(pending_ts);
+    }
+    snapshot_writer.flush();
+    nbbo_writer.flush();
+    // The read that ended the loop stops short of a whole entry only on a truncated file
+    if (f_in.gcount() > 0) {
+        result.warnings.push_back("Encountered an incomplete final entry in '" + input_filepath + "'. Skipping.");
+    }
+
+    feature_builder.finish();
+    result.feature_bars_written = feature_builder.bars_written();
+
+    result.input_records = total_input_records_read;
+    result.venue_feed_ids.assign(latest_venue_quotes.feed_ids, latest_venue_quotes.feed_ids + latest_venue_quotes.num_venues);
+    return result;
+}
+
+bool parse_duration_ns(const std::string& text, uint64_t& duration_ns) {
+    size_t digits_end = 0;
+    while (digits_end < text.size() && std::isdigit(static_cast<unsigned char>(text[digits_end]))) {
+        ++digits_end;
+    }
+    if (digits_end == 0) return false;
+
+    uint64_t value = 0;
+    try {
+        value = std::stoull(text.substr(0, digits_end));
+    } catch (const std::out_of_range&) {
+        return false;
+    }
+    std::string unit = text.substr(digits_end);
+    uint64_t multiplier = 0;
+    if (unit.empty() || unit == "ns") multiplier = 1;
+    else if (unit == "us") multiplier = 1000;
+    else if (unit == "ms") multiplier = 1000000;
+    else if (unit == "s") multiplier = 1000000000;
+    else return false;
+
+    if (value > std::numeric_limits<uint64_t>::max() / multiplier) return false;
+    duration_ns = value * multiplier;
+    return duration_ns > 0;
+}
+
+std::string describe_consolidation_options(const ConsolidationOptions& options) {
+    return "depth=" + std::to_string(options.depth) +
+           " conflate_ns=" + std::to_string(options.conflation_interval_ns) +
+           " nbbo_price_changes_only=" + std::to_string(options.nbbo_price_changes_only ? 1 : 0) +
+           " feature_bar_ns=" + std::to_string(options.feature_bar_ns) +
+           " index_interval=" + std::to_string(options.index_interval);
+}
+
+bool is_supported_snapshot_depth(int depth) {
+    return depth == 1 || depth == 3 || depth == 5 || depth == 10;
+}
+
+ConsolidationFileResult process_merged_tops_file(const std::string& input_filepath,
+                                                 const std::string& output_filepath,
+                                                 const std::string& nbbo_filepath,
+                                                 const std::string& features_filepath,
+                                                 const ConsolidationOptions& options) {
+    ConsolidationFileResult file_result;
+    if (output_filepath.empty() && nbbo_filepath.empty() && features_filepath.empty()) {
+        file_result.error = "No output requested for '" + input_filepath + "'";
+        return file_result;
+    }
+    if (!features_filepath.empty() && options.feature_bar_ns == 0) {
+        file_result.error = "Feature bar width must be positive";
+        return file_result;
+    }
+
+    // An NBBO-only run needs a single consolidated level; features look at FEATURE_LEVELS
+    int snapshot_depth = options.depth;
+    if (snapshot_depth == 0) {
+        snapshot_depth = output_filepath.empty() && features_filepath.empty() ? 1 : DEFAULT_SNAPSHOT_DEPTH;
+    }
+    if (!is_supported_snapshot_depth(snapshot_depth)) {
+        file_result.error = "Unsupported snapshot depth " + std::to_string(snapshot_depth) + " (expected 1, 3, 5 or 10)";
+        return file_result;
+    }
+    if (!features_filepath.empty() && snapshot_depth < FEATURE_LEVELS) {
+        file_result.error = "Book features need a snapshot depth of at least " + std::to_string(FEATURE_LEVELS) +
+                            ", got " + std::to_string(snapshot_depth);
+        return file_result;
+    }
+
+    std::ifstream f_in(input_filepath, std::ios::binary);
+    if (!f_in) {
+        file_result.error = "Input file not found or cannot be opened: " + input_filepath;
+        return file_result;
+    }
+
+    InputFileHeader input_header;
+    f_in.read(reinterpret_cast<char*>(&input_header), sizeof(InputFileHeader));
+    if (static_cast<size_t>(f_in.gcount()) < sizeof(InputFileHeader)) {
+        file_result.error = "Input file '" + input_filepath + "' is too small to contain a valid header";
+        return file_result;
+    }
+    file_result.dateint = input_header.dateint;
+    file_result.symbol_idx = input_header.symbol_idx;
+    if (options.report_progress) {
+        std::cout << "Input file ('" << input_filepath << "') header: DateInt=" << input_header.dateint
+                  << ", SymbolIdx=" << input_header.symbol_idx
+                  << ", TotalRecords=" << input_header.total_record_count << std::endl;
+    }
+
+    std::ofstream f_out;
+    if (!output_filepath.empty()) {
+        f_out.open(output_filepath, std::ios::binary | std::ios::trunc);
+        if (!f_out) {
+            file_result.error = "Output file cannot be opened: " + output_filepath;
+            return file_result;
+        }
+        // The index of a previous run points into the old snapshots; it is rewritten below if enabled
+        std::remove((output_filepath + SNAPSHOT_INDEX_SUFFIX).c_str());
+    }
+
+    std::ofstream f_nbbo;
+    if (!nbbo_filepath.empty()) {
+        f_nbbo.open(nbbo_filepath, std::ios::binary | std::ios::trunc);
+        if (!f_nbbo) {
+            file_result.error = "NBBO file cannot be opened: " + nbbo_filepath;
+            return file_result;
+        }
+    }
+
+    std::ofstream f_features;
+    if (!features_filepath.empty()) {
+        f_features.open(features_filepath, std::ios::binary | std::ios::trunc);
+        if (!f_features) {
+            file_result.error = "Features file cannot be opened: " + features_filepath;
+            return file_result;
+        }
+    }
+
+    // Write placeholders for the output file headers
+    if (f_out.is_open()) {
+        OutputFileHeader output_header_placeholder = {};
+        f_out.write(reinterpret_cast<const char*>(&output_header_placeholder), sizeof(OutputFileHeader));
+    }
+    if (f_nbbo.is_open()) {
+        NbboFileHeader nbbo_header_placeholder = {};
+        f_nbbo.write(reinterpret_cast<const char*>(&nbbo_header_placeholder), sizeof(NbboFileHeader));
+    }
+    if (f_features.is_open()) {
+        BookFeaturesFileHeader features_header_placeholder = {};
+        f_features.write(reinterpret_cast<const char*>(&features_header_placeholder), sizeof(BookFeaturesFileHeader));
+    }
+
+    std::ofstream* snapshot_out = f_out.is_open() ? &f_out : nullptr;
+    std::ofstream* nbbo_out = f_nbbo.is_open() ? &f_nbbo : nullptr;
+    std::ofstream* features_out = f_features.is_open() ? &f_features : nullptr;
+    ConsolidationResult result;
+    switch (snapshot_depth) {
+        case 1:  result = consolidate_tops_stream<1>(f_in, snapshot_out, nbbo_out, features_out, input_filepath, options); break;
+        case 3:  result = consolidate_tops_stream<3>(f_in, snapshot_out, nbbo_out, features_out, input_filepath, options); break;
+        case 5:  result = consolidate_tops_stream<5>(f_in, snapshot_out, nbbo_out, features_out, input_filepath, options); break;
+        case 10: result = consolidate_tops_stream<10>(f_in, snapshot_out, nbbo_out, features_out, input_filepath, options); break;
+    }
+    file_result.input_records = result.input_records;
+    file_result.snapshots_written = result.snapshots_written;
+    file_result.nbbo_records_written = result.nbbo_records_written;
+    file_result.feature_bars_written = result.feature_bars_written;
+    file_result.warnings = std::move(result.warnings);
+
+    // Write the final main headers
+    if (f_out.is_open()) {
+        f_out.seekp(0, std::ios::beg);
+        OutputFileHeader final_output_header;
+        final_output_header.feed_id = PROCESSED_SNAPSHOT_FILE_FEED_ID;
+        final_output_header.dateint = input_header.dateint;
+        final_output_header.num_snapshots = result.snapshots_written;
+        final_output_header.symbol_idx = input_header.symbol_idx;
+        f_out.write(reinterpret_cast<const char*>(&final_output_header), sizeof(OutputFileHeader));
+        f_out.close();
+        if (f_out.fail()) {
+            file_result.error = "Failed writing output file: " + output_filepath;
+            return file_result;
+        }
+
+        if (options.index_interval != 0 &&
+            !write_snapshot_index(output_filepath, options.index_interval, result.index_entries)) {
+            file_result.error = "Failed writing snapshot index for: " + output_filepath;
+            return file_result;
+        }
+    }
+
+    if (f_nbbo.is_open()) {
+        f_nbbo.seekp(0, std::ios::beg);
+        NbboFileHeader final_nbbo_header = {};
+        final_nbbo_header.feed_id = PROCESSED_SNAPSHOT_FILE_FEED_ID;
+        final_nbbo_header.dateint = input_header.dateint;
+        final_nbbo_header.num_records = result.nbbo_records_written;
+        final_nbbo_header.symbol_idx = input_header.symbol_idx;
+        final_nbbo_header.record_size = sizeof(NbboRecordWrite);
+        final_nbbo_header.num_venues = static_cast<uint32_t>(result.venue_feed_ids.size());
+        std::copy(result.venue_feed_ids.begin(), result.venue_feed_ids.end(), final_nbbo_header.venue_feed_ids);
+        f_nbbo.write(reinterpret_cast<const char*>(&final_nbbo_header), sizeof(NbboFileHeader));
+        f_nbbo.close();
+        if (f_nbbo.fail()) {
+            file_result.error = "Failed writing NBBO file: " + nbbo_filepath;
+            return file_result;
+        }
+    }
+
+    if (f_features.is_open()) {
+        f_features.seekp(0, std::ios::beg);
+        BookFeaturesFileHeader final_features_header = {};
+        final_features_header.feed_id = PROCESSED_SNAPSHOT_FILE_FEED_ID;
+        final_features_header.dateint = input_header.dateint;
+        final_features_header.num_bars = result.feature_bars_written;
+        final_features_header.symbol_idx = input_header.symbol_idx;
+        final_features_header.bar_ns = options.feature_bar_ns;
+        f_features.write(reinterpret_cast<const char*>(&final_features_header), sizeof(BookFeaturesFileHeader));
+        f_features.close();
+        if (f_features.fail()) {
+            file_result.error = "Failed writing features file: " + features_filepath;
+            return file_result;
+        }
+    }
+
+    file_result.ok = true;
+    return file_result;
+}
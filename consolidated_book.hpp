@@ -0,0 +1,195 @@
+#ifndef CONSOLIDATED_BOOK_HPP
+#define CONSOLIDATED_BOOK_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "processed_tops.hpp"
+
+// --- Constants ---
+const int DEFAULT_SNAPSHOT_DEPTH = 3;
+// Bumped whenever the bytes written for a given input and options change
+const std::string CONSOLIDATED_BOOK_VERSION = "1";
+
+const size_t INPUT_FILE_HEADER_SIZE = 24;
+const size_t MERGED_ENTRY_PREFIX_FEED_ID_SIZE = 8;
+const size_t TOPS_RECORD_SIZE_EXPECTED = 88;
+const size_t MERGED_TOPS_FULL_ENTRY_SIZE = MERGED_ENTRY_PREFIX_FEED_ID_SIZE + TOPS_RECORD_SIZE_EXPECTED;
+
+const int VENUE_LEVELS = 3;
+
+// Book features: consolidated levels they look at, and the default bar width
+const int FEATURE_LEVELS = 3;
+const uint64_t DEFAULT_FEATURE_BAR_NS = 1000000000ULL;
+
+#pragma pack(push, 1)
+
+struct InputFileHeader {
+    uint64_t feed_id;
+    uint32_t dateint;
+    uint32_t total_record_count;
+    uint64_t symbol_idx;
+};
+
+struct TopLevelData {
+    int64_t bid_price;
+    int64_t ask_price;
+    uint32_t bid_qty;
+    uint32_t ask_qty;
+};
+
+// One venue's three-level top, as stored in book_tops and after the feed_id of a merged_tops entry
+struct VenueTopsRecord {
+    uint64_t ts;
+    uint64_t seqno;
+    TopLevelData level1;
+    TopLevelData level2;
+    TopLevelData level3;
+};
+static_assert(sizeof(TopLevelData) == 24, "TopLevelData size mismatch");
+static_assert(sizeof(VenueTopsRecord) == TOPS_RECORD_SIZE_EXPECTED, "VenueTopsRecord size mismatch");
+
+// One entry of merged_tops.SYM.bin
+struct MergedTopsEntry {
+    uint64_t feed_id;
+    VenueTopsRecord record;
+};
+static_assert(sizeof(MergedTopsEntry) == MERGED_TOPS_FULL_ENTRY_SIZE, "MergedTopsEntry size mismatch");
+
+// Header of a book features file; num_bars BookFeatureBarRecords follow
+struct BookFeaturesFileHeader {
+    uint64_t feed_id;
+    uint32_t dateint;
+    uint32_t num_bars;
+    uint64_t symbol_idx;
+    uint64_t bar_ns;
+};
+static_assert(sizeof(BookFeaturesFileHeader) == 32, "BookFeaturesFileHeader size mismatch");
+
+// Features of one bar, written for every bar with at least one book update. Level k is the k-th
+// consolidated price level of each side.
+// ofi[k]: order-flow imbalance of level k summed over the bar's updates (Cont, Kukanov & Stoikov):
+//   bid size added at or above the previous bid price minus size removed, minus the same for the ask.
+// depth_imbalance[k]: (bid_qty - ask_qty) / (bid_qty + ask_qty) at level k when the bar closes.
+// microprice: (ask * bid_qty + bid * ask_qty) / (bid_qty + ask_qty) of level 1 when the bar closes;
+//   microprice_twap is its time-weighted mean over the bar. NaN where a side is empty.
+struct BookFeatureBarRecord {
+    uint64_t bar_start_ns;
+    uint32_t update_count;
+    int64_t ofi[FEATURE_LEVELS];
+    double depth_imbalance[FEATURE_LEVELS];
+    double microprice;
+    double microprice_twap;
+};
+static_assert(sizeof(BookFeatureBarRecord) == 76, "BookFeatureBarRecord size mismatch");
+
+#pragma pack(pop)
+
+// Latest three-level quote of every venue, kept as one contiguous row per side, field and level
+// so snapshot construction scans flat arrays instead of walking a map.
+// feed_ids are remapped to dense slots [0, num_venues) the first time they are seen in the file.
+struct alignas(64) VenueQuoteTable {
+    alignas(64) int64_t bid_price[VENUE_LEVELS][MAX_VENUES] = {};
+    alignas(64) int64_t ask_price[VENUE_LEVELS][MAX_VENUES] = {};
+    alignas(64) uint32_t bid_qty[VENUE_LEVELS][MAX_VENUES] = {};
+    alignas(64) uint32_t ask_qty[VENUE_LEVELS][MAX_VENUES] = {};
+    uint64_t feed_ids[MAX_VENUES] = {};
+    size_t num_venues = 0;
+    size_t last_slot = 0;
+
+    // Dense slot for feed_id, assigned on first sight. Returns -1 once MAX_VENUES slots are taken.
+    int slot_for(uint64_t feed_id) {
+        if (last_slot < num_venues && feed_ids[last_slot] == feed_id) {
+            return static_cast<int>(last_slot);
+        }
+        for (size_t v = 0; v < num_venues; ++v) {
+            if (feed_ids[v] == feed_id) {
+                last_slot = v;
+                return static_cast<int>(v);
+            }
+        }
+        if (num_venues == MAX_VENUES) {
+            return -1;
+        }
+        feed_ids[num_venues] = feed_id;
+        last_slot = num_venues;
+        return static_cast<int>(num_venues++);
+    }
+
+    void update(int slot, const VenueTopsRecord& record) {
+        const TopLevelData* levels[VENUE_LEVELS] = {&record.level1, &record.level2, &record.level3};
+        for (int level = 0; level < VENUE_LEVELS; ++level) {
+            bid_price[level][slot] = levels[level]->bid_price;
+            ask_price[level][slot] = levels[level]->ask_price;
+            bid_qty[level][slot] = levels[level]->bid_qty;
+            ask_qty[level][slot] = levels[level]->ask_qty;
+        }
+    }
+};
+
+// Consolidated depth of one side across every venue level in a VenueQuoteTable, best price first.
+// Each rung aggregates all venue quotes at one price; venue_mask has bit `slot` set for each venue quoting it.
+struct DepthLadder {
+    size_t count = 0;
+    int64_t price[VENUE_LEVELS * MAX_VENUES];
+    uint64_t quantity[VENUE_LEVELS * MAX_VENUES];
+    uint64_t venue_mask[VENUE_LEVELS * MAX_VENUES];
+};
+
+// Rebuilds ladder from every live (non-zero price and quantity) level of every venue
+void build_depth_ladder(const VenueQuoteTable& table, bool is_bid, DepthLadder& ladder);
+
+// Controls how often a state is emitted. With conflation_interval_ns set, at most one state is written per
+// interval: the last one of the interval, stamped with the ts of the record that produced it. With
+// nbbo_price_changes_only set, a state is only written when the best bid or ask price moved.
+// index_interval is the snapshot spacing of the seek index entries; 0 disables the index.
+// depth 0 picks 1 for NBBO-only runs and DEFAULT_SNAPSHOT_DEPTH otherwise; a features output needs
+// at least FEATURE_LEVELS.
+// feature_bar_ns is the bar width of the book features output. Features are built from every record,
+// whatever the conflation interval.
+struct ConsolidationOptions {
+    int depth = 0;
+    uint64_t conflation_interval_ns = 0;
+    uint64_t feature_bar_ns = DEFAULT_FEATURE_BAR_NS;
+    bool nbbo_price_changes_only = false;
+    uint32_t index_interval = DEFAULT_SNAPSHOT_INDEX_INTERVAL;
+    bool report_progress = false;
+};
+
+// Canonical text form of the options that affect the output, e.g. for provenance records
+std::string describe_consolidation_options(const ConsolidationOptions& options);
+
+// Outcome of one merged_tops file. On failure, error describes the problem and outputs may be partial.
+// warnings lists recoverable problems with the input, for the caller to report.
+struct ConsolidationFileResult {
+    bool ok = false;
+    std::string error;
+    std::vector<std::string> warnings;
+    uint32_t dateint = 0;
+    uint64_t symbol_idx = 0;
+    uint32_t input_records = 0;
+    uint32_t snapshots_written = 0;
+    uint32_t nbbo_records_written = 0;
+    uint32_t feature_bars_written = 0;
+};
+
+// Depths process_merged_tops_file can build: 1, 3, 5 or 10
+bool is_supported_snapshot_depth(int depth);
+
+// Parses a duration such as "1ms", "100us", "250000ns" or "1s" into nanoseconds. A bare number is nanoseconds.
+// Returns false for an unknown unit, a zero duration or one that does not fit in uint64 nanoseconds.
+bool parse_duration_ns(const std::string& text, uint64_t& duration_ns);
+
+// Consolidates one merged_tops.SYM.bin file. Any output path may be empty, but not all of them:
+// output_filepath receives the processed_tops snapshots (plus its .idx sidecar), nbbo_filepath the
+// fixed-width NBBO stream and features_filepath the per-bar book features, all from the same pass.
+// Nothing is printed unless options.report_progress is set, so the function can run on several
+// files at once.
+ConsolidationFileResult process_merged_tops_file(const std::string& input_filepath,
+                                                 const std::string& output_filepath,
+                                                 const std::string& nbbo_filepath,
+                                                 const std::string& features_filepath,
+                                                 const ConsolidationOptions& options);
+
+#endif
@@ -19,6 +19,8 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "bar_container.hpp"
+
 #pragma pack(push, 1)
 struct FillsBarRecord {
     uint64_t timestamp_sec;
@@ -40,6 +42,14 @@ struct TopsBarRecord {
 
 extern const size_t MIN_DATA_LENGTH = 10;
 
+// Series compared for every pair, named as in the bar container; true for the fills series
+const std::vector<std::pair<std::string, bool>> BAR_SERIES = {
+    {"fills", true},
+    {"bid_L1", false}, {"ask_L1", false},
+    {"bid_L2", false}, {"ask_L2", false},
+    {"bid_L3", false}, {"ask_L3", false}
+};
+
 namespace fs = std::filesystem;
 
 std::vector<double> read_fills_bar_file(const std::string& file_path);
@@ -93,7 +103,7 @@ std::optional<double> calculate_weighted_correlation(
 
 // Function to extract unique stock symbols from .bin filenames in a folder
 std::vector<std::string> extract_symbols_from_folder(const fs::path& folder_path) {
-    std::regex symbol_pattern("\\.(?:fills_bars|bid_bars_L[0-9]|ask_bars_L[0-9])\\.([A-Z0-9_]+)\\.bin$", std::regex_constants::icase);
+    std::regex symbol_pattern("\\.(?:bars|fills_bars|bid_bars_L[0-9]|ask_bars_L[0-9])\\.([A-Z0-9_]+)\\.bin$", std::regex_constants::icase);
     std::set<std::string> symbols_set;
 
     if (!fs::is_directory(folder_path)) {
@@ -117,17 +127,17 @@ std::vector<std::string> extract_symbols_from_folder(const fs::path& folder_path
     return symbols_vec;
 }
 
-// Creates a map of all required file paths for a symbol
+// Creates a map of the per-series bar file paths for a symbol, keyed by series name
 std::map<std::string, std::string> generate_file_paths_cpp(const std::string& base_path_for_feed, const std::string& symbol) {
     std::string upper_symbol = to_upper(symbol);
     return {
         {"fills", base_path_for_feed + ".fills_bars." + upper_symbol + ".bin"},
-        {"L1_bid", base_path_for_feed + ".bid_bars_L1." + upper_symbol + ".bin"},
-        {"L1_ask", base_path_for_feed + ".ask_bars_L1." + upper_symbol + ".bin"},
-        {"L2_bid", base_path_for_feed + ".bid_bars_L2." + upper_symbol + ".bin"},
-        {"L2_ask", base_path_for_feed + ".ask_bars_L2." + upper_symbol + ".bin"},
-        {"L3_bid", base_path_for_feed + ".bid_bars_L3." + upper_symbol + ".bin"},
-        {"L3_ask", base_path_for_feed + ".ask_bars_L3." + upper_symbol + ".bin"}
+        {"bid_L1", base_path_for_feed + ".bid_bars_L1." + upper_symbol + ".bin"},
+        {"ask_L1", base_path_for_feed + ".ask_bars_L1." + upper_symbol + ".bin"},
+        {"bid_L2", base_path_for_feed + ".bid_bars_L2." + upper_symbol + ".bin"},
+        {"ask_L2", base_path_for_feed + ".ask_bars_L2." + upper_symbol + ".bin"},
+        {"bid_L3", base_path_for_feed + ".bid_bars_L3." + upper_symbol + ".bin"},
+        {"ask_L3", base_path_for_feed + ".ask_bars_L3." + upper_symbol + ".bin"}
     };
 }
 
@@ -151,32 +161,16 @@ bool file_exists_with_cache(const std::string& path) {
     return exists;
 }
 
-// Check if all required files for a symbol contain sufficient data
-bool is_symbol_valid_cpp(const std::string& base_path_for_feed, const std::string& symbol) {
-    auto paths = generate_file_paths_cpp(base_path_for_feed, symbol);
-    if (paths.empty()) return false;
+std::vector<double> read_series_closes(const std::string& base_path_for_feed, const std::string& symbol,
+                                       const std::string& series, bool is_fills);
 
-    // First check if all files exist and have non-zero size
-    for (const auto& [key, path] : paths) {
-        if (!file_exists_with_cache(path)) {
+// Check if every series of a symbol exists and contains sufficient data
+bool is_symbol_valid_cpp(const std::string& base_path_for_feed, const std::string& symbol) {
+    for (const auto& [series, is_fills] : BAR_SERIES) {
+        if (read_series_closes(base_path_for_feed, symbol, series, is_fills).size() < MIN_DATA_LENGTH) {
             return false;
         }
     }
-
-    // Check each file's data length individually with early return
-    auto check_file = [](const std::string& path, bool is_fills) -> bool {
-        auto data = is_fills ? read_fills_bar_file(path) : read_tops_bar_file(path);
-        return data.size() >= MIN_DATA_LENGTH;
-    };
-    
-    if (!check_file(paths.at("fills"), true)) return false;
-    if (!check_file(paths.at("L1_bid"), false)) return false;
-    if (!check_file(paths.at("L1_ask"), false)) return false;
-    if (!check_file(paths.at("L2_bid"), false)) return false;
-    if (!check_file(paths.at("L2_ask"), false)) return false;
-    if (!check_file(paths.at("L3_bid"), false)) return false;
-    if (!check_file(paths.at("L3_ask"), false)) return false;
-
     return true;
 }
 
@@ -251,10 +245,63 @@ std::vector<double> read_tops_bar_file(const std::string& file_path) {
     return read_file_mmap_cached(file_path, false);
 }
 
+// Close prices of one series from a bar container. The first request maps the container once and
+// caches the closes of every series in it, so the other series of the symbol need no further reads.
+// Returns an empty vector if the container or the series is missing.
+std::vector<double> read_container_closes_cached(const std::string& container_path, const std::string& series) {
+    std::string cache_key = container_path + "#" + series;
+    {
+        std::lock_guard<std::mutex> lock(file_cache_mutex);
+        auto it = file_data_cache.find(cache_key);
+        if (it != file_data_cache.end()) {
+            return it->second;
+        }
+    }
+
+    BarContainer container;
+    std::string error;
+    if (!container.open(container_path, error)) {
+        std::cerr << "Warning: " << error << std::endl;
+        return {};
+    }
+    std::vector<double> requested;
+    std::lock_guard<std::mutex> lock(file_cache_mutex);
+    for (const auto& [name, is_fills] : BAR_SERIES) {
+        std::vector<double> closes = container.series_values(name + ".close");
+        if (name == series) {
+            requested = closes;
+        }
+        // Only cache if not too large (prevent memory issues)
+        if (!closes.empty() && closes.size() < 100000) {
+            file_data_cache[container_path + "#" + name] = std::move(closes);
+        }
+    }
+    return requested;
+}
+
+// Close prices of one series of a symbol: from the symbol's bar container when it holds the
+// series, otherwise from the series' own bar file
+std::vector<double> read_series_closes(const std::string& base_path_for_feed, const std::string& symbol,
+                                       const std::string& series, bool is_fills) {
+    std::string container_path = bar_container_path(base_path_for_feed + ".", to_upper(symbol));
+    if (file_exists_with_cache(container_path)) {
+        std::vector<double> closes = read_container_closes_cached(container_path, series);
+        if (!closes.empty()) {
+            return closes;
+        }
+    }
+    std::string file_path = generate_file_paths_cpp(base_path_for_feed, symbol).at(series);
+    if (!file_exists_with_cache(file_path)) {
+        return {};
+    }
+    return is_fills ? read_fills_bar_file(file_path) : read_tops_bar_file(file_path);
+}
+
 
-std::optional<double> calculate_file_correlation(const std::string& file1, const std::string& file2, bool is_fills) {
-    auto data1 = is_fills ? read_fills_bar_file(file1) : read_tops_bar_file(file1);
-    auto data2 = is_fills ? read_fills_bar_file(file2) : read_tops_bar_file(file2);
+std::optional<double> calculate_series_correlation(const std::string& base_path_for_feed, const std::string& symbol1,
+                                                   const std::string& symbol2, const std::string& series, bool is_fills) {
+    auto data1 = read_series_closes(base_path_for_feed, symbol1, series, is_fills);
+    auto data2 = read_series_closes(base_path_for_feed, symbol2, series, is_fills);
     
     if (data1.empty() || data2.empty()) {
         return std::nullopt;
@@ -362,22 +409,12 @@ std::vector<CorrelationResult> compute_overall_correlations_cpp(
                 const std::string& sym1 = valid_symbols[i];
                 const std::string& sym2 = valid_symbols[j];
                 
-                // Generate file paths only once and reuse
-                auto paths1 = generate_file_paths_cpp(base_path_for_feed, sym1);
-                auto paths2 = generate_file_paths_cpp(base_path_for_feed, sym2);
-                
-                // Load data for each file type (fills, L1_bid, etc.)
-                const std::vector<std::string> file_types = {"fills", "L1_bid", "L1_ask", "L2_bid", "L2_ask", "L3_bid", "L3_ask"};
-                const std::vector<bool> is_fills_type = {true, false, false, false, false, false, false};
-                
+                // Load data for each series (fills, bid_L1, etc.)
                 std::vector<std::optional<double>> correlations;
-                correlations.reserve(file_types.size());
+                correlations.reserve(BAR_SERIES.size());
                 
-                for (size_t idx = 0; idx < file_types.size(); ++idx) {
-                    const std::string& type = file_types[idx];
-                    bool is_fills = is_fills_type[idx];
-                    
-                    correlations.push_back(calculate_file_correlation(paths1.at(type), paths2.at(type), is_fills));
+                for (const auto& [series, is_fills] : BAR_SERIES) {
+                    correlations.push_back(calculate_series_correlation(base_path_for_feed, sym1, sym2, series, is_fills));
                 }
                 
                 std::vector<double> weights(correlations.size(), 0.125);
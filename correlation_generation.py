@@ -2,11 +2,11 @@ import os
 import re
 import itertools
 import csv
-from price_correlation import calculate_correlation, calculate_weighted_correlation, read_fills_bar_file, read_tops_bar_file
+from price_correlation import BAR_SERIES_FILES, calculate_correlation, calculate_weighted_correlation, read_series_closes
 
 def extract_symbols_from_folder(folder_path):
-    """Extracts unique stock symbols from .bin filenames."""
-    pattern = re.compile(r'\.(?:fills|bid_bars_L\d|ask_bars_L\d)\.([A-Z]+)\.bin$')
+    """Extracts unique stock symbols from bar container and bar file names."""
+    pattern = re.compile(r'\.(?:bars|fills_bars|bid_bars_L\d|ask_bars_L\d)\.([A-Z]+)\.bin$')
     symbols = set()
     for filename in os.listdir(folder_path):
         match = pattern.search(filename)
@@ -14,33 +14,10 @@ def extract_symbols_from_folder(folder_path):
             symbols.add(match.group(1))
     return sorted(symbols)
 
-def generate_file_paths(base_path, symbol):
-    """Creates a dictionary of all required file paths for a symbol."""
-    return {
-        'fills': f"{base_path}.fills_bars.{symbol}.bin",
-        'L1_bid': f"{base_path}.bid_bars_L1.{symbol}.bin",
-        'L1_ask': f"{base_path}.ask_bars_L1.{symbol}.bin",
-        'L2_bid': f"{base_path}.bid_bars_L2.{symbol}.bin",
-        'L2_ask': f"{base_path}.ask_bars_L2.{symbol}.bin",
-        'L3_bid': f"{base_path}.bid_bars_L3.{symbol}.bin",
-        'L3_ask': f"{base_path}.ask_bars_L3.{symbol}.bin"
-    }
-
 def is_symbol_valid(base_path, symbol, min_length=10):
-    """Check if all required files for a symbol contain data."""
-    paths = generate_file_paths(base_path, symbol)
-
-    checks = [
-        read_fills_bar_file(paths['fills']),
-        read_tops_bar_file(paths['L1_bid']),
-        read_tops_bar_file(paths['L1_ask']),
-        read_tops_bar_file(paths['L2_bid']),
-        read_tops_bar_file(paths['L2_ask']),
-        read_tops_bar_file(paths['L3_bid']),
-        read_tops_bar_file(paths['L3_ask']),
-    ]
-
-    return all(len(data) >= min_length for data in checks)
+    """Check if every compared series of a symbol contains data."""
+    return all(len(read_series_closes(base_path, symbol, series, series == 'fills')) >= min_length
+               for series in BAR_SERIES_FILES)
 
 def compute_overall_correlations(symbols, base_path):
     """Computes overall correlation for all symbol pairs."""
@@ -50,17 +27,9 @@ def compute_overall_correlations(symbols, base_path):
     for i, (sym1, sym2) in enumerate(itertools.combinations(symbols, 2), 1):
         print(f"[{i}/{total}] Processing: {sym1} vs {sym2}")
         
-        paths1 = generate_file_paths(base_path, sym1)
-        paths2 = generate_file_paths(base_path, sym2)
-
         correlations = [
-            calculate_correlation(paths1['fills'], paths2['fills'], True),
-            calculate_correlation(paths1['L1_bid'], paths2['L1_bid'], False),
-            calculate_correlation(paths1['L1_ask'], paths2['L1_ask'], False),
-            calculate_correlation(paths1['L2_bid'], paths2['L2_bid'], False),
-            calculate_correlation(paths1['L2_ask'], paths2['L2_ask'], False),
-            calculate_correlation(paths1['L3_bid'], paths2['L3_bid'], False),
-            calculate_correlation(paths1['L3_ask'], paths2['L3_ask'], False)
+            calculate_correlation(base_path, sym1, sym2, series, series == 'fills')
+            for series in BAR_SERIES_FILES
         ]
         weights = [0.125] * len(correlations)
         overall = calculate_weighted_correlation(correlations, weights)
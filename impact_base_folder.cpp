@@ -0,0 +1,231 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <regex>
+#include <algorithm>
+#include <chrono>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+#include "impact_kernels.hpp"
+#include "impact_runner.hpp"
+
+// --- Constants ---
+// Files smaller than this are grouped into one task of about this many bytes
+const off_t SMALL_FILE_BATCH_BYTES = 16 << 20;
+const std::string MERGED_BOOKS_FEED = "mergedbooks";
+
+void print_usage(const char* prog_name) {
+    std::cerr << "Usage: " << prog_name << " <date> <venue|mergedbooks> <target_quantity>[,<target_quantity>...]"
+              << " [--jobs <worker threads, default: hardware threads>] [--consolidated] [--stats] [--compact] [--bps <bps>[,<bps>...]]" << std::endl;
+    std::cerr << "  Runs the impact computation of impact_base (venue) or merged_impact_base (mergedbooks) on every symbol of the date." << std::endl;
+}
+
+struct FileJob {
+    std::string filename;
+    std::string input_filepath;
+    off_t input_size = 0;
+    ImpactFileResult result;
+};
+
+// Aggregated over all workers; printed whenever another percent of the input bytes is done
+struct BatchProgress {
+    std::mutex console_mutex;
+    std::atomic<size_t> files_done{0};
+    std::atomic<uint64_t> bytes_done{0};
+    uint64_t bytes_total = 0;
+    size_t files_total = 0;
+    int last_percent_reported = -1;
+};
+
+// Runs every file of one task and reports progress after each file
+void process_task(std::vector<FileJob>& jobs, const std::vector<size_t>& task, ImpactInputKind kind,
+                  const ImpactOptions& options, BatchProgress& progress) {
+    for (size_t job_index : task) {
+        FileJob& job = jobs[job_index];
+        job.result = process_impact_file(job.input_filepath, kind, options);
+
+        size_t files_done = ++progress.files_done;
+        uint64_t bytes_done = progress.bytes_done += static_cast<uint64_t>(job.input_size);
+        int percent = progress.bytes_total == 0 ? 100 : static_cast<int>(bytes_done * 100 / progress.bytes_total);
+
+        std::lock_guard<std::mutex> lock(progress.console_mutex);
+        for (const auto& warning : job.result.warnings) {
+            std::cerr << "  Warning: " << warning << std::endl;
+        }
+        if (!job.result.ok) {
+            std::cerr << "  Error processing " << job.filename << ": " << job.result.error << std::endl;
+        }
+        if (percent > progress.last_percent_reported) {
+            progress.last_percent_reported = percent;
+            std::cout << "  Progress: " << files_done << "/" << progress.files_total << " files, "
+                      << percent << "% of input bytes" << std::endl;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    std::string date = argv[1];
+    std::string feed = argv[2];
+    unsigned int max_jobs = std::max(1u, std::thread::hardware_concurrency());
+    std::string bps_arg;
+    ImpactOptions options;
+
+    for (int i = 4; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--consolidated") {
+            options.consolidated = true;
+        } else if (arg == "--stats") {
+            options.stats_mode = true;
+        } else if (arg == "--compact") {
+            options.compact_results = true;
+        } else if (arg == "--bps" && i + 1 < argc) {
+            bps_arg = argv[++i];
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            try {
+                max_jobs = static_cast<unsigned int>(std::stoul(argv[++i]));
+            } catch (const std::exception&) {
+                max_jobs = 0;
+            }
+            if (max_jobs == 0) {
+                std::cerr << "Error: --jobs must be a positive integer." << std::endl;
+                return 1;
+            }
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!parse_target_quantities(argv[3], options.target_quantities)) {
+        return 1;
+    }
+    if (!bps_arg.empty() && !parse_bps_budgets(bps_arg, options.budgets_bps)) {
+        return 1;
+    }
+
+    bool merged = feed == MERGED_BOOKS_FEED;
+    if (options.consolidated && !merged) {
+        std::cerr << "Error: --consolidated needs the mergedbooks feed." << std::endl;
+        return 1;
+    }
+    ImpactInputKind kind = merged ? ImpactInputKind::MergedTops : ImpactInputKind::VenueBookTops;
+
+    std::string upper_feed = feed;
+    std::transform(upper_feed.begin(), upper_feed.end(), upper_feed.begin(), ::toupper);
+    std::string books_dir_path = merged ? "/home/vir/" + date + "/" + MERGED_BOOKS_FEED
+                                        : "/home/vir/" + date + "/" + feed + "/books";
+    std::regex file_pattern(merged ? std::string("^merged_tops\\.([a-zA-Z0-9_]+)\\.bin$")
+                                   : "^" + upper_feed + "\\.book_tops\\.([a-zA-Z0-9_]+)\\.bin$");
+
+    std::vector<FileJob> jobs;
+    DIR* dir = opendir(books_dir_path.c_str());
+    if (dir == NULL) {
+        std::cerr << "Error: Could not open input directory: " << books_dir_path << std::endl;
+        return 1;
+    }
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        std::string filename = ent->d_name;
+        if (!std::regex_match(filename, file_pattern)) {
+            continue;
+        }
+        std::string full_path_to_entry = books_dir_path + "/" + filename;
+        struct stat statbuf;
+        if (stat(full_path_to_entry.c_str(), &statbuf) != 0 || !S_ISREG(statbuf.st_mode)) {
+            continue;
+        }
+        FileJob job;
+        job.filename = filename;
+        job.input_filepath = full_path_to_entry;
+        job.input_size = statbuf.st_size;
+        jobs.push_back(std::move(job));
+    }
+    closedir(dir);
+
+    // One directory setup for the whole date
+    bool created = false;
+    std::string error;
+    if (!ensure_impactbase_directory(books_dir_path, created, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return 1;
+    }
+    if (created) {
+        std::cout << "Created directory: " << books_dir_path << "/" << IMPACTBASE_FOLDER << std::endl;
+    }
+
+    // Largest inputs first, so a big symbol picked up last does not leave the other workers idle.
+    // The small tail is grouped into tasks of about SMALL_FILE_BATCH_BYTES.
+    std::sort(jobs.begin(), jobs.end(),
+              [](const FileJob& a, const FileJob& b) { return a.input_size > b.input_size; });
+    std::vector<std::vector<size_t>> tasks;
+    off_t open_batch_bytes = 0;
+    for (size_t j = 0; j < jobs.size(); ++j) {
+        if (jobs[j].input_size >= SMALL_FILE_BATCH_BYTES) {
+            tasks.push_back({j});
+            continue;
+        }
+        if (tasks.empty() || open_batch_bytes == 0 || open_batch_bytes >= SMALL_FILE_BATCH_BYTES) {
+            tasks.emplace_back();
+            open_batch_bytes = 0;
+        }
+        tasks.back().push_back(j);
+        // Counts at least one byte, so even empty files end up sharing a task
+        open_batch_bytes += std::max<off_t>(jobs[j].input_size, 1);
+    }
+
+    BatchProgress progress;
+    progress.files_total = jobs.size();
+    for (const auto& job : jobs) {
+        progress.bytes_total += static_cast<uint64_t>(job.input_size);
+    }
+
+    unsigned int num_workers = static_cast<unsigned int>(std::min<size_t>(max_jobs, tasks.size()));
+    std::cout << "Processing " << jobs.size() << " files (" << tasks.size() << " tasks) from: " << books_dir_path
+              << " with " << num_workers << " workers" << std::endl;
+
+    auto start_time = std::chrono::steady_clock::now();
+    std::atomic<size_t> next_task{0};
+    std::vector<std::thread> workers;
+    for (unsigned int w = 0; w < num_workers; ++w) {
+        workers.emplace_back([&]() {
+            for (size_t task_index = next_task++; task_index < tasks.size(); task_index = next_task++) {
+                process_task(jobs, tasks[task_index], kind, options, progress);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+    int processed_count = 0;
+    int failed_count = 0;
+    uint64_t tops_processed = 0;
+    for (const auto& job : jobs) {
+        if (job.result.ok) {
+            processed_count++;
+            tops_processed += job.result.tops_processed;
+        } else {
+            failed_count++;
+        }
+    }
+
+    std::cout << "\nBatch processing complete in " << elapsed_seconds << " s." << std::endl;
+    std::cout << "Successfully processed: " << processed_count << " files (" << tops_processed << " tops)." << std::endl;
+    std::cout << "Failed: " << failed_count << " files." << std::endl;
+    for (const auto& job : jobs) {
+        if (!job.result.ok) {
+            std::cerr << "  Failed: " << job.filename << ": " << job.result.error << std::endl;
+        }
+    }
+
+    return failed_count == 0 ? 0 : 1;
+}
@@ -0,0 +1,429 @@
+#include "impact_kernels.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <random>
+#include <cstring>
+#include <memory>
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+std::pair<double, uint32_t> calculate_side_execution(
+    uint32_t target_exec_quantity,
+    const int64_t side_prices[IMPACT_LEVELS],
+    const uint32_t side_quantities[IMPACT_LEVELS]) {
+
+    if (target_exec_quantity == 0) {
+        return {NAN, 0};
+    }
+
+    double total_value_for_qty = 0.0;
+    uint32_t quantity_filled = 0;
+    uint32_t levels_touched = 0;
+
+    for (int i = 0; i < IMPACT_LEVELS; ++i) {
+        if (quantity_filled == target_exec_quantity) {
+            break;
+        }
+
+        if (side_prices[i] == 0 || side_quantities[i] == 0) {
+            break;
+        }
+
+        levels_touched++;
+
+        double price_at_level = static_cast<double>(side_prices[i]) / 1e9;
+        uint32_t qty_available_at_level = side_quantities[i];
+
+        uint32_t qty_needed_from_this_level = target_exec_quantity - quantity_filled;
+        uint32_t qty_executed_this_level = std::min(qty_needed_from_this_level, qty_available_at_level);
+
+        total_value_for_qty += qty_executed_this_level * price_at_level;
+        quantity_filled += qty_executed_this_level;
+    }
+
+    if (quantity_filled < target_exec_quantity) {
+        return {NAN, levels_touched};
+    }
+
+    return {total_value_for_qty / static_cast<double>(target_exec_quantity), levels_touched};
+}
+
+bool results_meaningfully_changed(const ExecutionResult& r1, const ExecutionResult& r2) {
+    bool bid_price_diff = (std::isnan(r1.bid_exec_price) != std::isnan(r2.bid_exec_price)) ||
+                          (!std::isnan(r1.bid_exec_price) && r1.bid_exec_price != r2.bid_exec_price);
+    bool ask_price_diff = (std::isnan(r1.ask_exec_price) != std::isnan(r2.ask_exec_price)) ||
+                          (!std::isnan(r1.ask_exec_price) && r1.ask_exec_price != r2.ask_exec_price);
+
+    return bid_price_diff || r1.bid_levels_consumed != r2.bid_levels_consumed ||
+           ask_price_diff || r1.ask_levels_consumed != r2.ask_levels_consumed;
+}
+
+bool results_meaningfully_changed(const ConsolidatedExecutionResult& r1, const ConsolidatedExecutionResult& r2) {
+    bool bid_price_diff = (std::isnan(r1.bid_exec_price) != std::isnan(r2.bid_exec_price)) ||
+                          (!std::isnan(r1.bid_exec_price) && r1.bid_exec_price != r2.bid_exec_price);
+    bool ask_price_diff = (std::isnan(r1.ask_exec_price) != std::isnan(r2.ask_exec_price)) ||
+                          (!std::isnan(r1.ask_exec_price) && r1.ask_exec_price != r2.ask_exec_price);
+
+    return bid_price_diff || r1.bid_levels_consumed != r2.bid_levels_consumed || r1.bid_venues_touched != r2.bid_venues_touched ||
+           ask_price_diff || r1.ask_levels_consumed != r2.ask_levels_consumed || r1.ask_venues_touched != r2.ask_venues_touched;
+}
+
+DepthExecution calculate_depth_execution(
+    uint32_t target_exec_quantity,
+    const int64_t* level_prices,
+    const uint64_t* level_quantities,
+    const uint64_t* venue_masks,
+    size_t num_levels) {
+
+    if (target_exec_quantity == 0) {
+        return {NAN, 0, 0};
+    }
+
+    double total_value_for_qty = 0.0;
+    uint64_t quantity_filled = 0;
+    uint32_t levels_touched = 0;
+    uint64_t venues_touched_mask = 0;
+
+    for (size_t i = 0; i < num_levels && quantity_filled < target_exec_quantity; ++i) {
+        levels_touched++;
+        venues_touched_mask |= venue_masks[i];
+
+        double price_at_level = static_cast<double>(level_prices[i]) / 1e9;
+        uint64_t qty_executed_this_level = std::min<uint64_t>(target_exec_quantity - quantity_filled, level_quantities[i]);
+
+        total_value_for_qty += qty_executed_this_level * price_at_level;
+        quantity_filled += qty_executed_this_level;
+    }
+
+    uint32_t venues_touched = static_cast<uint32_t>(__builtin_popcountll(venues_touched_mask));
+    if (quantity_filled < target_exec_quantity) {
+        return {NAN, levels_touched, venues_touched};
+    }
+    return {total_value_for_qty / static_cast<double>(target_exec_quantity), levels_touched, venues_touched};
+}
+
+bool results_meaningfully_changed(const CapacityResult& r1, const CapacityResult& r2) {
+    return r1.bid_max_quantity != r2.bid_max_quantity || r1.ask_max_quantity != r2.ask_max_quantity;
+}
+
+uint64_t calculate_depth_capacity(
+    double budget_bps,
+    bool is_bid,
+    const int64_t* level_prices,
+    const uint64_t* level_quantities,
+    size_t num_levels) {
+
+    if (num_levels == 0) {
+        return 0;
+    }
+    // Worst average price allowed, in the same nanos units as the book
+    double touch = static_cast<double>(level_prices[0]);
+    double limit_price = is_bid ? touch * (1.0 - budget_bps / 1e4) : touch * (1.0 + budget_bps / 1e4);
+
+    double total_value = 0.0;
+    uint64_t quantity_filled = 0;
+    for (size_t i = 0; i < num_levels; ++i) {
+        double price_at_level = static_cast<double>(level_prices[i]);
+        bool inside_budget = is_bid ? price_at_level >= limit_price : price_at_level <= limit_price;
+        if (inside_budget) {
+            total_value += static_cast<double>(level_quantities[i]) * price_at_level;
+            quantity_filled += level_quantities[i];
+            continue;
+        }
+        // Every level so far is inside the budget, so their average has room left; this level can
+        // use it up until the average price equals limit_price
+        double room = is_bid ? total_value - limit_price * static_cast<double>(quantity_filled)
+                             : limit_price * static_cast<double>(quantity_filled) - total_value;
+        double extra = std::floor(room / std::abs(price_at_level - limit_price));
+        if (extra > 0.0) {
+            quantity_filled += std::min<uint64_t>(level_quantities[i], static_cast<uint64_t>(extra));
+        }
+        break;
+    }
+    return quantity_filled;
+}
+
+// Records [begin, end) of calculate_side_execution_block one at a time. Without SIMD the early
+// exits of the scalar function beat evaluating every level of every record.
+static void side_execution_block_scalar(
+    uint32_t target_exec_quantity,
+    const int64_t (&side_prices)[IMPACT_LEVELS][IMPACT_BLOCK_SIZE],
+    const uint32_t (&side_quantities)[IMPACT_LEVELS][IMPACT_BLOCK_SIZE],
+    size_t begin, size_t end,
+    SideExecutionBlock& out) {
+
+    int64_t prices[IMPACT_LEVELS];
+    uint32_t quantities[IMPACT_LEVELS];
+    for (size_t r = begin; r < end; ++r) {
+        for (int i = 0; i < IMPACT_LEVELS; ++i) {
+            prices[i] = side_prices[i][r];
+            quantities[i] = side_quantities[i][r];
+        }
+        std::pair<double, uint32_t> execution = calculate_side_execution(target_exec_quantity, prices, quantities);
+        out.exec_price[r] = execution.first;
+        out.levels_consumed[r] = execution.second;
+    }
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+// The walk of calculate_side_execution eight records at a time with AVX-512F/DQ intrinsics. The early
+// exits become a per-lane 'still walking' mask: a level that is not walked executes 0 shares and adds
+// an exact zero. Quantities are widened to 64 bits to line up with the prices. Built for AVX-512 whatever
+// the -march of the rest of the file, and only called after the CPU check.
+// The scalar function's sum is fused into FMAs exactly when the whole build targets FMA (the compiler
+// contracts a * b + c there), so the lanes do the same: fused in such builds, otherwise a multiply and
+// an add with explicit rounding, which the compiler cannot contract.
+// GCC 12 warns about the deliberately undefined pass-through operands inside its own intrinsic headers
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+__attribute__((target("avx512f,avx512dq")))
+static size_t side_execution_block_avx512(
+    uint32_t target_exec_quantity,
+    const int64_t (&side_prices)[IMPACT_LEVELS][IMPACT_BLOCK_SIZE],
+    const uint32_t (&side_quantities)[IMPACT_LEVELS][IMPACT_BLOCK_SIZE],
+    size_t count,
+    SideExecutionBlock& out) {
+
+    const __m512i target = _mm512_set1_epi64(static_cast<long long>(target_exec_quantity));
+    const __m512d target_pd = _mm512_set1_pd(static_cast<double>(target_exec_quantity));
+    const __m512d nanos_per_unit = _mm512_set1_pd(1e9);
+    const __m512d not_filled = _mm512_set1_pd(NAN);
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i one = _mm512_set1_epi64(1);
+
+    size_t r = 0;
+    for (; r + 8 <= count; r += 8) {
+        __m512d total_value_for_qty = _mm512_setzero_pd();
+        __m512i quantity_filled = zero;
+        __m512i levels_touched = zero;
+        __mmask8 walking = 0xFF;
+
+        for (int i = 0; i < IMPACT_LEVELS; ++i) {
+            __m512i price = _mm512_loadu_si512(&side_prices[i][r]);
+            __m512i qty_available_at_level = _mm512_cvtepu32_epi64(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&side_quantities[i][r])));
+            __m512i qty_needed_from_this_level = _mm512_sub_epi64(target, quantity_filled);
+            walking = walking & _mm512_cmpneq_epi64_mask(qty_needed_from_this_level, zero) &
+                      _mm512_cmpneq_epi64_mask(price, zero) & _mm512_cmpneq_epi64_mask(qty_available_at_level, zero);
+
+            __m512i qty_executed_this_level = _mm512_maskz_min_epu64(walking, qty_needed_from_this_level, qty_available_at_level);
+            __m512d price_at_level = _mm512_div_pd(_mm512_cvtepi64_pd(price), nanos_per_unit);
+            __m512d qty_executed_pd = _mm512_cvtepu64_pd(qty_executed_this_level);
+#ifdef __FMA__
+            total_value_for_qty = _mm512_fmadd_pd(qty_executed_pd, price_at_level, total_value_for_qty);
+#else
+            total_value_for_qty = _mm512_add_round_pd(
+                total_value_for_qty,
+                _mm512_mul_round_pd(qty_executed_pd, price_at_level, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC),
+                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+#endif
+            quantity_filled = _mm512_add_epi64(quantity_filled, qty_executed_this_level);
+            levels_touched = _mm512_mask_add_epi64(levels_touched, walking, levels_touched, one);
+        }
+
+        __mmask8 filled = _mm512_cmpge_epu64_mask(quantity_filled, target);
+        _mm512_storeu_pd(&out.exec_price[r], _mm512_mask_div_pd(not_filled, filled, total_value_for_qty, target_pd));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&out.levels_consumed[r]), _mm512_cvtepi64_epi32(levels_touched));
+    }
+    return r;
+}
+#pragma GCC diagnostic pop
+
+static bool cpu_has_avx512_kernel() {
+    static const bool supported = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq");
+    return supported;
+}
+#endif
+
+void calculate_side_execution_block(
+    uint32_t target_exec_quantity,
+    const int64_t (&side_prices)[IMPACT_LEVELS][IMPACT_BLOCK_SIZE],
+    const uint32_t (&side_quantities)[IMPACT_LEVELS][IMPACT_BLOCK_SIZE],
+    size_t count,
+    SideExecutionBlock& out) {
+
+    // Nothing to execute: no record walks a level
+    if (target_exec_quantity == 0) {
+        std::fill(out.exec_price, out.exec_price + count, NAN);
+        std::fill(out.levels_consumed, out.levels_consumed + count, 0u);
+        return;
+    }
+
+    size_t done = 0;
+#if defined(__GNUC__) && defined(__x86_64__)
+    if (cpu_has_avx512_kernel()) {
+        done = side_execution_block_avx512(target_exec_quantity, side_prices, side_quantities, count, out);
+    }
+#endif
+    side_execution_block_scalar(target_exec_quantity, side_prices, side_quantities, done, count, out);
+}
+
+bool execution_kernel_uses_avx512() {
+#if defined(__GNUC__) && defined(__x86_64__)
+    return cpu_has_avx512_kernel();
+#else
+    return false;
+#endif
+}
+
+void calculate_execution_block(uint32_t target_exec_quantity, const TopsBlock& block, ExecutionResult* results) {
+    SideExecutionBlock bids;
+    SideExecutionBlock asks;
+    calculate_side_execution_block(target_exec_quantity, block.bid_price, block.bid_qty, block.count, bids);
+    calculate_side_execution_block(target_exec_quantity, block.ask_price, block.ask_qty, block.count, asks);
+
+    for (size_t r = 0; r < block.count; ++r) {
+        ExecutionResult& result = results[r];
+        result.timestamp = block.ts[r];
+        result.seqno = block.seqno[r];
+        result.bid_exec_price = bids.exec_price[r];
+        result.bid_levels_consumed = bids.levels_consumed[r];
+        result.ask_exec_price = asks.exec_price[r];
+        result.ask_levels_consumed = asks.levels_consumed[r];
+    }
+}
+
+// Gathers one side of record r into a ladder that ends at the first empty level
+static size_t gather_side_levels(const int64_t (&side_prices)[IMPACT_LEVELS][IMPACT_BLOCK_SIZE],
+                                 const uint32_t (&side_quantities)[IMPACT_LEVELS][IMPACT_BLOCK_SIZE], size_t r,
+                                 int64_t (&prices)[IMPACT_LEVELS], uint64_t (&quantities)[IMPACT_LEVELS]) {
+    size_t num_levels = 0;
+    while (num_levels < IMPACT_LEVELS && side_prices[num_levels][r] != 0 && side_quantities[num_levels][r] != 0) {
+        prices[num_levels] = side_prices[num_levels][r];
+        quantities[num_levels] = side_quantities[num_levels][r];
+        num_levels++;
+    }
+    return num_levels;
+}
+
+void calculate_capacity_block(double budget_bps, const TopsBlock& block, CapacityResult* results) {
+    int64_t prices[IMPACT_LEVELS];
+    uint64_t quantities[IMPACT_LEVELS];
+    for (size_t r = 0; r < block.count; ++r) {
+        CapacityResult& result = results[r];
+        result.timestamp = block.ts[r];
+        result.seqno = block.seqno[r];
+        size_t bid_levels = gather_side_levels(block.bid_price, block.bid_qty, r, prices, quantities);
+        result.bid_max_quantity = calculate_depth_capacity(budget_bps, true, prices, quantities, bid_levels);
+        size_t ask_levels = gather_side_levels(block.ask_price, block.ask_qty, r, prices, quantities);
+        result.ask_max_quantity = calculate_depth_capacity(budget_bps, false, prices, quantities, ask_levels);
+    }
+}
+
+bool verify_execution_kernel(size_t num_books, uint32_t seed) {
+    std::mt19937 rng(seed);
+    // Small price and quantity ranges so that empty levels, exact fills and partial books all occur
+    std::uniform_int_distribution<int> empty_dist(0, 7);
+    std::uniform_int_distribution<int64_t> price_dist(1, 500000000000LL);
+    std::uniform_int_distribution<uint32_t> qty_dist(1, 400);
+    std::uniform_int_distribution<uint32_t> target_dist(0, 1000);
+
+    auto block = std::make_unique<TopsBlock>();
+    auto kernel_out = std::make_unique<SideExecutionBlock>();
+    size_t checked = 0;
+    while (checked < num_books) {
+        uint32_t target = target_dist(rng);
+        block->count = std::min(IMPACT_BLOCK_SIZE, num_books - checked);
+        for (size_t r = 0; r < block->count; ++r) {
+            for (int i = 0; i < IMPACT_LEVELS; ++i) {
+                block->bid_price[i][r] = empty_dist(rng) == 0 ? 0 : price_dist(rng);
+                block->bid_qty[i][r] = empty_dist(rng) == 0 ? 0 : qty_dist(rng);
+            }
+        }
+        calculate_side_execution_block(target, block->bid_price, block->bid_qty, block->count, *kernel_out);
+
+        for (size_t r = 0; r < block->count; ++r) {
+            int64_t prices[IMPACT_LEVELS];
+            uint32_t quantities[IMPACT_LEVELS];
+            for (int i = 0; i < IMPACT_LEVELS; ++i) {
+                prices[i] = block->bid_price[i][r];
+                quantities[i] = block->bid_qty[i][r];
+            }
+            auto expected = calculate_side_execution(target, prices, quantities);
+            double actual = kernel_out->exec_price[r];
+            uint64_t expected_bits, actual_bits;
+            std::memcpy(&expected_bits, &expected.first, sizeof(double));
+            std::memcpy(&actual_bits, &actual, sizeof(double));
+            bool same_price = (std::isnan(expected.first) && std::isnan(actual)) || expected_bits == actual_bits;
+            if (!same_price || expected.second != kernel_out->levels_consumed[r]) {
+                std::cerr << "Kernel mismatch at book " << (checked + r) << " (target " << target << "): scalar "
+                          << expected.first << "/" << expected.second << ", batched " << actual << "/"
+                          << kernel_out->levels_consumed[r] << std::endl;
+                return false;
+            }
+        }
+        checked += block->count;
+    }
+    return true;
+}
+
+bool parse_target_quantities(const std::string& text, std::vector<uint32_t>& quantities) {
+    quantities.clear();
+    std::istringstream stream(text);
+    std::string token;
+    while (std::getline(stream, token, ',')) {
+        try {
+            size_t consumed = 0;
+            unsigned long temp_qty = std::stoul(token, &consumed);
+            if (consumed != token.size() || temp_qty == 0 || temp_qty > UINT32_MAX) {
+                std::cerr << "Error: Target quantity must be a positive integer within uint32_t range and not zero: " << token << std::endl;
+                return false;
+            }
+            quantities.push_back(static_cast<uint32_t>(temp_qty));
+        } catch (const std::invalid_argument&) {
+            std::cerr << "Error: Invalid target quantity (not a number): " << token << std::endl;
+            return false;
+        } catch (const std::out_of_range&) {
+            std::cerr << "Error: Target quantity out of range: " << token << std::endl;
+            return false;
+        }
+    }
+    if (quantities.empty()) {
+        std::cerr << "Error: No target quantity given." << std::endl;
+        return false;
+    }
+    std::sort(quantities.begin(), quantities.end());
+    quantities.erase(std::unique(quantities.begin(), quantities.end()), quantities.end());
+    return true;
+}
+
+bool parse_bps_budgets(const std::string& text, std::vector<double>& budgets_bps) {
+    budgets_bps.clear();
+    std::istringstream stream(text);
+    std::string token;
+    while (std::getline(stream, token, ',')) {
+        try {
+            size_t consumed = 0;
+            double budget = std::stod(token, &consumed);
+            if (consumed != token.size() || !(budget > 0.0) || std::isinf(budget)) {
+                std::cerr << "Error: bps budget must be a positive number: " << token << std::endl;
+                return false;
+            }
+            budgets_bps.push_back(budget);
+        } catch (const std::invalid_argument&) {
+            std::cerr << "Error: Invalid bps budget (not a number): " << token << std::endl;
+            return false;
+        } catch (const std::out_of_range&) {
+            std::cerr << "Error: bps budget out of range: " << token << std::endl;
+            return false;
+        }
+    }
+    if (budgets_bps.empty()) {
+        std::cerr << "Error: No bps budget given." << std::endl;
+        return false;
+    }
+    std::sort(budgets_bps.begin(), budgets_bps.end());
+    budgets_bps.erase(std::unique(budgets_bps.begin(), budgets_bps.end()), budgets_bps.end());
+    return true;
+}
+
+std::string capacity_output_path(const std::string& output_path_prefix, double budget_bps) {
+    std::ostringstream label;
+    label << budget_bps;
+    std::string budget_label = label.str();
+    std::replace(budget_label.begin(), budget_label.end(), '.', 'p');
+    return output_path_prefix + ".bps" + budget_label + ".capacity.bin";
+}
@@ -0,0 +1,172 @@
+#ifndef IMPACT_KERNELS_HPP
+#define IMPACT_KERNELS_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <utility>
+#include <cmath>
+#include <cstdint>
+
+// --- Constants ---
+const int IMPACT_LEVELS = 3;
+const size_t IMPACT_BLOCK_SIZE = 512;
+
+// Output format
+struct ExecutionResult {
+    uint64_t timestamp;
+    uint64_t seqno;
+    double bid_exec_price;
+    uint32_t bid_levels_consumed;
+    double ask_exec_price;
+    uint32_t ask_levels_consumed;
+
+    ExecutionResult() : timestamp(0), seqno(0),
+                        bid_exec_price(NAN), bid_levels_consumed(0),
+                        ask_exec_price(NAN), ask_levels_consumed(0) {}
+};
+
+// Output format of the consolidated-depth mode. venues_touched counts the distinct venues
+// quoting the levels consumed; the struct has no padding.
+struct ConsolidatedExecutionResult {
+    uint64_t timestamp;
+    uint64_t seqno;
+    double bid_exec_price;
+    uint32_t bid_levels_consumed;
+    uint32_t bid_venues_touched;
+    double ask_exec_price;
+    uint32_t ask_levels_consumed;
+    uint32_t ask_venues_touched;
+
+    ConsolidatedExecutionResult() : timestamp(0), seqno(0),
+                                    bid_exec_price(NAN), bid_levels_consumed(0), bid_venues_touched(0),
+                                    ask_exec_price(NAN), ask_levels_consumed(0), ask_venues_touched(0) {}
+};
+static_assert(sizeof(ConsolidatedExecutionResult) == 48, "ConsolidatedExecutionResult size mismatch");
+
+// Output format of the --bps capacity files: the largest quantity that can be sold into the bids
+// (bid_max_quantity) or bought from the asks (ask_max_quantity) within the slippage budget
+struct CapacityResult {
+    uint64_t timestamp;
+    uint64_t seqno;
+    uint64_t bid_max_quantity;
+    uint64_t ask_max_quantity;
+
+    CapacityResult() : timestamp(0), seqno(0), bid_max_quantity(0), ask_max_quantity(0) {}
+};
+static_assert(sizeof(CapacityResult) == 32, "CapacityResult size mismatch");
+
+// Function to calculate effective price and levels consumed for one side
+std::pair<double, uint32_t> calculate_side_execution(
+    uint32_t target_exec_quantity,
+    const int64_t side_prices[IMPACT_LEVELS],
+    const uint32_t side_quantities[IMPACT_LEVELS]);
+
+// Function to check if the relevant fields of ExecutionResult have changed
+bool results_meaningfully_changed(const ExecutionResult& r1, const ExecutionResult& r2);
+bool results_meaningfully_changed(const ConsolidatedExecutionResult& r1, const ConsolidatedExecutionResult& r2);
+bool results_meaningfully_changed(const CapacityResult& r1, const CapacityResult& r2);
+
+struct DepthExecution {
+    double exec_price;
+    uint32_t levels_consumed;
+    uint32_t venues_touched;
+};
+
+// calculate_side_execution over an arbitrarily deep price ladder (best first) whose levels
+// aggregate several venues; venue_masks[i] has one bit per venue quoting level i
+DepthExecution calculate_depth_execution(
+    uint32_t target_exec_quantity,
+    const int64_t* level_prices,
+    const uint64_t* level_quantities,
+    const uint64_t* venue_masks,
+    size_t num_levels);
+
+// Inverse of calculate_depth_execution: the largest quantity whose execution price stays within
+// budget_bps of the touch (level 0). Levels inside the budget are taken whole; the first level outside
+// it is taken only as far as the average price reaches the budget. Depth beyond the last level is unknown,
+// so a book that fits the budget entirely returns its total quantity.
+uint64_t calculate_depth_capacity(
+    double budget_bps,
+    bool is_bid,
+    const int64_t* level_prices,
+    const uint64_t* level_quantities,
+    size_t num_levels);
+
+// Up to IMPACT_BLOCK_SIZE book tops in columnar form, one contiguous row per field and level
+struct TopsBlock {
+    size_t count = 0;
+    uint64_t ts[IMPACT_BLOCK_SIZE];
+    uint64_t seqno[IMPACT_BLOCK_SIZE];
+    int64_t bid_price[IMPACT_LEVELS][IMPACT_BLOCK_SIZE];
+    int64_t ask_price[IMPACT_LEVELS][IMPACT_BLOCK_SIZE];
+    uint32_t bid_qty[IMPACT_LEVELS][IMPACT_BLOCK_SIZE];
+    uint32_t ask_qty[IMPACT_LEVELS][IMPACT_BLOCK_SIZE];
+};
+
+struct SideExecutionBlock {
+    double exec_price[IMPACT_BLOCK_SIZE];
+    uint32_t levels_consumed[IMPACT_BLOCK_SIZE];
+};
+
+// Batched calculate_side_execution over the first count tops of a block. On CPUs with AVX-512F/DQ
+// eight records are walked per instruction; elsewhere, and for the last count % 8 records, each record
+// goes through the scalar function. The result of every record is bit-identical to the scalar function.
+void calculate_side_execution_block(
+    uint32_t target_exec_quantity,
+    const int64_t (&side_prices)[IMPACT_LEVELS][IMPACT_BLOCK_SIZE],
+    const uint32_t (&side_quantities)[IMPACT_LEVELS][IMPACT_BLOCK_SIZE],
+    size_t count,
+    SideExecutionBlock& out);
+
+// True when calculate_side_execution_block runs its AVX-512 path on this CPU
+bool execution_kernel_uses_avx512();
+
+// Both sides of every top in the block for one target quantity; results must hold block.count entries
+void calculate_execution_block(uint32_t target_exec_quantity, const TopsBlock& block, ExecutionResult* results);
+
+// calculate_depth_capacity for both sides of every top in the block; a side's depth ends at its
+// first empty level, as in calculate_side_execution. results must hold block.count entries.
+void calculate_capacity_block(double budget_bps, const TopsBlock& block, CapacityResult* results);
+
+// Compares the batched kernel with calculate_side_execution on num_books random books and prints
+// the first mismatch. Returns true if every price (bit pattern) and level count agrees.
+bool verify_execution_kernel(size_t num_books, uint32_t seed);
+
+// Parses "500" or "100,500,1000" into positive uint32_t quantities. Prints the problem and returns false on bad input.
+bool parse_target_quantities(const std::string& text, std::vector<uint32_t>& quantities);
+
+// Parses "5" or "1,2.5,10" into positive bps budgets, sorted and without duplicates.
+// Prints the problem and returns false on bad input.
+bool parse_bps_budgets(const std::string& text, std::vector<double>& budgets_bps);
+
+// <output_path_prefix>.bps<budget>.capacity.bin, with the decimal point of the budget written as 'p'
+std::string capacity_output_path(const std::string& output_path_prefix, double budget_bps);
+
+// Result file of one target quantity; a result is only written when it differs from the last one written
+template <typename Result>
+struct ExecutionOutput {
+    uint32_t target_quantity = 0;
+    std::string path;
+    std::ofstream file;
+    Result last_written;
+    bool first_record_to_write = true;
+    long records_written = 0;
+
+    // Returns false on a write error
+    bool write_if_changed(const Result& result) {
+        if (!first_record_to_write && !results_meaningfully_changed(last_written, result)) {
+            return true;
+        }
+        file.write(reinterpret_cast<const char *>(&result), sizeof(Result));
+        if (!file) {
+            return false;
+        }
+        last_written = result;
+        first_record_to_write = false;
+        records_written++;
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,426 @@
+#include "impact_runner.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <memory>
+#include <cmath>
+#include <cerrno>
+#include <sys/stat.h>
+
+#include "impact_kernels.hpp"
+#include "impact_stats.hpp"
+#include "consolidated_book.hpp"
+#include "compact_results.hpp"
+
+// Book top as read from a venue book_tops file: each field holds all three levels
+struct VenueBookTop {
+    uint64_t ts;
+    uint64_t seqno;
+    int64_t bid_price[3];
+    int64_t ask_price[3];
+    uint32_t bid_qty[3];
+    uint32_t ask_qty[3];
+};
+static_assert(sizeof(VenueBookTop) == TOPS_RECORD_SIZE_EXPECTED, "VenueBookTop size mismatch");
+
+// Every output of one file: a result file (raw or compact) or statistics collector per target quantity,
+// plus a capacity file per bps budget (parallel to options.budgets_bps)
+template <typename Result>
+struct ImpactOutputs {
+    std::vector<ExecutionOutput<Result>> results;
+    std::vector<CompactResultsWriter> compact_results;
+    std::vector<ImpactStatsCollector> collectors;
+    std::vector<ExecutionOutput<CapacityResult>> capacities;
+};
+
+const std::string WRITE_FAILED_ERROR = "Failed to write to output file. Disk full or other I/O error?";
+
+bool ensure_impactbase_directory(const std::string& books_folder, bool& created, std::string& error) {
+    std::string impactbase_dir_path_str = books_folder + "/" + IMPACTBASE_FOLDER;
+    created = false;
+    struct stat st;
+    if (stat(impactbase_dir_path_str.c_str(), &st) == -1) {
+        if (errno != ENOENT) {
+            error = "Could not stat path '" + impactbase_dir_path_str + "'. Errno: " + std::to_string(errno);
+            return false;
+        }
+        // Another process may have created it in the meantime
+        if (mkdir(impactbase_dir_path_str.c_str(), 0775) != 0 && errno != EEXIST) {
+            error = "Could not create directory '" + impactbase_dir_path_str + "'. Errno: " + std::to_string(errno);
+            return false;
+        }
+        created = true;
+        return true;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        error = "Path '" + impactbase_dir_path_str + "' exists but is not a directory.";
+        return false;
+    }
+    return true;
+}
+
+std::string impact_output_prefix(const std::string& input_filepath, const ImpactOptions& options) {
+    size_t last_slash = input_filepath.rfind('/');
+    std::string file_name_with_ext = (last_slash == std::string::npos) ? input_filepath : input_filepath.substr(last_slash + 1);
+    std::string input_dir_path = (last_slash == std::string::npos) ? "" : input_filepath.substr(0, last_slash + 1);
+
+    size_t last_dot_idx = file_name_with_ext.rfind('.');
+    std::string base_file_name_part = (last_dot_idx != std::string::npos) ? file_name_with_ext.substr(0, last_dot_idx) : file_name_with_ext;
+    std::string prefix = input_dir_path + IMPACTBASE_FOLDER + "/" + base_file_name_part;
+    return options.consolidated ? prefix + ".consolidated" : prefix;
+}
+
+template <typename Result>
+bool open_impact_outputs(const std::string& output_path_prefix, const ImpactOptions& options,
+                         ImpactOutputs<Result>& outputs, std::string& error) {
+    if (options.stats_mode) {
+        for (uint32_t target_quantity : options.target_quantities) {
+            outputs.collectors.emplace_back(target_quantity, DEFAULT_IMPACT_STATS_BUCKETS_NS);
+        }
+    } else if (options.compact_results) {
+        outputs.compact_results = std::vector<CompactResultsWriter>(options.target_quantities.size());
+        for (size_t q = 0; q < options.target_quantities.size(); ++q) {
+            std::string path = output_path_prefix + ".qty" + std::to_string(options.target_quantities[q]) + COMPACT_RESULTS_SUFFIX;
+            if (!outputs.compact_results[q].open(path, options.target_quantities[q], options.consolidated)) {
+                error = "Could not open output file: " + path;
+                return false;
+            }
+        }
+    } else {
+        outputs.results = std::vector<ExecutionOutput<Result>>(options.target_quantities.size());
+        for (size_t q = 0; q < options.target_quantities.size(); ++q) {
+            ExecutionOutput<Result>& output = outputs.results[q];
+            output.target_quantity = options.target_quantities[q];
+            output.path = output_path_prefix + ".qty" + std::to_string(output.target_quantity) + ".results.bin";
+            output.file.open(output.path, std::ios::binary | std::ios::trunc);
+            if (!output.file.is_open()) {
+                error = "Could not open output file: " + output.path;
+                return false;
+            }
+        }
+    }
+
+    outputs.capacities = std::vector<ExecutionOutput<CapacityResult>>(options.budgets_bps.size());
+    for (size_t b = 0; b < options.budgets_bps.size(); ++b) {
+        ExecutionOutput<CapacityResult>& capacity_output = outputs.capacities[b];
+        capacity_output.path = capacity_output_path(output_path_prefix, options.budgets_bps[b]);
+        capacity_output.file.open(capacity_output.path, std::ios::binary | std::ios::trunc);
+        if (!capacity_output.file.is_open()) {
+            error = "Could not open output file: " + capacity_output.path;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Closes the files, writes the statistics and records every path in file_result
+template <typename Result>
+bool finish_impact_outputs(const std::string& output_path_prefix, const ImpactOptions& options,
+                           ImpactOutputs<Result>& outputs, ImpactFileResult& file_result) {
+    if (options.report_progress) {
+        std::cout << "Processing complete." << std::endl;
+        std::cout << "Total BookTop entries processed: " << file_result.tops_processed << std::endl;
+    }
+    for (auto& output : outputs.results) {
+        output.file.close();
+        file_result.output_paths.push_back(output.path);
+        if (options.report_progress) {
+            std::cout << "Quantity " << output.target_quantity << ": " << output.records_written
+                      << " execution result records written to: " << output.path << std::endl;
+        }
+    }
+    for (auto& writer : outputs.compact_results) {
+        if (!writer.close()) {
+            file_result.error = "Failed writing output file: " + writer.path();
+            return false;
+        }
+        file_result.output_paths.push_back(writer.path());
+        if (options.report_progress) {
+            std::cout << "Quantity " << writer.target_quantity() << ": " << writer.records_written()
+                      << " compact execution result records written to: " << writer.path() << std::endl;
+        }
+    }
+    for (size_t b = 0; b < outputs.capacities.size(); ++b) {
+        outputs.capacities[b].file.close();
+        file_result.output_paths.push_back(outputs.capacities[b].path);
+        if (options.report_progress) {
+            std::cout << "Budget " << options.budgets_bps[b] << " bps: " << outputs.capacities[b].records_written
+                      << " capacity records written to: " << outputs.capacities[b].path << std::endl;
+        }
+    }
+
+    std::vector<std::string> stats_paths;
+    for (auto& collector : outputs.collectors) {
+        collector.finish();
+        if (!write_impact_stats(collector, output_path_prefix, stats_paths)) {
+            file_result.error = "Failed writing statistics for '" + output_path_prefix + "'";
+            return false;
+        }
+    }
+    for (const auto& stats_path : stats_paths) {
+        file_result.output_paths.push_back(stats_path);
+        if (options.report_progress) {
+            std::cout << "Statistics written to: " << stats_path << std::endl;
+        }
+    }
+    return true;
+}
+
+// Result of target quantity q into whichever result file is open for it
+template <typename Result>
+bool write_result(ImpactOutputs<Result>& outputs, size_t q, const Result& result) {
+    return outputs.compact_results.empty() ? outputs.results[q].write_if_changed(result)
+                                           : outputs.compact_results[q].write_if_changed(result);
+}
+
+void fill_tops_block(const VenueBookTop* tops, size_t count, TopsBlock& block) {
+    for (size_t r = 0; r < count; ++r) {
+        const VenueBookTop& top = tops[r];
+        block.ts[r] = top.ts;
+        block.seqno[r] = top.seqno;
+        for (int i = 0; i < IMPACT_LEVELS; ++i) {
+            block.bid_price[i][r] = top.bid_price[i];
+            block.ask_price[i][r] = top.ask_price[i];
+            block.bid_qty[i][r] = top.bid_qty[i];
+            block.ask_qty[i][r] = top.ask_qty[i];
+        }
+    }
+    block.count = count;
+}
+
+void fill_tops_block(const MergedTopsEntry* entries, size_t count, TopsBlock& block) {
+    for (size_t r = 0; r < count; ++r) {
+        const VenueTopsRecord& top = entries[r].record;
+        const TopLevelData* levels[IMPACT_LEVELS] = {&top.level1, &top.level2, &top.level3};
+        block.ts[r] = top.ts;
+        block.seqno[r] = top.seqno;
+        for (int i = 0; i < IMPACT_LEVELS; ++i) {
+            block.bid_price[i][r] = levels[i]->bid_price;
+            block.ask_price[i][r] = levels[i]->ask_price;
+            block.bid_qty[i][r] = levels[i]->bid_qty;
+            block.ask_qty[i][r] = levels[i]->ask_qty;
+        }
+    }
+    block.count = count;
+}
+
+// Each top on its own: tops are read IMPACT_BLOCK_SIZE at a time and transposed into columns for the batched kernels
+template <typename Row>
+bool run_row_impact(std::ifstream& input_file, const std::string& input_filepath, uint32_t number_of_tops,
+                    const ImpactOptions& options, ImpactOutputs<ExecutionResult>& outputs, ImpactFileResult& file_result) {
+    std::vector<Row> read_buffer(IMPACT_BLOCK_SIZE);
+    auto block = std::make_unique<TopsBlock>();
+    std::vector<ExecutionResult> block_results(IMPACT_BLOCK_SIZE);
+    std::vector<double> block_mids(IMPACT_BLOCK_SIZE);
+    std::vector<CapacityResult> capacity_results(IMPACT_BLOCK_SIZE);
+
+    while (file_result.tops_processed < number_of_tops) {
+        size_t tops_to_read = std::min<size_t>(IMPACT_BLOCK_SIZE, number_of_tops - file_result.tops_processed);
+        input_file.read(reinterpret_cast<char *>(read_buffer.data()), tops_to_read * sizeof(Row));
+        size_t tops_read = static_cast<size_t>(input_file.gcount()) / sizeof(Row);
+        fill_tops_block(read_buffer.data(), tops_read, *block);
+
+        for (size_t q = 0; q < options.target_quantities.size() && !options.stats_mode; ++q) {
+            calculate_execution_block(options.target_quantities[q], *block, block_results.data());
+            for (size_t r = 0; r < tops_read; ++r) {
+                if (!write_result(outputs, q, block_results[r])) {
+                    file_result.error = WRITE_FAILED_ERROR;
+                    return false;
+                }
+            }
+        }
+
+        if (!outputs.collectors.empty()) {
+            for (size_t r = 0; r < tops_read; ++r) {
+                bool two_sided = block->bid_price[0][r] != 0 && block->ask_price[0][r] != 0;
+                block_mids[r] = two_sided ? static_cast<double>(block->bid_price[0][r] + block->ask_price[0][r]) / 2e9 : NAN;
+            }
+            for (auto& collector : outputs.collectors) {
+                calculate_execution_block(collector.target_quantity(), *block, block_results.data());
+                for (size_t r = 0; r < tops_read; ++r) {
+                    collector.add(block_results[r].timestamp, block_mids[r],
+                                  block_results[r].bid_exec_price, block_results[r].ask_exec_price);
+                }
+            }
+        }
+
+        for (size_t b = 0; b < outputs.capacities.size(); ++b) {
+            calculate_capacity_block(options.budgets_bps[b], *block, capacity_results.data());
+            for (size_t r = 0; r < tops_read; ++r) {
+                if (!outputs.capacities[b].write_if_changed(capacity_results[r])) {
+                    file_result.error = WRITE_FAILED_ERROR;
+                    return false;
+                }
+            }
+        }
+        file_result.tops_processed += static_cast<uint32_t>(tops_read);
+
+        if (tops_read < tops_to_read) {
+            file_result.warnings.push_back("Could not read full top " + std::to_string(file_result.tops_processed + 1) + "/" +
+                                           std::to_string(number_of_tops) + " of '" + input_filepath + "'. Processed " +
+                                           std::to_string(file_result.tops_processed) + " entries.");
+            break;
+        }
+    }
+    return true;
+}
+
+// Consolidated depth: keeps the latest three levels of every venue, as process_merged_tops does,
+// and sweeps the depth aggregated across all venues after every merged entry
+bool run_consolidated_impact(std::ifstream& input_file, const std::string& input_filepath, uint32_t number_of_tops,
+                             const ImpactOptions& options, ImpactOutputs<ConsolidatedExecutionResult>& outputs,
+                             ImpactFileResult& file_result) {
+    std::vector<MergedTopsEntry> read_buffer(IMPACT_BLOCK_SIZE);
+    auto venue_quotes = std::make_unique<VenueQuoteTable>();
+    auto bid_ladder = std::make_unique<DepthLadder>();
+    auto ask_ladder = std::make_unique<DepthLadder>();
+    bool venue_overflow_reported = false;
+
+    while (file_result.tops_processed < number_of_tops) {
+        size_t tops_to_read = std::min<size_t>(IMPACT_BLOCK_SIZE, number_of_tops - file_result.tops_processed);
+        input_file.read(reinterpret_cast<char *>(read_buffer.data()), tops_to_read * sizeof(MergedTopsEntry));
+        size_t tops_read = static_cast<size_t>(input_file.gcount()) / sizeof(MergedTopsEntry);
+
+        for (size_t r = 0; r < tops_read; ++r) {
+            const MergedTopsEntry& entry = read_buffer[r];
+            int venue_slot = venue_quotes->slot_for(entry.feed_id);
+            if (venue_slot < 0) {
+                if (!venue_overflow_reported) {
+                    file_result.warnings.push_back("More than " + std::to_string(MAX_VENUES) + " venues in '" + input_filepath +
+                                                   "'. Skipping records from additional feed_ids.");
+                    venue_overflow_reported = true;
+                }
+                continue;
+            }
+            venue_quotes->update(venue_slot, entry.record);
+            build_depth_ladder(*venue_quotes, true, *bid_ladder);
+            build_depth_ladder(*venue_quotes, false, *ask_ladder);
+
+            for (size_t q = 0; q < options.target_quantities.size() && !options.stats_mode; ++q) {
+                uint32_t target_quantity = options.target_quantities[q];
+                DepthExecution bid = calculate_depth_execution(target_quantity, bid_ladder->price, bid_ladder->quantity,
+                                                               bid_ladder->venue_mask, bid_ladder->count);
+                DepthExecution ask = calculate_depth_execution(target_quantity, ask_ladder->price, ask_ladder->quantity,
+                                                               ask_ladder->venue_mask, ask_ladder->count);
+                ConsolidatedExecutionResult current_exec_result;
+                current_exec_result.timestamp = entry.record.ts;
+                current_exec_result.seqno = entry.record.seqno;
+                current_exec_result.bid_exec_price = bid.exec_price;
+                current_exec_result.bid_levels_consumed = bid.levels_consumed;
+                current_exec_result.bid_venues_touched = bid.venues_touched;
+                current_exec_result.ask_exec_price = ask.exec_price;
+                current_exec_result.ask_levels_consumed = ask.levels_consumed;
+                current_exec_result.ask_venues_touched = ask.venues_touched;
+                if (!write_result(outputs, q, current_exec_result)) {
+                    file_result.error = WRITE_FAILED_ERROR;
+                    return false;
+                }
+            }
+
+            if (!outputs.collectors.empty()) {
+                bool two_sided = bid_ladder->count > 0 && ask_ladder->count > 0;
+                double mid = two_sided ? static_cast<double>(bid_ladder->price[0] + ask_ladder->price[0]) / 2e9 : NAN;
+                for (auto& collector : outputs.collectors) {
+                    DepthExecution bid = calculate_depth_execution(collector.target_quantity(), bid_ladder->price, bid_ladder->quantity,
+                                                                   bid_ladder->venue_mask, bid_ladder->count);
+                    DepthExecution ask = calculate_depth_execution(collector.target_quantity(), ask_ladder->price, ask_ladder->quantity,
+                                                                   ask_ladder->venue_mask, ask_ladder->count);
+                    collector.add(entry.record.ts, mid, bid.exec_price, ask.exec_price);
+                }
+            }
+
+            for (size_t b = 0; b < outputs.capacities.size(); ++b) {
+                CapacityResult capacity;
+                capacity.timestamp = entry.record.ts;
+                capacity.seqno = entry.record.seqno;
+                capacity.bid_max_quantity = calculate_depth_capacity(options.budgets_bps[b], true, bid_ladder->price,
+                                                                     bid_ladder->quantity, bid_ladder->count);
+                capacity.ask_max_quantity = calculate_depth_capacity(options.budgets_bps[b], false, ask_ladder->price,
+                                                                     ask_ladder->quantity, ask_ladder->count);
+                if (!outputs.capacities[b].write_if_changed(capacity)) {
+                    file_result.error = WRITE_FAILED_ERROR;
+                    return false;
+                }
+            }
+        }
+        file_result.tops_processed += static_cast<uint32_t>(tops_read);
+
+        if (tops_read < tops_to_read) {
+            file_result.warnings.push_back("Could not read full merged tops entry " + std::to_string(file_result.tops_processed + 1) +
+                                           "/" + std::to_string(number_of_tops) + " of '" + input_filepath + "'. Processed " +
+                                           std::to_string(file_result.tops_processed) + " entries.");
+            break;
+        }
+    }
+    return true;
+}
+
+template <typename Result, typename Run>
+bool run_with_outputs(const std::string& output_path_prefix, const ImpactOptions& options,
+                      ImpactFileResult& file_result, Run run) {
+    ImpactOutputs<Result> outputs;
+    if (!open_impact_outputs(output_path_prefix, options, outputs, file_result.error)) {
+        return false;
+    }
+    if (!run(outputs)) {
+        return false;
+    }
+    return finish_impact_outputs(output_path_prefix, options, outputs, file_result);
+}
+
+ImpactFileResult process_impact_file(const std::string& input_filepath, ImpactInputKind kind, const ImpactOptions& options) {
+    ImpactFileResult file_result;
+    if (options.consolidated && kind != ImpactInputKind::MergedTops) {
+        file_result.error = "Consolidated depth needs merged_tops input: " + input_filepath;
+        return file_result;
+    }
+    if (options.target_quantities.empty() && options.budgets_bps.empty()) {
+        file_result.error = "No target quantity or bps budget for '" + input_filepath + "'";
+        return file_result;
+    }
+
+    std::ifstream input_file(input_filepath, std::ios::binary);
+    if (!input_file.is_open()) {
+        file_result.error = "Could not open input file: " + input_filepath;
+        return file_result;
+    }
+    InputFileHeader header;
+    input_file.read(reinterpret_cast<char *>(&header), sizeof(InputFileHeader));
+    if (static_cast<size_t>(input_file.gcount()) < sizeof(InputFileHeader)) {
+        file_result.error = "File is too small to contain a valid header or read error: " + input_filepath;
+        return file_result;
+    }
+    file_result.dateint = header.dateint;
+    file_result.symbol_idx = header.symbol_idx;
+
+    if (options.report_progress) {
+        std::cout << "Processing file: " << input_filepath << std::endl;
+        std::cout << "  Feed ID: " << header.feed_id << ", Date: " << header.dateint
+                  << ", Tops: " << header.total_record_count << ", Symbol Idx: " << header.symbol_idx << std::endl;
+        std::cout << "Target quantities for execution:";
+        for (uint32_t target_quantity : options.target_quantities) {
+            std::cout << " " << target_quantity;
+        }
+        std::cout << std::endl;
+    }
+
+    std::string output_path_prefix = impact_output_prefix(input_filepath, options);
+    uint32_t number_of_tops = header.total_record_count;
+    bool ok;
+    if (options.consolidated) {
+        ok = run_with_outputs<ConsolidatedExecutionResult>(output_path_prefix, options, file_result, [&](auto& outputs) {
+            return run_consolidated_impact(input_file, input_filepath, number_of_tops, options, outputs, file_result);
+        });
+    } else if (kind == ImpactInputKind::MergedTops) {
+        ok = run_with_outputs<ExecutionResult>(output_path_prefix, options, file_result, [&](auto& outputs) {
+            return run_row_impact<MergedTopsEntry>(input_file, input_filepath, number_of_tops, options, outputs, file_result);
+        });
+    } else {
+        ok = run_with_outputs<ExecutionResult>(output_path_prefix, options, file_result, [&](auto& outputs) {
+            return run_row_impact<VenueBookTop>(input_file, input_filepath, number_of_tops, options, outputs, file_result);
+        });
+    }
+    file_result.ok = ok;
+    return file_result;
+}
@@ -0,0 +1,51 @@
+#ifndef IMPACT_RUNNER_HPP
+#define IMPACT_RUNNER_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// --- Constants ---
+const std::string IMPACTBASE_FOLDER = "impactbase";
+
+enum class ImpactInputKind {
+    VenueBookTops,  // <VENUE>.book_tops.SYM.bin
+    MergedTops      // merged_tops.SYM.bin, each top prefixed by its feed_id
+};
+
+// What process_impact_file computes for one file. consolidated only applies to MergedTops input;
+// compact_results writes the v2 encoding (<prefix>.qtyN.results.v2.bin) instead of raw records.
+struct ImpactOptions {
+    std::vector<uint32_t> target_quantities;
+    std::vector<double> budgets_bps;
+    bool stats_mode = false;
+    bool consolidated = false;
+    bool compact_results = false;
+    bool report_progress = false;
+};
+
+// Outcome of one tops file. On failure, error describes the problem and outputs may be partial.
+// warnings lists recoverable problems with the input, for the caller to report.
+struct ImpactFileResult {
+    bool ok = false;
+    std::string error;
+    std::vector<std::string> warnings;
+    uint32_t dateint = 0;
+    uint64_t symbol_idx = 0;
+    uint32_t tops_processed = 0;
+    std::vector<std::string> output_paths;
+};
+
+// Creates <books_folder>/impactbase unless it already exists; created tells which.
+// Returns false with error set if it cannot be created or is not a directory.
+bool ensure_impactbase_directory(const std::string& books_folder, bool& created, std::string& error);
+
+// <input folder>/impactbase/<input file name without .bin>, plus ".consolidated" in consolidated mode
+std::string impact_output_prefix(const std::string& input_filepath, const ImpactOptions& options);
+
+// Runs every requested impact computation over one tops file in a single pass. The impactbase
+// folder must exist. Nothing is printed unless options.report_progress is set, so the function
+// can run on several files at once.
+ImpactFileResult process_impact_file(const std::string& input_filepath, ImpactInputKind kind, const ImpactOptions& options);
+
+#endif
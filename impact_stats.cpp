@@ -0,0 +1,298 @@
+#include "impact_stats.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+
+// Magnitudes below this are counted as zero
+const double DDSKETCH_MIN_MAGNITUDE = 1e-9;
+
+DDSketch::DDSketch(double relative_accuracy)
+    : gamma_((1.0 + relative_accuracy) / (1.0 - relative_accuracy)),
+      log_gamma_(std::log((1.0 + relative_accuracy) / (1.0 - relative_accuracy))) {}
+
+void DDSketch::BinStore::add(int index, double weight) {
+    if (weights.empty()) {
+        offset = index;
+        weights.assign(1, 0.0);
+    } else if (index < offset) {
+        weights.insert(weights.begin(), static_cast<size_t>(offset - index), 0.0);
+        offset = index;
+    } else if (index >= offset + static_cast<int>(weights.size())) {
+        weights.resize(static_cast<size_t>(index - offset + 1), 0.0);
+    }
+    weights[static_cast<size_t>(index - offset)] += weight;
+    total += weight;
+}
+
+void DDSketch::BinStore::merge(const BinStore& other) {
+    for (size_t i = 0; i < other.weights.size(); ++i) {
+        if (other.weights[i] != 0.0) {
+            add(other.offset + static_cast<int>(i), other.weights[i]);
+        }
+    }
+}
+
+void DDSketch::BinStore::clear() {
+    // Keeps the capacity, sketches of consecutive buckets cover similar ranges
+    weights.clear();
+    offset = 0;
+    total = 0.0;
+}
+
+int DDSketch::index_for(double magnitude) const {
+    return static_cast<int>(std::ceil(std::log(magnitude) / log_gamma_));
+}
+
+double DDSketch::value_for(int index) const {
+    // Midpoint (in relative terms) of the bin (gamma^(index-1), gamma^index]
+    return 2.0 * std::pow(gamma_, index) / (gamma_ + 1.0);
+}
+
+void DDSketch::add(double value, double weight) {
+    if (weight <= 0.0 || std::isnan(value)) {
+        return;
+    }
+    if (value > DDSKETCH_MIN_MAGNITUDE) {
+        positive_.add(index_for(value), weight);
+    } else if (value < -DDSKETCH_MIN_MAGNITUDE) {
+        negative_.add(index_for(-value), weight);
+    } else {
+        zero_weight_ += weight;
+    }
+}
+
+void DDSketch::merge(const DDSketch& other) {
+    positive_.merge(other.positive_);
+    negative_.merge(other.negative_);
+    zero_weight_ += other.zero_weight_;
+}
+
+void DDSketch::clear() {
+    positive_.clear();
+    negative_.clear();
+    zero_weight_ = 0.0;
+}
+
+double DDSketch::quantile(double q) const {
+    double total = total_weight();
+    if (total <= 0.0) {
+        return NAN;
+    }
+    double rank = std::clamp(q, 0.0, 1.0) * total;
+    double cumulative = 0.0;
+
+    // Ascending values: largest negative magnitudes first, then zero, then positives
+    for (size_t i = negative_.weights.size(); i-- > 0;) {
+        cumulative += negative_.weights[i];
+        if (cumulative > rank) {
+            return -value_for(negative_.offset + static_cast<int>(i));
+        }
+    }
+    cumulative += zero_weight_;
+    if (cumulative > rank) {
+        return 0.0;
+    }
+    for (size_t i = 0; i < positive_.weights.size(); ++i) {
+        cumulative += positive_.weights[i];
+        if (cumulative > rank) {
+            return value_for(positive_.offset + static_cast<int>(i));
+        }
+    }
+
+    // q == 1 (or rounding): the largest value
+    if (!positive_.weights.empty()) {
+        return value_for(positive_.offset + static_cast<int>(positive_.weights.size()) - 1);
+    }
+    if (zero_weight_ > 0.0) {
+        return 0.0;
+    }
+    return -value_for(negative_.offset);
+}
+
+void ImpactStatsCollector::SideBucket::add(double cost_bps, uint64_t duration_ns) {
+    if (duration_ns == 0) {
+        return;
+    }
+    if (std::isnan(cost_bps)) {
+        unfilled_ns += duration_ns;
+        return;
+    }
+    if (filled_ns == 0) {
+        min = cost_bps;
+        max = cost_bps;
+    } else {
+        min = std::min(min, cost_bps);
+        max = std::max(max, cost_bps);
+    }
+    filled_ns += duration_ns;
+    weighted_sum += cost_bps * static_cast<double>(duration_ns);
+    sketch.add(cost_bps, static_cast<double>(duration_ns));
+}
+
+void ImpactStatsCollector::SideBucket::merge(const SideBucket& other) {
+    if (other.filled_ns > 0) {
+        if (filled_ns == 0) {
+            min = other.min;
+            max = other.max;
+        } else {
+            min = std::min(min, other.min);
+            max = std::max(max, other.max);
+        }
+    }
+    filled_ns += other.filled_ns;
+    unfilled_ns += other.unfilled_ns;
+    updates += other.updates;
+    weighted_sum += other.weighted_sum;
+    sketch.merge(other.sketch);
+}
+
+void ImpactStatsCollector::SideBucket::clear() {
+    filled_ns = 0;
+    unfilled_ns = 0;
+    updates = 0;
+    weighted_sum = 0.0;
+    min = 0.0;
+    max = 0.0;
+    sketch.clear();
+}
+
+ImpactSideStats ImpactStatsCollector::SideBucket::summarize() const {
+    ImpactSideStats stats;
+    stats.filled_ns = filled_ns;
+    stats.unfilled_ns = unfilled_ns;
+    stats.updates = updates;
+    if (filled_ns == 0) {
+        stats.mean_bps = stats.min_bps = stats.max_bps = NAN;
+        stats.p50_bps = stats.p90_bps = stats.p99_bps = NAN;
+        return stats;
+    }
+    stats.mean_bps = weighted_sum / static_cast<double>(filled_ns);
+    stats.min_bps = min;
+    stats.max_bps = max;
+    // The sketch only knows bins; keep its estimates inside the exact range
+    stats.p50_bps = std::clamp(sketch.quantile(0.50), min, max);
+    stats.p90_bps = std::clamp(sketch.quantile(0.90), min, max);
+    stats.p99_bps = std::clamp(sketch.quantile(0.99), min, max);
+    return stats;
+}
+
+ImpactStatsCollector::ImpactStatsCollector(uint32_t target_quantity, const std::vector<uint64_t>& bucket_widths_ns)
+    : target_quantity_(target_quantity),
+      bucket_widths_ns_(bucket_widths_ns),
+      open_buckets_(bucket_widths_ns.size()),
+      records_(bucket_widths_ns.size()) {}
+
+void ImpactStatsCollector::roll(size_t level, uint64_t start_ns) {
+    Bucket& bucket = open_buckets_[level];
+    if (bucket.open && bucket.start_ns == start_ns) {
+        return;
+    }
+    if (bucket.open) {
+        close(level);
+    }
+    bucket.open = true;
+    bucket.start_ns = start_ns;
+}
+
+void ImpactStatsCollector::close(size_t level) {
+    Bucket& bucket = open_buckets_[level];
+    // A bucket without updates only repeats the result in force before it. Its time still counts in
+    // the coarser buckets, but it gets no record of its own
+    if (bucket.buy.updates > 0) {
+        ImpactStatsRecord record;
+        record.bucket_start_ns = bucket.start_ns;
+        record.buy = bucket.buy.summarize();
+        record.sell = bucket.sell.summarize();
+        records_[level].push_back(record);
+    }
+
+    if (level + 1 < open_buckets_.size()) {
+        uint64_t parent_width = bucket_widths_ns_[level + 1];
+        roll(level + 1, bucket.start_ns / parent_width * parent_width);
+        open_buckets_[level + 1].buy.merge(bucket.buy);
+        open_buckets_[level + 1].sell.merge(bucket.sell);
+    }
+    bucket.buy.clear();
+    bucket.sell.clear();
+    bucket.open = false;
+}
+
+void ImpactStatsCollector::add_segment(uint64_t begin_ns, uint64_t end_ns, double buy_bps, double sell_bps) {
+    const uint64_t width = bucket_widths_ns_[0];
+    while (begin_ns < end_ns) {
+        uint64_t bucket_start = begin_ns / width * width;
+        uint64_t segment_end = std::min(end_ns, bucket_start + width);
+        roll(0, bucket_start);
+        open_buckets_[0].buy.add(buy_bps, segment_end - begin_ns);
+        open_buckets_[0].sell.add(sell_bps, segment_end - begin_ns);
+        begin_ns = segment_end;
+    }
+}
+
+void ImpactStatsCollector::add(uint64_t ts, double mid_price, double bid_exec_price, double ask_exec_price) {
+    if (bucket_widths_ns_.empty()) {
+        return;
+    }
+    bool has_mid = mid_price > 0.0;
+    double buy_bps = (has_mid && !std::isnan(ask_exec_price)) ? (ask_exec_price - mid_price) / mid_price * 1e4 : NAN;
+    double sell_bps = (has_mid && !std::isnan(bid_exec_price)) ? (mid_price - bid_exec_price) / mid_price * 1e4 : NAN;
+
+    if (have_last_) {
+        ts = std::max(ts, last_ts_);
+        add_segment(last_ts_, ts, last_buy_bps_, last_sell_bps_);
+    }
+    const uint64_t width = bucket_widths_ns_[0];
+    roll(0, ts / width * width);
+    open_buckets_[0].buy.updates++;
+    open_buckets_[0].sell.updates++;
+
+    have_last_ = true;
+    last_ts_ = ts;
+    last_buy_bps_ = buy_bps;
+    last_sell_bps_ = sell_bps;
+}
+
+void ImpactStatsCollector::finish() {
+    for (size_t level = 0; level < open_buckets_.size(); ++level) {
+        if (open_buckets_[level].open) {
+            close(level);
+        }
+    }
+}
+
+std::string bucket_width_label(uint64_t bucket_ns) {
+    const uint64_t second_ns = 1000000000ULL;
+    if (bucket_ns % (3600 * second_ns) == 0) return std::to_string(bucket_ns / (3600 * second_ns)) + "h";
+    if (bucket_ns % (60 * second_ns) == 0) return std::to_string(bucket_ns / (60 * second_ns)) + "m";
+    if (bucket_ns % second_ns == 0) return std::to_string(bucket_ns / second_ns) + "s";
+    return std::to_string(bucket_ns) + "ns";
+}
+
+bool write_impact_stats(const ImpactStatsCollector& collector, const std::string& output_path_prefix,
+                        std::vector<std::string>& written_paths) {
+    for (size_t w = 0; w < collector.bucket_widths_ns().size(); ++w) {
+        const std::vector<ImpactStatsRecord>& records = collector.records(w);
+        std::string path = output_path_prefix + ".qty" + std::to_string(collector.target_quantity()) +
+                           ".stats_" + bucket_width_label(collector.bucket_widths_ns()[w]) + ".bin";
+        std::ofstream stats_file(path, std::ios::binary | std::ios::trunc);
+        if (!stats_file.is_open()) {
+            std::cerr << "Error: Could not open output file: " << path << std::endl;
+            return false;
+        }
+
+        ImpactStatsFileHeader header;
+        header.bucket_ns = collector.bucket_widths_ns()[w];
+        header.target_quantity = collector.target_quantity();
+        header.record_count = static_cast<uint32_t>(records.size());
+        stats_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        stats_file.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(ImpactStatsRecord));
+        if (!stats_file) {
+            std::cerr << "Error: Failed to write to output file: " << path << std::endl;
+            return false;
+        }
+        written_paths.push_back(path);
+    }
+    return true;
+}
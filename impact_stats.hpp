@@ -0,0 +1,151 @@
+#ifndef IMPACT_STATS_HPP
+#define IMPACT_STATS_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// --- Constants ---
+// Bucket widths of the --stats mode: 1s, 1m and 30m. Each width must be a multiple of the one before it.
+const std::vector<uint64_t> DEFAULT_IMPACT_STATS_BUCKETS_NS = {1000000000ULL, 60000000000ULL, 1800000000000ULL};
+// Quantiles are within 1% of the true value (relative)
+const double DDSKETCH_RELATIVE_ACCURACY = 0.01;
+
+// Weighted DDSketch: values are counted in logarithmic bins of relative width DDSKETCH_RELATIVE_ACCURACY,
+// so two sketches merge exactly by adding bin weights. Negative values get their own bins.
+class DDSketch {
+public:
+    explicit DDSketch(double relative_accuracy = DDSKETCH_RELATIVE_ACCURACY);
+
+    void add(double value, double weight);
+    void merge(const DDSketch& other);
+    void clear();
+
+    // Value at rank q * total weight, q in [0, 1]; NaN when empty
+    double quantile(double q) const;
+    double total_weight() const { return zero_weight_ + positive_.total + negative_.total; }
+
+private:
+    // Dense weights of consecutive bin indexes starting at offset
+    struct BinStore {
+        int offset = 0;
+        std::vector<double> weights;
+        double total = 0.0;
+
+        void add(int index, double weight);
+        void merge(const BinStore& other);
+        void clear();
+    };
+
+    int index_for(double magnitude) const;
+    double value_for(int index) const;
+
+    double gamma_;
+    double log_gamma_;
+    double zero_weight_ = 0.0;
+    BinStore positive_;
+    BinStore negative_;
+};
+
+#pragma pack(push, 1)
+
+// Execution cost of one side over one bucket. Cost is in bps of the mid, positive when worse than the mid.
+// Statistics are weighted by how long each result held; time without a result (target not fillable
+// or no two-sided top) counts as unfilled_ns and is left out of them. They are NaN if filled_ns is 0.
+struct ImpactSideStats {
+    uint64_t filled_ns;
+    uint64_t unfilled_ns;
+    uint64_t updates;
+    double mean_bps;
+    double min_bps;
+    double max_bps;
+    double p50_bps;
+    double p90_bps;
+    double p99_bps;
+};
+static_assert(sizeof(ImpactSideStats) == 72, "ImpactSideStats size mismatch");
+
+// buy lifts the asks, sell hits the bids
+struct ImpactStatsRecord {
+    uint64_t bucket_start_ns;
+    ImpactSideStats buy;
+    ImpactSideStats sell;
+};
+static_assert(sizeof(ImpactStatsRecord) == 152, "ImpactStatsRecord size mismatch");
+
+// Followed by record_count ImpactStatsRecord, ascending by bucket_start_ns. Only buckets that received
+// at least one update have a record, so quiet stretches leave gaps in bucket_start_ns.
+struct ImpactStatsFileHeader {
+    uint64_t bucket_ns;
+    uint32_t target_quantity;
+    uint32_t record_count;
+};
+static_assert(sizeof(ImpactStatsFileHeader) == 16, "ImpactStatsFileHeader size mismatch");
+
+#pragma pack(pop)
+
+// Streaming per-bucket statistics of one target quantity. Only the finest bucket receives results;
+// a closed bucket is merged into the coarser bucket containing it, so a day of ticks ends up as a
+// few thousand records at most. Buckets without updates are merged but not recorded.
+class ImpactStatsCollector {
+public:
+    ImpactStatsCollector(uint32_t target_quantity, const std::vector<uint64_t>& bucket_widths_ns);
+
+    // Execution prices at ts (NaN if not fillable). The result holds until the next call;
+    // ts must not go backwards.
+    void add(uint64_t ts, double mid_price, double bid_exec_price, double ask_exec_price);
+
+    // Closes every open bucket. The last result has no successor and therefore no duration.
+    void finish();
+
+    uint32_t target_quantity() const { return target_quantity_; }
+    const std::vector<uint64_t>& bucket_widths_ns() const { return bucket_widths_ns_; }
+    const std::vector<ImpactStatsRecord>& records(size_t width_index) const { return records_[width_index]; }
+
+private:
+    struct SideBucket {
+        uint64_t filled_ns = 0;
+        uint64_t unfilled_ns = 0;
+        uint64_t updates = 0;
+        double weighted_sum = 0.0;
+        double min = 0.0;
+        double max = 0.0;
+        DDSketch sketch;
+
+        void add(double cost_bps, uint64_t duration_ns);
+        void merge(const SideBucket& other);
+        void clear();
+        ImpactSideStats summarize() const;
+    };
+
+    struct Bucket {
+        bool open = false;
+        uint64_t start_ns = 0;
+        SideBucket buy;
+        SideBucket sell;
+    };
+
+    // Makes start_ns the open bucket of width level, closing the previous one first
+    void roll(size_t level, uint64_t start_ns);
+    void close(size_t level);
+    void add_segment(uint64_t begin_ns, uint64_t end_ns, double buy_bps, double sell_bps);
+
+    uint32_t target_quantity_;
+    std::vector<uint64_t> bucket_widths_ns_;
+    std::vector<Bucket> open_buckets_;
+    std::vector<std::vector<ImpactStatsRecord>> records_;
+    bool have_last_ = false;
+    uint64_t last_ts_ = 0;
+    double last_buy_bps_ = 0.0;
+    double last_sell_bps_ = 0.0;
+};
+
+// "1s", "1m", "30m", "1h" or "<n>ns"
+std::string bucket_width_label(uint64_t bucket_ns);
+
+// Writes <output_path_prefix>.qtyN.stats_<label>.bin for every bucket width of a finished collector
+// and appends the paths to written_paths. Prints the problem and returns false on an I/O error.
+bool write_impact_stats(const ImpactStatsCollector& collector, const std::string& output_path_prefix,
+                        std::vector<std::string>& written_paths);
+
+#endif
@@ -20,6 +20,9 @@
 #include <atomic>
 #include <functional>
 
+#include "merged_cursor.hpp"
+#include "provenance.hpp"
+
 #ifdef _WIN32
 #else
 #include <sys/wait.h>
@@ -28,60 +31,8 @@
 namespace fs = std::filesystem;
 
 // --- Constants ---
-const size_t HEADER_SIZE = 24;
 const std::string PYTHON_EXECUTABLE = "python";
-
-#pragma pack(push, 1)
-
-struct Header {
-    uint64_t feed_id;
-    uint32_t dateint;
-    uint32_t count;
-    uint64_t symbol_idx;
-};
-static_assert(sizeof(Header) == HEADER_SIZE, "Header size mismatch");
-
-struct FillsRecord {
-    uint64_t ts;
-    uint64_t seq_no;
-    uint64_t resting_order_id;
-    bool was_hidden;
-    int64_t trade_price;
-    uint32_t trade_qty;
-    uint64_t execution_id;
-    uint32_t resting_original_qty;
-    uint32_t resting_order_remaining_qty;
-    uint64_t resting_order_last_update_ts;
-    bool resting_side_is_bid;
-    int64_t resting_side_price;
-    uint32_t resting_side_qty;
-    int64_t opposing_side_price;
-    uint32_t opposing_side_qty;
-    uint32_t resting_side_number_of_orders;
-};
-const size_t FILLS_RECORD_SIZE = sizeof(FillsRecord);
-static_assert(sizeof(FillsRecord) == 90, "FillsRecord size mismatch");
-
-struct top_level
-{
-    int64_t bid_nanos;
-    int64_t ask_nanos;
-    uint32_t bid_qty;
-    uint32_t ask_qty;
-};
-static_assert(sizeof(top_level) == 24, "top_level size mismatch");
-
-struct TopsRecord {
-    uint64_t ts;
-    uint64_t seqno;
-    top_level first_level;
-    top_level second_level;
-    top_level third_level;
-};
-const size_t TOPS_RECORD_SIZE = sizeof(TopsRecord);
-static_assert(sizeof(TopsRecord) == 88, "TopsRecord size mismatch");
-
-#pragma pack(pop)
+const std::string MERGED_BOOK_GENERATION_VERSION = "1";
 
 // --- Helper Functions ---
 std::string to_lower_str(std::string s) {
@@ -129,44 +80,13 @@ std::vector<std::string> find_venue_folders(const fs::path& base_date_path, std:
     return venue_folders;
 }
 
-std::optional<std::pair<uint64_t, std::vector<char>>>
-read_next_record_with_timestamp_raw(std::ifstream& file_handle, size_t record_size) {
-    if (record_size == 0) return std::nullopt;
-    std::vector<char> record_data_bytes(record_size);
-    file_handle.read(record_data_bytes.data(), record_size);
-
-    if (static_cast<size_t>(file_handle.gcount()) < record_size) {
-        return std::nullopt;
-    }
-
-    uint64_t timestamp;
-    std::memcpy(&timestamp, record_data_bytes.data(), sizeof(uint64_t));
-    return std::make_pair(timestamp, record_data_bytes);
-}
-
-
-// Structure for items in the min-heap
-struct HeapItem {
-    uint64_t timestamp;
-    std::vector<char> record_data;
-    size_t file_index;
-    uint64_t feed_id;
-
-    // Min-heap comparison
-    bool operator>(const HeapItem& other) const {
-        if (timestamp != other.timestamp) {
-            return timestamp > other.timestamp;
-        }
-        return false;
-    }
-};
-
 std::optional<fs::path> merge_files_for_symbol_by_timestamp(
     const fs::path& base_date_path,
     const std::vector<std::string>& venue_folders,
     const std::string& symbol,
     const std::string& file_type_suffix,
     const fs::path& merged_output_folder,
+    bool force_rebuild,
     std::mutex& console_mutex) {
 
     std::string merged_filename_key;
@@ -182,76 +102,31 @@ std::optional<fs::path> merge_files_for_symbol_by_timestamp(
 
     fs::path merged_filepath = merged_output_folder / ("merged_" + merged_filename_key + "." + symbol + ".bin");
 
-    size_t record_size = 0;
-    if (file_type_suffix == "book_fills") {
-        record_size = FILLS_RECORD_SIZE;
-    } else {
-        record_size = TOPS_RECORD_SIZE;
-    }
-
-    std::vector<fs::path> source_files_to_process;
-    for (const auto& venue : venue_folders) {
-        fs::path books_folder_path = base_date_path / venue / "books";
-        fs::path source_filepath = books_folder_path / (to_upper_str(venue) + "." + file_type_suffix + "." + symbol + ".bin");
-
-        if (fs::exists(source_filepath) && fs::is_regular_file(source_filepath)) {
-            try {
-                if (fs::file_size(source_filepath) >= HEADER_SIZE) {
-                    source_files_to_process.push_back(source_filepath);
-                } else {
-                    std::lock_guard<std::mutex> lock(console_mutex);
-                    std::cout << "  Skipping small file (less than header size): " << source_filepath << std::endl;
-                }
-            } catch (const fs::filesystem_error& e) {
-                std::lock_guard<std::mutex> lock(console_mutex);
-                std::cerr << "  Error checking file size for " << source_filepath << ": " << e.what() << std::endl;
-            }
+    MergedCursor cursor(base_date_path, venue_folders, symbol, file_type_suffix);
+    if (!cursor.warnings().empty()) {
+        std::lock_guard<std::mutex> lock(console_mutex);
+        for (const auto& warning : cursor.warnings()) {
+            std::cerr << "  " << warning << std::endl;
         }
     }
 
-    if (source_files_to_process.empty()) {
+    if (cursor.empty() || !cursor.first_header()) {
         return std::nullopt;
     }
 
-    std::vector<std::unique_ptr<std::ifstream>> file_streams;
-    file_streams.reserve(source_files_to_process.size());
-
-    std::optional<Header> first_valid_header_data_opt;
-    std::priority_queue<HeapItem, std::vector<HeapItem>, std::greater<HeapItem>> min_heap;
-    uint32_t total_records_merged = 0;
-
-    for (size_t i = 0; i < source_files_to_process.size(); ++i) {
-        const auto& source_filepath = source_files_to_process[i];
-        auto ifs = std::make_unique<std::ifstream>(source_filepath, std::ios::binary);
-        if (!ifs->is_open()) {
-            std::lock_guard<std::mutex> lock(console_mutex);
-            std::cerr << "  Failed to open source file: " << source_filepath << std::endl;
-            continue;
-        }
-
-        Header current_header;
-        ifs->read(reinterpret_cast<char*>(&current_header), sizeof(Header));
-        if (static_cast<size_t>(ifs->gcount()) < sizeof(Header)) {
+    // The merged file only depends on the venue files the cursor opened
+    std::vector<fs::path> source_files = cursor.source_files();
+    fs::path provenance_path = provenance_path_for(merged_filepath);
+    if (!force_rebuild) {
+        std::optional<Provenance> current = make_provenance("merged_book_generation", MERGED_BOOK_GENERATION_VERSION,
+                                                            file_type_suffix, source_files, {merged_filepath});
+        if (current && provenance_is_current(provenance_path, *current)) {
             std::lock_guard<std::mutex> lock(console_mutex);
-            std::cerr << "  Failed to read header from: " << source_filepath << std::endl;
-            continue;
-        }
-
-        if (!first_valid_header_data_opt) {
-            first_valid_header_data_opt = current_header;
+            std::cout << "  Up to date, skipping: " << merged_filepath << std::endl;
+            return merged_filepath;
         }
-        file_streams.push_back(std::move(ifs));
-        size_t current_file_idx = file_streams.size() - 1;
-
-        auto next_item_opt = read_next_record_with_timestamp_raw(*file_streams.back(), record_size);
-        if (next_item_opt) {
-            min_heap.push({next_item_opt->first, next_item_opt->second, current_file_idx, current_header.feed_id});
-        }
-    }
-    
-    if (min_heap.empty() || !first_valid_header_data_opt) {
-        return std::nullopt;
     }
+    remove_provenance(provenance_path);
 
     std::ofstream merged_file_handle(merged_filepath, std::ios::binary | std::ios::trunc);
     if (!merged_file_handle.is_open()) {
@@ -263,35 +138,28 @@ std::optional<fs::path> merge_files_for_symbol_by_timestamp(
     std::vector<char> null_header(HEADER_SIZE, 0);
     merged_file_handle.write(null_header.data(), HEADER_SIZE);
 
-    while (!min_heap.empty()) {
-        HeapItem current_item = min_heap.top();
-        min_heap.pop();
-
-        merged_file_handle.write(reinterpret_cast<const char*>(&current_item.feed_id), sizeof(uint64_t));
-        merged_file_handle.write(current_item.record_data.data(), current_item.record_data.size());
+    uint32_t total_records_merged = 0;
+    MergedRecordView record;
+    while (cursor.next(record)) {
+        merged_file_handle.write(reinterpret_cast<const char*>(&record.feed_id), sizeof(uint64_t));
+        merged_file_handle.write(record.record_data, record.record_size);
         total_records_merged++;
-
-        auto next_item_opt = read_next_record_with_timestamp_raw(*file_streams[current_item.file_index], record_size);
-        if (next_item_opt) {
-            min_heap.push({next_item_opt->first, next_item_opt->second, current_item.file_index, current_item.feed_id});
-        }
-    }
-
-    for(auto& stream_ptr : file_streams) {
-        if(stream_ptr && stream_ptr->is_open()) {
-            stream_ptr->close();
-        }
     }
-    file_streams.clear();
-
 
     if (total_records_merged > 0) {
-        Header final_header = first_valid_header_data_opt.value();
+        Header final_header = cursor.first_header().value();
         final_header.count = total_records_merged;
         
         merged_file_handle.seekp(0, std::ios::beg);
         merged_file_handle.write(reinterpret_cast<const char*>(&final_header), sizeof(Header));
         merged_file_handle.close();
+
+        std::optional<Provenance> provenance = make_provenance("merged_book_generation", MERGED_BOOK_GENERATION_VERSION,
+                                                               file_type_suffix, source_files, {merged_filepath});
+        if (!merged_file_handle.fail() && (!provenance || !write_provenance(provenance_path, *provenance))) {
+            std::lock_guard<std::mutex> lock(console_mutex);
+            std::cerr << "  Warning: Could not record provenance for " << merged_filepath << std::endl;
+        }
         {
             std::lock_guard<std::mutex> lock(console_mutex);
             std::cout << "  Successfully merged " << file_type_suffix << " for " << symbol 
@@ -406,6 +274,7 @@ std::vector<MergedFileInfo> process_symbol_task(
     const fs::path& base_date_path,
     const std::vector<std::string>& venue_folders,
     const fs::path& merged_output_folder,
+    bool force_rebuild,
     std::mutex& console_mutex,
     size_t symbol_idx,
     size_t total_symbols) {
@@ -416,12 +285,12 @@ std::vector<MergedFileInfo> process_symbol_task(
     }
     
     std::vector<MergedFileInfo> results;
-    auto merged_fills_path_opt = merge_files_for_symbol_by_timestamp(base_date_path, venue_folders, symbol, "book_fills", merged_output_folder, console_mutex);
+    auto merged_fills_path_opt = merge_files_for_symbol_by_timestamp(base_date_path, venue_folders, symbol, "book_fills", merged_output_folder, force_rebuild, console_mutex);
     if (merged_fills_path_opt) {
         results.push_back({merged_fills_path_opt.value(), "fills"});
     }
 
-    auto merged_tops_path_opt = merge_files_for_symbol_by_timestamp(base_date_path, venue_folders, symbol, "book_tops", merged_output_folder, console_mutex);
+    auto merged_tops_path_opt = merge_files_for_symbol_by_timestamp(base_date_path, venue_folders, symbol, "book_tops", merged_output_folder, force_rebuild, console_mutex);
     if (merged_tops_path_opt) {
         results.push_back({merged_tops_path_opt.value(), "tops"});
     }
@@ -470,8 +339,15 @@ bool run_test_task(
 }
 
 
-int main() {
+int main(int argc, char* argv[]) {
     std::mutex console_mutex;
+    // Merged files whose .prov record still matches their venue inputs are kept unless --force is given
+    bool force_rebuild = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--force") {
+            force_rebuild = true;
+        }
+    }
 
     std::string date_str = get_user_input_date(console_mutex);
     fs::path base_date_path = fs::path("/home/vir") / date_str;
@@ -535,7 +411,7 @@ int main() {
         symbol_futures.push_back(
             std::async(std::launch::async, process_symbol_task,
                        symbol, base_date_path, std::ref(venue_folders), merged_output_folder,
-                       std::ref(console_mutex), i, all_symbols.size())
+                       force_rebuild, std::ref(console_mutex), i, all_symbols.size())
         );
     }
 
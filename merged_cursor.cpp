@@ -0,0 +1,148 @@
+#include "merged_cursor.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace fs = std::filesystem;
+
+// Helper to convert string to lower case
+static std::string cursor_to_lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(),
+                   [](unsigned char c){ return std::tolower(c); });
+    return s;
+}
+
+// Helper to convert string to upper case
+static std::string cursor_to_upper(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(),
+                   [](unsigned char c){ return std::toupper(c); });
+    return s;
+}
+
+size_t record_size_for_book_type(const std::string& file_type_suffix) {
+    if (file_type_suffix == "book_fills") {
+        return FILLS_RECORD_SIZE;
+    } else if (file_type_suffix == "book_tops") {
+        return TOPS_RECORD_SIZE;
+    }
+    return 0;
+}
+
+fs::path venue_book_file_path(
+    const fs::path& base_date_path,
+    const std::string& venue,
+    const std::string& file_type_suffix,
+    const std::string& symbol) {
+    return base_date_path / venue / "books" / (cursor_to_upper(venue) + "." + file_type_suffix + "." + symbol + ".bin");
+}
+
+bool VenueFilter::accepts(const std::string& venue) const {
+    std::string venue_lower = cursor_to_lower(venue);
+    for (const auto& excluded : exclude) {
+        if (cursor_to_lower(excluded) == venue_lower) return false;
+    }
+    if (include.empty()) return true;
+    for (const auto& included : include) {
+        if (cursor_to_lower(included) == venue_lower) return true;
+    }
+    return false;
+}
+
+MergedCursor::MergedCursor(const fs::path& base_date_path,
+                           const std::vector<std::string>& venue_folders,
+                           const std::string& symbol,
+                           const std::string& file_type_suffix,
+                           const VenueFilter& venue_filter) {
+    record_size_ = record_size_for_book_type(file_type_suffix);
+    if (record_size_ == 0) {
+        warnings_.push_back("Unknown file_type_suffix for merging: " + file_type_suffix);
+        return;
+    }
+    current_record_.resize(record_size_);
+
+    for (const auto& venue : venue_folders) {
+        if (!venue_filter.accepts(venue)) continue;
+
+        fs::path source_filepath = venue_book_file_path(base_date_path, venue, file_type_suffix, symbol);
+        std::error_code ec;
+        if (!fs::is_regular_file(source_filepath, ec)) continue;
+
+        uintmax_t file_size = fs::file_size(source_filepath, ec);
+        if (ec) {
+            warnings_.push_back("Error checking file size for " + source_filepath.string() + ": " + ec.message());
+            continue;
+        }
+        if (file_size < HEADER_SIZE) {
+            warnings_.push_back("Skipping small file (less than header size): " + source_filepath.string());
+            continue;
+        }
+
+        auto source = std::make_unique<Source>();
+        source->stream.open(source_filepath, std::ios::binary);
+        if (!source->stream.is_open()) {
+            warnings_.push_back("Failed to open source file: " + source_filepath.string());
+            continue;
+        }
+
+        Header current_header;
+        source->stream.read(reinterpret_cast<char*>(&current_header), sizeof(Header));
+        if (static_cast<size_t>(source->stream.gcount()) < sizeof(Header)) {
+            warnings_.push_back("Failed to read header from: " + source_filepath.string());
+            continue;
+        }
+
+        if (!first_header_) {
+            first_header_ = current_header;
+        }
+        total_record_count_ += current_header.count;
+        source->feed_id = current_header.feed_id;
+        source->buffer.resize(RECORDS_PER_BLOCK * record_size_);
+
+        sources_.push_back(std::move(source));
+        source_files_.push_back(source_filepath);
+
+        size_t source_index = sources_.size() - 1;
+        if (refill(*sources_[source_index])) {
+            push_current(source_index);
+        }
+    }
+}
+
+bool MergedCursor::refill(Source& source) {
+    source.stream.read(source.buffer.data(), source.buffer.size());
+    size_t bytes_read = static_cast<size_t>(source.stream.gcount());
+    source.position = 0;
+    // A trailing partial record is dropped, as the per-record reader did before
+    source.available = bytes_read - (bytes_read % record_size_);
+    return source.available > 0;
+}
+
+void MergedCursor::push_current(size_t source_index) {
+    const Source& source = *sources_[source_index];
+    uint64_t timestamp;
+    std::memcpy(&timestamp, source.buffer.data() + source.position, sizeof(uint64_t));
+    heap_.push({timestamp, source.feed_id, source_index});
+}
+
+bool MergedCursor::next(MergedRecordView& out) {
+    if (heap_.empty()) {
+        return false;
+    }
+
+    HeapItem top = heap_.top();
+    heap_.pop();
+
+    Source& source = *sources_[top.source_index];
+    std::memcpy(current_record_.data(), source.buffer.data() + source.position, record_size_);
+
+    source.position += record_size_;
+    if (source.position < source.available || refill(source)) {
+        push_current(top.source_index);
+    }
+
+    out.feed_id = top.feed_id;
+    out.timestamp = top.timestamp;
+    out.record_data = current_record_.data();
+    out.record_size = record_size_;
+    return true;
+}
@@ -0,0 +1,162 @@
+#ifndef MERGED_CURSOR_HPP
+#define MERGED_CURSOR_HPP
+
+#include <string>
+#include <vector>
+#include <set>
+#include <queue>
+#include <memory>
+#include <fstream>
+#include <optional>
+#include <filesystem>
+#include <functional>
+#include <cstdint>
+
+// --- Constants ---
+const size_t HEADER_SIZE = 24;
+
+#pragma pack(push, 1)
+
+struct Header {
+    uint64_t feed_id;
+    uint32_t dateint;
+    uint32_t count;
+    uint64_t symbol_idx;
+};
+static_assert(sizeof(Header) == HEADER_SIZE, "Header size mismatch");
+
+struct FillsRecord {
+    uint64_t ts;
+    uint64_t seq_no;
+    uint64_t resting_order_id;
+    bool was_hidden;
+    int64_t trade_price;
+    uint32_t trade_qty;
+    uint64_t execution_id;
+    uint32_t resting_original_qty;
+    uint32_t resting_order_remaining_qty;
+    uint64_t resting_order_last_update_ts;
+    bool resting_side_is_bid;
+    int64_t resting_side_price;
+    uint32_t resting_side_qty;
+    int64_t opposing_side_price;
+    uint32_t opposing_side_qty;
+    uint32_t resting_side_number_of_orders;
+};
+const size_t FILLS_RECORD_SIZE = sizeof(FillsRecord);
+static_assert(sizeof(FillsRecord) == 90, "FillsRecord size mismatch");
+
+struct top_level
+{
+    int64_t bid_nanos;
+    int64_t ask_nanos;
+    uint32_t bid_qty;
+    uint32_t ask_qty;
+};
+static_assert(sizeof(top_level) == 24, "top_level size mismatch");
+
+struct TopsRecord {
+    uint64_t ts;
+    uint64_t seqno;
+    top_level first_level;
+    top_level second_level;
+    top_level third_level;
+};
+const size_t TOPS_RECORD_SIZE = sizeof(TopsRecord);
+static_assert(sizeof(TopsRecord) == 88, "TopsRecord size mismatch");
+
+#pragma pack(pop)
+
+// Record size for a per-venue book file type ("book_fills" or "book_tops"), 0 if unknown
+size_t record_size_for_book_type(const std::string& file_type_suffix);
+
+// <base>/<venue>/books/<VENUE>.<file_type_suffix>.<symbol>.bin
+std::filesystem::path venue_book_file_path(
+    const std::filesystem::path& base_date_path,
+    const std::string& venue,
+    const std::string& file_type_suffix,
+    const std::string& symbol);
+
+// Venue subset for a merged view. Names are compared case-insensitively;
+// an empty include set means every venue that is not excluded.
+struct VenueFilter {
+    std::set<std::string> include;
+    std::set<std::string> exclude;
+
+    bool accepts(const std::string& venue) const;
+};
+
+// One entry of the merged stream, i.e. what merged_<type>.SYM.bin stores per record.
+// record_data points into the cursor and stays valid until the next call to next().
+struct MergedRecordView {
+    uint64_t feed_id;
+    uint64_t timestamp;
+    const char* record_data;
+    size_t record_size;
+};
+
+// Walks the per-venue book_tops/book_fills files of one symbol in (ts, feed_id) order
+// without materializing merged_tops/merged_fills. Uses the same min-heap merge as
+// merged_book_generation, which is now built on top of this cursor.
+class MergedCursor {
+public:
+    MergedCursor(const std::filesystem::path& base_date_path,
+                 const std::vector<std::string>& venue_folders,
+                 const std::string& symbol,
+                 const std::string& file_type_suffix,
+                 const VenueFilter& venue_filter = VenueFilter());
+
+    MergedCursor(const MergedCursor&) = delete;
+    MergedCursor& operator=(const MergedCursor&) = delete;
+
+    // Advances to the next record in (ts, feed_id) order. Returns false once every source is exhausted.
+    bool next(MergedRecordView& out);
+
+    bool empty() const { return heap_.empty(); }
+    size_t record_size() const { return record_size_; }
+
+    // Header of the first source that opened, used as the template for a merged file header
+    const std::optional<Header>& first_header() const { return first_header_; }
+    // Sum of the record counts in the opened sources' headers
+    uint64_t total_record_count() const { return total_record_count_; }
+    const std::vector<std::filesystem::path>& source_files() const { return source_files_; }
+    // Non-fatal problems met while opening sources (missing header, unreadable file, ...)
+    const std::vector<std::string>& warnings() const { return warnings_; }
+
+private:
+    static const size_t RECORDS_PER_BLOCK = 4096;
+
+    struct Source {
+        std::ifstream stream;
+        uint64_t feed_id = 0;
+        std::vector<char> buffer;
+        size_t position = 0;
+        size_t available = 0;
+    };
+
+    struct HeapItem {
+        uint64_t timestamp;
+        uint64_t feed_id;
+        size_t source_index;
+
+        bool operator>(const HeapItem& other) const {
+            if (timestamp != other.timestamp) return timestamp > other.timestamp;
+            if (feed_id != other.feed_id) return feed_id > other.feed_id;
+            return source_index > other.source_index;
+        }
+    };
+
+    bool refill(Source& source);
+    void push_current(size_t source_index);
+
+    size_t record_size_ = 0;
+    std::vector<std::unique_ptr<Source>> sources_;
+    std::priority_queue<HeapItem, std::vector<HeapItem>, std::greater<HeapItem>> heap_;
+    std::vector<char> current_record_;
+    std::optional<Header> first_header_;
+    uint64_t total_record_count_ = 0;
+    std::vector<std::filesystem::path> source_files_;
+    std::vector<std::string> warnings_;
+};
+
+#endif
@@ -6,6 +6,17 @@
 #include <cstdint>
 #include <algorithm>
 #include <limits>
+#include <cstring>
+#include <cstddef>
+#include <cmath>
+#include <sstream>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bar_container.hpp"
 
 // Define the header format (little-endian)
 #pragma pack(push, 1)
@@ -45,19 +56,71 @@ struct BarRecord {
     double close;
     int32_t volume;
 };
+
+// Companion of BarRecord, one per bar and in the same order. Buy volume is traded against
+// resting asks (buyer-initiated), sell volume against resting bids.
+struct VwapBarRecord {
+    uint64_t timestamp_sec;
+    double vwap;
+    uint32_t trade_count;
+    uint64_t volume;
+    uint64_t buy_volume;
+    uint64_t sell_volume;
+};
+
+// Liquidity statistics of the fills of one bar, again one per BarRecord. Age is the time since
+// the resting order's last update; fill fraction is trade_qty / resting_original_qty. Quantiles
+// are nearest-rank over the fills of the bar, not volume weighted.
+struct LiquidityBarRecord {
+    uint64_t timestamp_sec;
+    uint64_t hidden_volume;
+    double hidden_share;           // hidden_volume / volume
+    uint32_t hidden_trade_count;
+    uint32_t completed_order_count; // fills that left the resting order with nothing remaining
+    double age_mean_ns;
+    uint64_t age_p50_ns;
+    uint64_t age_p90_ns;
+    uint64_t age_max_ns;
+    double fill_fraction_mean;
+    double fill_fraction_p50;
+    double fill_fraction_p90;
+};
+
+// A bar closed by activity rather than the clock: after a number of trades, a traded volume or a
+// traded notional. The trade that reaches the threshold belongs to the bar it closes.
+struct EventBarRecord {
+    uint64_t start_ts;  // ns of the first and last trade of the bar
+    uint64_t end_ts;
+    double open;
+    double high;
+    double low;
+    double close;
+    double vwap;
+    double notional;
+    uint64_t volume;
+    uint64_t buy_volume;
+    uint64_t sell_volume;
+    uint32_t trade_count;
+};
 #pragma pack(pop)
 
 const size_t HEADER_SIZE = sizeof(FileHeader);
 const size_t DATA_SIZE = sizeof(DataRecord);
-const size_t BAR_SIZE = sizeof(BarRecord);
+static_assert(sizeof(DataRecord) == 90, "DataRecord size mismatch");
+static_assert(sizeof(VwapBarRecord) == 44, "VwapBarRecord size mismatch");
+static_assert(sizeof(LiquidityBarRecord) == 88, "LiquidityBarRecord size mismatch");
+static_assert(sizeof(EventBarRecord) == 92, "EventBarRecord size mismatch");
 
-// Function to read the file header
-uint32_t read_header(std::ifstream& file, FileHeader& header) {
-    file.read(reinterpret_cast<char*>(&header), HEADER_SIZE);
-    if (file.gcount() < HEADER_SIZE) {
+const uint64_t NANOS_PER_SECOND = 1000000000ULL;
+const size_t BAR_WRITE_BLOCK = 4096;
+
+// Function to read the file header from the start of the mapped input
+uint32_t read_header(const char* data, size_t size, FileHeader& header) {
+    if (size < HEADER_SIZE) {
         std::cerr << "Error: File is too small to contain a valid header or read error." << std::endl;
         return 0;
     }
+    std::memcpy(&header, data, HEADER_SIZE);
 
     std::cout << "Header Information:" << std::endl;
     std::cout << "  Feed ID: " << header.feed_id << std::endl;
@@ -68,82 +131,271 @@ uint32_t read_header(std::ifstream& file, FileHeader& header) {
     return header.number_of_fills;
 }
 
-// Function to write a bar to the binary file
-void write_bar(std::ofstream& outFile, 
-               std::chrono::system_clock::time_point bar_time_utc, 
-               double high_price, double low_price, double open_price, double close_price, 
-               int32_t total_volume) {
-    if (!outFile.is_open() || !outFile.good()) {
-        std::cerr << "Error: Output file stream is not valid for writing bar." << std::endl;
+// One second of fills, accumulated for all bar files
+struct FillsBarState {
+    uint64_t timestamp_sec = 0;
+    double open = 0.0;
+    double high = 0.0;
+    double low = 0.0;
+    double close = 0.0;
+    double notional = 0.0;
+    uint64_t volume = 0;
+    uint64_t buy_volume = 0;
+    uint64_t sell_volume = 0;
+    uint32_t trade_count = 0;
+    uint64_t hidden_volume = 0;
+    uint32_t hidden_trade_count = 0;
+    uint32_t completed_order_count = 0;
+    // Per-fill samples for the quantiles; kept across bars to reuse their storage
+    std::vector<uint64_t> ages_ns;
+    std::vector<double> fill_fractions;
+
+    void start(uint64_t bar_sec, double trade_price) {
+        timestamp_sec = bar_sec;
+        open = high = low = close = trade_price;
+        notional = 0.0;
+        volume = buy_volume = sell_volume = hidden_volume = 0;
+        trade_count = hidden_trade_count = completed_order_count = 0;
+        ages_ns.clear();
+        fill_fractions.clear();
+    }
+};
+
+// Bars waiting to be written, one vector per series
+struct FillsBarBuffers {
+    std::vector<BarRecord> bars;
+    std::vector<VwapBarRecord> vwap_bars;
+    std::vector<LiquidityBarRecord> liquidity_bars;
+};
+
+// Nearest-rank quantile; reorders values
+template<typename T>
+T nearest_rank_quantile(std::vector<T>& values, double q) {
+    size_t rank = static_cast<size_t>(std::ceil(q * static_cast<double>(values.size())));
+    size_t index = std::min(values.size() - 1, rank == 0 ? 0 : rank - 1);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+LiquidityBarRecord liquidity_bar(FillsBarState& state) {
+    LiquidityBarRecord bar = {};
+    bar.timestamp_sec = state.timestamp_sec;
+    bar.hidden_volume = state.hidden_volume;
+    bar.hidden_share = static_cast<double>(state.hidden_volume) / static_cast<double>(state.volume);
+    bar.hidden_trade_count = state.hidden_trade_count;
+    bar.completed_order_count = state.completed_order_count;
+    if (!state.ages_ns.empty()) {
+        double age_sum = 0.0;
+        for (uint64_t age : state.ages_ns) {
+            age_sum += static_cast<double>(age);
+        }
+        bar.age_mean_ns = age_sum / static_cast<double>(state.ages_ns.size());
+        bar.age_p50_ns = nearest_rank_quantile(state.ages_ns, 0.5);
+        bar.age_p90_ns = nearest_rank_quantile(state.ages_ns, 0.9);
+        bar.age_max_ns = *std::max_element(state.ages_ns.begin(), state.ages_ns.end());
+    }
+    if (state.fill_fractions.empty()) {
+        bar.fill_fraction_mean = bar.fill_fraction_p50 = bar.fill_fraction_p90 = std::numeric_limits<double>::quiet_NaN();
+    } else {
+        double fraction_sum = 0.0;
+        for (double fraction : state.fill_fractions) {
+            fraction_sum += fraction;
+        }
+        bar.fill_fraction_mean = fraction_sum / static_cast<double>(state.fill_fractions.size());
+        bar.fill_fraction_p50 = nearest_rank_quantile(state.fill_fractions, 0.5);
+        bar.fill_fraction_p90 = nearest_rank_quantile(state.fill_fractions, 0.9);
+    }
+    return bar;
+}
+
+// Appends the bar of state to every buffer; bars without volume are skipped as before
+void append_bar(FillsBarState& state, FillsBarBuffers& buffers) {
+    if (state.volume == 0) {
         return;
     }
     BarRecord bar;
-    bar.timestamp_sec = std::chrono::duration_cast<std::chrono::seconds>(bar_time_utc.time_since_epoch()).count();
-    bar.high = high_price;
-    bar.low = low_price;
-    bar.open = open_price;
-    bar.close = close_price;
-    bar.volume = total_volume;
-    outFile.write(reinterpret_cast<const char*>(&bar), BAR_SIZE);
+    bar.timestamp_sec = state.timestamp_sec;
+    bar.high = state.high;
+    bar.low = state.low;
+    bar.open = state.open;
+    bar.close = state.close;
+    bar.volume = static_cast<int32_t>(state.volume);
+    buffers.bars.push_back(bar);
+
+    VwapBarRecord vwap_bar;
+    vwap_bar.timestamp_sec = state.timestamp_sec;
+    vwap_bar.vwap = state.notional / static_cast<double>(state.volume);
+    vwap_bar.trade_count = state.trade_count;
+    vwap_bar.volume = state.volume;
+    vwap_bar.buy_volume = state.buy_volume;
+    vwap_bar.sell_volume = state.sell_volume;
+    buffers.vwap_bars.push_back(vwap_bar);
+
+    buffers.liquidity_bars.push_back(liquidity_bar(state));
+}
+
+template<typename Record>
+void flush_bars(std::ofstream& outFile, std::vector<Record>& bars) {
+    outFile.write(reinterpret_cast<const char*>(bars.data()), static_cast<std::streamsize>(bars.size() * sizeof(Record)));
+    bars.clear();
 }
 
-// Function to read data records and generate bars
-void read_data_and_generate_bars(std::ifstream& inputFile, uint32_t number_of_fills, std::ofstream& outputFile) {
+enum class EventBarKind {
+    Tick,    // every N trades
+    Volume,  // every N shares
+    Dollar   // every N of notional
+};
+
+// Builds the event bars of one kind and threshold and writes them to their own file. The trailing
+// bar that never reaches the threshold is not written, so every bar carries the same activity.
+class EventBarBuilder {
+public:
+    EventBarBuilder(EventBarKind kind, uint64_t threshold, std::string path)
+        : kind_(kind), threshold_(static_cast<double>(threshold)), path_(std::move(path)) {}
+
+    bool open() {
+        file_.open(path_, std::ios::binary | std::ios::trunc);
+        pending_.reserve(BAR_WRITE_BLOCK);
+        return file_.is_open();
+    }
+
+    void add(uint64_t ts, double trade_price, uint32_t trade_qty, bool sell_initiated) {
+        if (bar_.trade_count == 0) {
+            bar_ = EventBarRecord();
+            bar_.start_ts = ts;
+            bar_.open = bar_.high = bar_.low = trade_price;
+        } else {
+            bar_.high = std::max(bar_.high, trade_price);
+            bar_.low = std::min(bar_.low, trade_price);
+        }
+        bar_.end_ts = ts;
+        bar_.close = trade_price;
+        bar_.notional += trade_price * trade_qty;
+        bar_.volume += trade_qty;
+        (sell_initiated ? bar_.sell_volume : bar_.buy_volume) += trade_qty;
+        bar_.trade_count++;
+
+        double progress = kind_ == EventBarKind::Tick ? static_cast<double>(bar_.trade_count)
+                        : kind_ == EventBarKind::Volume ? static_cast<double>(bar_.volume)
+                        : bar_.notional;
+        if (progress >= threshold_) {
+            bar_.vwap = bar_.volume > 0 ? bar_.notional / static_cast<double>(bar_.volume)
+                                        : std::numeric_limits<double>::quiet_NaN();
+            pending_.push_back(bar_);
+            bar_.trade_count = 0;
+            if (pending_.size() >= BAR_WRITE_BLOCK) {
+                flush_bars(file_, pending_);
+            }
+        }
+    }
+
+    // Writes the remaining complete bars; returns false on a write error
+    bool finish() {
+        flush_bars(file_, pending_);
+        bool ok = file_.good();
+        file_.close();
+        return ok;
+    }
+
+    const std::string& path() const { return path_; }
+
+private:
+    EventBarKind kind_;
+    double threshold_;
+    std::string path_;
+    std::ofstream file_;
+    std::vector<EventBarRecord> pending_;
+    EventBarRecord bar_ = {};
+};
+
+// Function to build one-second bars over the mapped data records, and the requested event bars in
+// the same pass. Buckets are taken on the raw nanosecond timestamps; bars are buffered and written
+// BAR_WRITE_BLOCK at a time.
+// The time bars are collected in container_bars for the bar container; the per-series files are only
+// written when outputFile is open, and then vwapOutputFile and liquidityOutputFile are too
+void read_data_and_generate_bars(const char* records, uint32_t number_of_fills, std::ofstream& outputFile,
+                                 std::ofstream& vwapOutputFile, std::ofstream& liquidityOutputFile,
+                                 std::vector<EventBarBuilder>& event_builders, FillsBarBuffers& container_bars) {
     std::cout << "\nProcessing Book Fill Snapshots..." << std::endl;
-    
-    DataRecord data_record;
 
-    std::chrono::system_clock::time_point current_bar_tp_utc{};
-    double bar_open_price = 0.0;
-    double bar_high_price = -std::numeric_limits<double>::infinity();
-    double bar_low_price = std::numeric_limits<double>::infinity();
-    double bar_close_price = 0.0;
-    int32_t bar_total_volume = 0;
+    FillsBarBuffers buffers;
+    buffers.bars.reserve(BAR_WRITE_BLOCK);
+    buffers.vwap_bars.reserve(BAR_WRITE_BLOCK);
+    buffers.liquidity_bars.reserve(BAR_WRITE_BLOCK);
+    auto flush_all = [&]() {
+        container_bars.bars.insert(container_bars.bars.end(), buffers.bars.begin(), buffers.bars.end());
+        container_bars.vwap_bars.insert(container_bars.vwap_bars.end(), buffers.vwap_bars.begin(), buffers.vwap_bars.end());
+        container_bars.liquidity_bars.insert(container_bars.liquidity_bars.end(), buffers.liquidity_bars.begin(),
+                                             buffers.liquidity_bars.end());
+        if (outputFile.is_open()) {
+            flush_bars(outputFile, buffers.bars);
+            flush_bars(vwapOutputFile, buffers.vwap_bars);
+            flush_bars(liquidityOutputFile, buffers.liquidity_bars);
+        } else {
+            buffers.bars.clear();
+            buffers.vwap_bars.clear();
+            buffers.liquidity_bars.clear();
+        }
+    };
+
+    FillsBarState state;
+    bool has_bar = false;
+    DataRecord data_record;
 
     for (uint32_t i = 0; i < number_of_fills; ++i) {
-        inputFile.read(reinterpret_cast<char*>(&data_record), DATA_SIZE);
-        if (inputFile.gcount() < DATA_SIZE) {
-            std::cerr << "Warning: Reached end of file earlier than expected or read error at record " << i << "." << std::endl;
-            break;
-        }
-        
-        uint64_t raw_timestamp_ns = data_record.ts;
-        double current_trade_price = static_cast<double>(data_record.trade_price) / 1e9;
-        uint32_t current_trade_qty = data_record.trade_qty;
-
-        auto trade_tp_utc = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(raw_timestamp_ns)));
-        auto this_bar_tp_utc = std::chrono::floor<std::chrono::seconds>(trade_tp_utc);
-
-        if (current_bar_tp_utc.time_since_epoch().count() != 0 && this_bar_tp_utc != current_bar_tp_utc) {
-            if (bar_total_volume > 0) {
-                 write_bar(outputFile, current_bar_tp_utc, bar_high_price, bar_low_price, bar_open_price, bar_close_price, bar_total_volume);
+        std::memcpy(&data_record, records + static_cast<size_t>(i) * DATA_SIZE, DATA_SIZE);
+
+        uint64_t bar_sec = data_record.ts / NANOS_PER_SECOND;
+        double trade_price = static_cast<double>(data_record.trade_price) / 1e9;
+        uint32_t trade_qty = data_record.trade_qty;
+
+        if (!has_bar || bar_sec != state.timestamp_sec) {
+            if (has_bar) {
+                append_bar(state, buffers);
+                if (buffers.bars.size() >= BAR_WRITE_BLOCK) {
+                    flush_all();
+                }
             }
-            current_bar_tp_utc = this_bar_tp_utc;
-            bar_open_price = current_trade_price;
-            bar_high_price = current_trade_price;
-            bar_low_price = current_trade_price;
-            bar_close_price = current_trade_price;
-            bar_total_volume = current_trade_qty;
-        
-        } else if (current_bar_tp_utc.time_since_epoch().count() == 0) {
-            current_bar_tp_utc = this_bar_tp_utc;
-            bar_open_price = current_trade_price;
-            bar_high_price = current_trade_price;
-            bar_low_price = current_trade_price;
-            bar_close_price = current_trade_price;
-            bar_total_volume = current_trade_qty;
+            has_bar = true;
+            state.start(bar_sec, trade_price);
+        } else {
+            state.high = std::max(state.high, trade_price);
+            state.low = std::min(state.low, trade_price);
+        }
+        state.close = trade_price;
+        state.notional += trade_price * trade_qty;
+        state.volume += trade_qty;
+        state.trade_count++;
+        // The aggressor took the other side of the resting order: a resting bid was hit by a seller
+        if (data_record.resting_side_is_bid) {
+            state.sell_volume += trade_qty;
         } else {
-            bar_high_price = std::max(bar_high_price, current_trade_price);
-            bar_low_price = std::min(bar_low_price, current_trade_price);
-            bar_close_price = current_trade_price;
-            bar_total_volume += current_trade_qty;
+            state.buy_volume += trade_qty;
+        }
+        for (auto& builder : event_builders) {
+            builder.add(data_record.ts, trade_price, trade_qty, data_record.resting_side_is_bid);
+        }
+
+        if (data_record.was_hidden) {
+            state.hidden_volume += trade_qty;
+            state.hidden_trade_count++;
+        }
+        if (data_record.resting_order_remaining_qty == 0) {
+            state.completed_order_count++;
+        }
+        // A last update after the fill would be a feed clock problem; it counts as age 0
+        uint64_t last_update_ts = data_record.resting_order_last_update_ts;
+        state.ages_ns.push_back(data_record.ts > last_update_ts ? data_record.ts - last_update_ts : 0);
+        if (data_record.resting_original_qty > 0) {
+            state.fill_fractions.push_back(static_cast<double>(trade_qty) / data_record.resting_original_qty);
         }
     }
 
-    if (current_bar_tp_utc.time_since_epoch().count() != 0 && bar_total_volume > 0) {
-        write_bar(outputFile, current_bar_tp_utc, bar_high_price, bar_low_price, bar_open_price, bar_close_price, bar_total_volume);
+    if (has_bar) {
+        append_bar(state, buffers);
     }
-    if (!outputFile.good()) {
+    flush_all();
+    if (!outputFile.good() || !vwapOutputFile.good() || !liquidityOutputFile.good()) {
          std::cerr << "Error occurred during writing output file." << std::endl;
     }
 }
@@ -163,10 +415,116 @@ std::string to_upper(std::string s) {
     return s;
 }
 
+// Parses a comma-separated list of positive thresholds for one of the event bar flags
+bool parse_thresholds(const std::string& arg, const std::string& flag, std::vector<uint64_t>& thresholds) {
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        uint64_t value = 0;
+        try {
+            size_t used = 0;
+            value = std::stoull(item, &used);
+            if (used != item.size()) value = 0;
+        } catch (const std::exception&) {
+            value = 0;
+        }
+        if (value == 0) {
+            std::cerr << "Error: " << flag << " needs positive integer thresholds, got '" << item << "'." << std::endl;
+            return false;
+        }
+        thresholds.push_back(value);
+    }
+    if (thresholds.empty()) {
+        std::cerr << "Error: " << flag << " needs at least one threshold." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// The time bars as series "fills" of the bar container
+BarSeries fills_bar_series(const std::vector<BarRecord>& bars) {
+    BarSeries series;
+    series.name = "fills";
+    series.fields = {"open", "high", "low", "close", "volume"};
+    series.columns.resize(series.fields.size());
+    for (const BarRecord& bar : bars) {
+        series.timestamps.push_back(bar.timestamp_sec);
+        series.columns[0].push_back(bar.open);
+        series.columns[1].push_back(bar.high);
+        series.columns[2].push_back(bar.low);
+        series.columns[3].push_back(bar.close);
+        series.columns[4].push_back(static_cast<double>(bar.volume));
+    }
+    return series;
+}
+
+// The VWAP and signed volume bars as series "vwap"
+BarSeries vwap_bar_series(const std::vector<VwapBarRecord>& bars) {
+    BarSeries series;
+    series.name = "vwap";
+    series.fields = {"vwap", "trade_count", "volume", "buy_volume", "sell_volume"};
+    series.columns.resize(series.fields.size());
+    for (const VwapBarRecord& bar : bars) {
+        series.timestamps.push_back(bar.timestamp_sec);
+        series.columns[0].push_back(bar.vwap);
+        series.columns[1].push_back(static_cast<double>(bar.trade_count));
+        series.columns[2].push_back(static_cast<double>(bar.volume));
+        series.columns[3].push_back(static_cast<double>(bar.buy_volume));
+        series.columns[4].push_back(static_cast<double>(bar.sell_volume));
+    }
+    return series;
+}
+
+// The liquidity bars as series "liquidity"; the fill fraction columns have no value in bars whose
+// resting orders all lack an original quantity, as in the record
+BarSeries liquidity_bar_series(const std::vector<LiquidityBarRecord>& bars) {
+    BarSeries series;
+    series.name = "liquidity";
+    series.fields = {"hidden_volume", "hidden_share", "hidden_trade_count", "completed_order_count", "age_mean_ns",
+                     "age_p50_ns", "age_p90_ns", "age_max_ns", "fill_fraction_mean", "fill_fraction_p50", "fill_fraction_p90"};
+    series.columns.resize(series.fields.size());
+    for (const LiquidityBarRecord& bar : bars) {
+        series.timestamps.push_back(bar.timestamp_sec);
+        size_t column = 0;
+        for (double value : {static_cast<double>(bar.hidden_volume), bar.hidden_share, static_cast<double>(bar.hidden_trade_count),
+                             static_cast<double>(bar.completed_order_count), bar.age_mean_ns, static_cast<double>(bar.age_p50_ns),
+                             static_cast<double>(bar.age_p90_ns), static_cast<double>(bar.age_max_ns), bar.fill_fraction_mean,
+                             bar.fill_fraction_p50, bar.fill_fraction_p90}) {
+            series.columns[column++].push_back(value);
+        }
+    }
+    return series;
+}
+
+// Index of the first fill at or after ts, found by binary search over the time-ordered fills
+uint32_t first_fill_at_or_after(const char* records, uint32_t number_of_fills, uint64_t ts) {
+    uint32_t low = 0, high = number_of_fills;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        uint64_t mid_ts;
+        std::memcpy(&mid_ts, records + static_cast<size_t>(mid) * DATA_SIZE + offsetof(DataRecord, ts), sizeof(mid_ts));
+        if (mid_ts < ts) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+void print_usage(const char* prog_name) {
+    std::cerr << "Usage: " << prog_name << " <date> <feed> <symbol>"
+              << " [--tick-bars <trades>[,...]] [--volume-bars <shares>[,...]] [--dollar-bars <notional>[,...]] [--legacy-files] [--append]" << std::endl;
+    std::cerr << "  The time bars go to the bar container <FEED>.bars.<SYMBOL>.bin as series fills, vwap and liquidity;" << std::endl;
+    std::cerr << "  --legacy-files also writes them to <FEED>.fills_bars/fills_vwap_bars/fills_liquidity_bars.<SYMBOL>.bin" << std::endl;
+    std::cerr << "  Event bars are written to their own files <FEED>.fills_<tick|volume|dollar><N>_bars.<SYMBOL>.bin" << std::endl;
+    std::cerr << "  --append resumes from the last stored time bar and only adds the bars of fills added since;" << std::endl;
+    std::cerr << "  it cannot be combined with event bars" << std::endl;
+}
 
 int main(int argc, char *argv[]) {
-    if (argc != 4) {
-        std::cerr << "Usage: " << argv[0] << " <date> <feed> <symbol>" << std::endl;
+    if (argc < 4) {
+        print_usage(argv[0]);
         return 1;
     }
 
@@ -174,6 +532,47 @@ int main(int argc, char *argv[]) {
     std::string feed = argv[2];
     std::string symbol = argv[3];
 
+    std::vector<std::pair<EventBarKind, uint64_t>> event_bars;
+    bool legacy_files = false;
+    bool append = false;
+    for (int i = 4; i < argc; ++i) {
+        std::string flag = argv[i];
+        EventBarKind kind;
+        if (flag == "--legacy-files") {
+            legacy_files = true;
+            continue;
+        } else if (flag == "--append") {
+            append = true;
+            continue;
+        } else if (flag == "--tick-bars") {
+            kind = EventBarKind::Tick;
+        } else if (flag == "--volume-bars") {
+            kind = EventBarKind::Volume;
+        } else if (flag == "--dollar-bars") {
+            kind = EventBarKind::Dollar;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        std::vector<uint64_t> thresholds;
+        if (!parse_thresholds(argv[++i], flag, thresholds)) {
+            return 1;
+        }
+        for (uint64_t threshold : thresholds) {
+            event_bars.emplace_back(kind, threshold);
+        }
+    }
+
+    // An event bar spans seconds and its open part is not stored, so there is nothing to resume it from
+    if (append && !event_bars.empty()) {
+        std::cerr << "Error: --append cannot be combined with event bars." << std::endl;
+        return 1;
+    }
+
     // Convert symbol to uppercase
     std::transform(symbol.begin(), symbol.end(), symbol.begin(), ::toupper);
 
@@ -181,35 +580,171 @@ int main(int argc, char *argv[]) {
     std::string base_path_input = "/home/vir/" + date + "/" + to_lower(feed) + "/books/" + to_upper(feed) + ".book_fills." + to_upper(symbol) + ".bin";
     std::string base_path_output = "/home/vir/" + date + "/" + to_lower(feed) + "/bars/" + to_upper(feed) + ".fills_bars." + to_upper(symbol) + ".bin";
     
-    std::ifstream input_file(base_path_input, std::ios::binary);
-    if (!input_file.is_open()) {
+    std::string vwap_path_output = "/home/vir/" + date + "/" + to_lower(feed) + "/bars/" + to_upper(feed) + ".fills_vwap_bars." + to_upper(symbol) + ".bin";
+    std::string liquidity_path_output = "/home/vir/" + date + "/" + to_lower(feed) + "/bars/" + to_upper(feed) + ".fills_liquidity_bars." + to_upper(symbol) + ".bin";
+    std::string container_path_output = bar_container_path("/home/vir/" + date + "/" + to_lower(feed) + "/bars/" + to_upper(feed) + ".", to_upper(symbol));
+
+    int input_fd = open(base_path_input.c_str(), O_RDONLY);
+    if (input_fd == -1) {
         std::cerr << "Error: Could not open input file: " << base_path_input << std::endl;
         return 1;
     }
-
-    std::ofstream output_file(base_path_output, std::ios::binary | std::ios::trunc);
-    if (!output_file.is_open()) {
-        std::cerr << "Error: Could not open output file for writing: " << base_path_output << std::endl;
-        input_file.close();
+    struct stat sb;
+    if (fstat(input_fd, &sb) == -1) {
+        std::cerr << "Error: Could not stat input file: " << base_path_input << std::endl;
+        close(input_fd);
         return 1;
     }
+    size_t input_size = static_cast<size_t>(sb.st_size);
+    const char* input_data = nullptr;
+    if (input_size > 0) {
+        void* mapped = mmap(nullptr, input_size, PROT_READ, MAP_PRIVATE, input_fd, 0);
+        if (mapped == MAP_FAILED) {
+            std::cerr << "Error: Could not map input file: " << base_path_input << std::endl;
+            close(input_fd);
+            return 1;
+        }
+        madvise(mapped, input_size, MADV_SEQUENTIAL);
+        input_data = static_cast<const char*>(mapped);
+    }
+
+    // In append mode, the last stored bar second may be incomplete: its bars are dropped from the container
+    // and every time bar file and rebuilt from the first fill of that second, and all later bars are appended
+    uint64_t resume_sec = 0;
+    if (append) {
+        std::vector<std::pair<std::string, size_t>> bar_files;
+        if (legacy_files) {
+            bar_files = {{base_path_output, sizeof(BarRecord)},
+                         {vwap_path_output, sizeof(VwapBarRecord)},
+                         {liquidity_path_output, sizeof(LiquidityBarRecord)}};
+        }
+        if (access(container_path_output.c_str(), F_OK) == 0) {
+            BarContainer container;
+            std::string error;
+            if (!container.open(container_path_output, error)) {
+                std::cerr << "Error: " << error << std::endl;
+                if (input_data) munmap(const_cast<char*>(input_data), input_size);
+                close(input_fd);
+                return 1;
+            }
+            const double* volumes = container.column("fills.volume");
+            for (uint64_t row = container.num_rows(); volumes && row > 0; --row) {
+                if (!std::isnan(volumes[row - 1])) {
+                    resume_sec = container.timestamps()[row - 1];
+                    break;
+                }
+            }
+        }
+        for (const auto& [path, record_size] : bar_files) {
+            uint64_t last_sec;
+            if (!last_bar_timestamp(path, record_size, last_sec)) {
+                std::cerr << "Error: Cannot resume from bar file: " << path << std::endl;
+                if (input_data) munmap(const_cast<char*>(input_data), input_size);
+                close(input_fd);
+                return 1;
+            }
+            resume_sec = std::max(resume_sec, last_sec);
+        }
+        for (const auto& [path, record_size] : bar_files) {
+            std::string error;
+            if (resume_sec != 0 && !drop_bars_from(path, record_size, resume_sec, error)) {
+                std::cerr << "Error: " << error << std::endl;
+                if (input_data) munmap(const_cast<char*>(input_data), input_size);
+                close(input_fd);
+                return 1;
+            }
+        }
+    }
+    std::ios::openmode output_mode = std::ios::binary | (resume_sec != 0 ? std::ios::app : std::ios::trunc);
+
+    std::ofstream output_file, vwap_output_file, liquidity_output_file;
+    if (legacy_files) {
+        output_file.open(base_path_output, output_mode);
+        vwap_output_file.open(vwap_path_output, output_mode);
+        liquidity_output_file.open(liquidity_path_output, output_mode);
+    }
+    for (const auto& [file, path] : {std::make_pair(&output_file, &base_path_output),
+                                     std::make_pair(&vwap_output_file, &vwap_path_output),
+                                     std::make_pair(&liquidity_output_file, &liquidity_path_output)}) {
+        if (legacy_files && !file->is_open()) {
+            std::cerr << "Error: Could not open output file for writing: " << *path << std::endl;
+            if (input_data) munmap(const_cast<char*>(input_data), input_size);
+            close(input_fd);
+            return 1;
+        }
+    }
     
-    std::cout << "\nSaving bars to " << base_path_output << " (Overwriting if exists)..." << std::endl;
+
+    std::vector<EventBarBuilder> event_builders;
+    for (const auto& [kind, threshold] : event_bars) {
+        const char* kind_name = kind == EventBarKind::Tick ? "tick" : kind == EventBarKind::Volume ? "volume" : "dollar";
+        event_builders.emplace_back(kind, threshold, "/home/vir/" + date + "/" + to_lower(feed) + "/bars/" + to_upper(feed) +
+                                    ".fills_" + kind_name + std::to_string(threshold) + "_bars." + to_upper(symbol) + ".bin");
+    }
+    for (auto& builder : event_builders) {
+        if (!builder.open()) {
+            std::cerr << "Error: Could not open output file for writing: " << builder.path() << std::endl;
+            if (input_data) munmap(const_cast<char*>(input_data), input_size);
+            close(input_fd);
+            return 1;
+        }
+    }
+    std::string bars_path_output = container_path_output;
+    if (legacy_files) {
+        bars_path_output += ", " + base_path_output + ", " + vwap_path_output + " and " + liquidity_path_output;
+    }
+    std::cout << "\nSaving bars to " << bars_path_output << " (Overwriting if exists)..." << std::endl;
 
     FileHeader header;
-    uint32_t number_of_fills = read_header(input_file, header);
+    uint32_t number_of_fills = read_header(input_data, input_size, header);
+    size_t records_in_file = input_size < HEADER_SIZE ? 0 : (input_size - HEADER_SIZE) / DATA_SIZE;
+    if (number_of_fills > records_in_file) {
+        std::cerr << "Warning: Reached end of file earlier than expected or read error at record " << records_in_file << "." << std::endl;
+        number_of_fills = static_cast<uint32_t>(records_in_file);
+    }
 
-    if (number_of_fills > 0 && input_file.good()) {
-        read_data_and_generate_bars(input_file, number_of_fills, output_file);
-        std::cout << "Bars saved to " << base_path_output << std::endl;
-    } else if (number_of_fills == 0) {
+    uint32_t first_fill = 0;
+    if (resume_sec != 0 && number_of_fills > 0) {
+        first_fill = first_fill_at_or_after(input_data + HEADER_SIZE, number_of_fills, resume_sec * NANOS_PER_SECOND);
+        std::cout << "Resuming from second " << resume_sec << " at fill " << first_fill << " of " << number_of_fills << std::endl;
+    }
+
+    FillsBarBuffers container_bars;
+    if (number_of_fills > first_fill) {
+        read_data_and_generate_bars(input_data + HEADER_SIZE + static_cast<size_t>(first_fill) * DATA_SIZE, number_of_fills - first_fill,
+                                    output_file, vwap_output_file, liquidity_output_file, event_builders, container_bars);
+        std::cout << "Bars saved to " << bars_path_output << std::endl;
+    } else if (first_fill > 0) {
+        std::cout << "No fills after the last stored bar." << std::endl;
+    } else if (input_size >= HEADER_SIZE) {
         std::cout << "No fills to process based on header." << std::endl;
     } else {
         std::cerr << "Could not process fills due to header read issue or 0 fills." << std::endl;
     }
 
-    input_file.close();
+    // Written even without fills, so the container does not keep the series of an earlier run
+    int exit_code = 0;
+    std::string container_error;
+    if (!write_bar_series(container_path_output, {fills_bar_series(container_bars.bars), vwap_bar_series(container_bars.vwap_bars),
+                                                  liquidity_bar_series(container_bars.liquidity_bars)},
+                          container_error, resume_sec)) {
+        std::cerr << "Error: " << container_error << std::endl;
+        exit_code = 1;
+    }
+
+    if (input_data) munmap(const_cast<char*>(input_data), input_size);
+    close(input_fd);
     output_file.close();
+    vwap_output_file.close();
+    liquidity_output_file.close();
+    for (auto& builder : event_builders) {
+        if (!builder.finish()) {
+            std::cerr << "Error occurred during writing output file: " << builder.path() << std::endl;
+            exit_code = 1;
+        } else {
+            std::cout << "Event bars saved to " << builder.path() << std::endl;
+        }
+    }
 
-    return 0;
-}
\ No newline at end of file
+    return exit_code;
+}
@@ -10,6 +10,10 @@
 #include <cstring>
 #include <algorithm>
 #include <thread>
+#include <unistd.h>
+
+#include "quote_bars.hpp"
+#include "bar_container.hpp"
 
 // Define the header format
 struct Header {
@@ -55,9 +59,12 @@ bool read_header(std::ifstream &file, Header &header) {
     return true;
 }
 
-// Function to read data
+QuoteLevels quote_levels_of(const BookTop &book_top);
+
+// Function to read data from the current position of file. Every top is also fed to quote_bars in the same pass.
 void read_data(std::ifstream &file, uint32_t number_of_tops, std::vector<uint64_t> &timestamps,
-    std::vector<std::vector<double>> &bid_prices, std::vector<std::vector<double>> &ask_prices) {
+    std::vector<std::vector<double>> &bid_prices, std::vector<std::vector<double>> &ask_prices,
+    QuoteBarBuilder &quote_bars) {
     bid_prices.resize(3);
     ask_prices.resize(3);
 
@@ -87,15 +94,19 @@ void read_data(std::ifstream &file, uint32_t number_of_tops, std::vector<uint64_
                 } else {
                     ask_prices[level].push_back(NAN);
                 }
+
             }
+            quote_bars.add(book_top.ts, quote_levels_of(book_top));
         }
 
         tops_read += read_count;
     }
 }
-// Function to create and store bars
+// Function to create and store bars. A non-zero last_timestamp is the last bar second already in
+// output_file: later bars are appended to it and earlier ones skipped. The bars are also returned in
+// stored_bars; with an empty output_file they are only returned.
 void create_and_store_bars(const std::vector<uint64_t> &timestamps, const std::vector<double> &prices,
-                           const std::string &output_file, uint64_t &last_timestamp) {
+                           const std::string &output_file, uint64_t &last_timestamp, std::vector<Bar> &stored_bars) {
     std::map<uint64_t, Bar> bars;
 
     for (size_t i = 0; i < timestamps.size(); ++i) {
@@ -105,7 +116,7 @@ void create_and_store_bars(const std::vector<uint64_t> &timestamps, const std::v
 
         uint64_t bar_time = timestamps[i] / 1000000000; // Convert nanoseconds to seconds
 
-        if (last_timestamp != 0 && bar_time <= last_timestamp + 1) {
+        if (last_timestamp != 0 && bar_time <= last_timestamp) {
             continue;
         }
 
@@ -118,35 +129,64 @@ void create_and_store_bars(const std::vector<uint64_t> &timestamps, const std::v
         }
     }
 
-    std::ofstream output(output_file, std::ios::binary | std::ios::trunc);
+    bool append = last_timestamp != 0;
+    stored_bars.clear();
+    for (const auto &entry : bars) {
+        stored_bars.push_back(entry.second);
+        last_timestamp = entry.second.timestamp;
+    }
+    if (output_file.empty()) {
+        return;
+    }
+
+    std::ofstream output(output_file, std::ios::binary | (append ? std::ios::app : std::ios::trunc));
     if (!output.is_open()) {
         std::cerr << "Error: Could not open output file: " << output_file << std::endl;
         return;
     }
+    output.write(reinterpret_cast<const char *>(stored_bars.data()), stored_bars.size() * sizeof(Bar));
+    output.close();
+}
 
-    for (const auto &entry : bars) {
-        const Bar &bar = entry.second;
-        output.write(reinterpret_cast<const char *>(&bar), sizeof(Bar));
-        last_timestamp = bar.timestamp;
+// The OHLC columns of one bid or ask level for the bar container
+BarSeries tops_bar_series(const std::string &name, const std::vector<Bar> &bars) {
+    BarSeries series;
+    series.name = name;
+    series.fields = {"open", "high", "low", "close"};
+    series.columns.resize(series.fields.size());
+    for (const Bar &bar : bars) {
+        series.timestamps.push_back(bar.timestamp);
+        series.columns[0].push_back(bar.open);
+        series.columns[1].push_back(bar.high);
+        series.columns[2].push_back(bar.low);
+        series.columns[3].push_back(bar.close);
     }
-
-    output.close();
+    return series;
 }
 
-// Function to process and store bars
-void process_and_store_bars(const std::vector<uint64_t> &timestamps,
+// Function to process and store bars. Every level goes to the symbol's bar container as series
+// bid_L<n>/ask_L<n>, next to the quote bars as series quote; with legacy_files set, the levels are also
+// written to the per-level files. A non-zero resume_sec appends the bars from that second on to the
+// bars stored before it. Returns false if the bar container cannot be written.
+bool process_and_store_bars(const std::vector<uint64_t> &timestamps,
     const std::vector<std::vector<double>> &bid_prices,
-    const std::vector<std::vector<double>> &ask_prices,
-    const std::string &output_file_path_base, const std::string &symbol) {
-    uint64_t last_bid_timestamps[3] = {0, 0, 0};
-    uint64_t last_ask_timestamps[3] = {0, 0, 0};
+    const std::vector<std::vector<double>> &ask_prices, const std::vector<QuoteBarRecord> &quote_bars,
+    const std::string &output_file_path_base, const std::string &symbol, bool legacy_files, uint64_t resume_sec) {
+    uint64_t resumed_from = resume_sec == 0 ? 0 : resume_sec - 1;
+    uint64_t last_bid_timestamps[3] = {resumed_from, resumed_from, resumed_from};
+    uint64_t last_ask_timestamps[3] = {resumed_from, resumed_from, resumed_from};
+    std::vector<Bar> bid_bars[3], ask_bars[3];
 
     auto process_level = [&](int level) {
         std::string bid_bar_file = output_file_path_base + "bid_bars_L" + std::to_string(level + 1) + "." + symbol + ".bin";
         std::string ask_bar_file = output_file_path_base + "ask_bars_L" + std::to_string(level + 1) + "." + symbol + ".bin";
+        if (!legacy_files) {
+            bid_bar_file.clear();
+            ask_bar_file.clear();
+        }
 
-        create_and_store_bars(timestamps, bid_prices[level], bid_bar_file, last_bid_timestamps[level]);
-        create_and_store_bars(timestamps, ask_prices[level], ask_bar_file, last_ask_timestamps[level]);
+        create_and_store_bars(timestamps, bid_prices[level], bid_bar_file, last_bid_timestamps[level], bid_bars[level]);
+        create_and_store_bars(timestamps, ask_prices[level], ask_bar_file, last_ask_timestamps[level], ask_bars[level]);
     };
 
     std::vector<std::thread> threads;
@@ -157,10 +197,104 @@ void process_and_store_bars(const std::vector<uint64_t> &timestamps,
     for (auto &thread : threads) {
         thread.join();
     }
+
+    std::vector<BarSeries> series = {quote_bar_series(quote_bars)};
+    for (int level = 0; level < 3; ++level) {
+        series.push_back(tops_bar_series("bid_L" + std::to_string(level + 1), bid_bars[level]));
+        series.push_back(tops_bar_series("ask_L" + std::to_string(level + 1), ask_bars[level]));
+    }
+    std::string container_file = bar_container_path(output_file_path_base, symbol);
+    std::string error;
+    if (!write_bar_series(container_file, series, error, resume_sec)) {
+        std::cerr << "Error: " << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::string level_bar_file(const std::string &output_file_path_base, const std::string &side, int level, const std::string &symbol) {
+    return output_file_path_base + side + "_bars_L" + std::to_string(level + 1) + "." + symbol + ".bin";
+}
+
+// The per-series files written with --legacy-files, with their record sizes
+std::vector<std::pair<std::string, size_t>> legacy_bar_files(const std::string &output_file_path_base, const std::string &symbol) {
+    std::vector<std::pair<std::string, size_t>> bar_files = {{quote_bars_path(output_file_path_base, symbol), sizeof(QuoteBarRecord)}};
+    for (int level = 0; level < 3; ++level) {
+        bar_files.push_back({level_bar_file(output_file_path_base, "bid", level, symbol), sizeof(Bar)});
+        bar_files.push_back({level_bar_file(output_file_path_base, "ask", level, symbol), sizeof(Bar)});
+    }
+    return bar_files;
+}
+
+// Second an append run resumes from: the last bar second stored by the previous run, whose bars may
+// be incomplete; every earlier second is final. 0 when nothing is stored yet. The quote series has a
+// bar for every second with a top, so it bounds the level series of the container.
+bool find_resume_second(const std::string &output_file_path_base, const std::string &symbol, bool legacy_files,
+                        uint64_t &resume_sec) {
+    resume_sec = 0;
+    for (const auto &[path, record_size] : legacy_files ? legacy_bar_files(output_file_path_base, symbol)
+                                                        : std::vector<std::pair<std::string, size_t>>()) {
+        uint64_t last_sec;
+        if (!last_bar_timestamp(path, record_size, last_sec)) {
+            std::cerr << "Error: Cannot resume from bar file: " << path << std::endl;
+            return false;
+        }
+        resume_sec = std::max(resume_sec, last_sec);
+    }
+
+    std::string container_file = bar_container_path(output_file_path_base, symbol);
+    if (access(container_file.c_str(), F_OK) == 0) {
+        BarContainer container;
+        std::string error;
+        if (!container.open(container_file, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return false;
+        }
+        const double *update_counts = container.column("quote.update_count");
+        for (uint64_t row = container.num_rows(); update_counts && row > 0; --row) {
+            if (!std::isnan(update_counts[row - 1])) {
+                resume_sec = std::max(resume_sec, container.timestamps()[row - 1]);
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+// Index of the first top at or after ts, found by binary search over the time-ordered tops
+uint32_t first_top_at_or_after(std::ifstream &file, uint32_t number_of_tops, uint64_t ts) {
+    uint32_t low = 0, high = number_of_tops;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        uint64_t mid_ts = 0;
+        file.seekg(sizeof(Header) + static_cast<std::streamoff>(mid) * sizeof(BookTop));
+        file.read(reinterpret_cast<char *>(&mid_ts), sizeof(mid_ts));
+        if (mid_ts < ts) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+QuoteLevels quote_levels_of(const BookTop &book_top) {
+    QuoteLevels levels;
+    for (int level = 0; level < 3; ++level) {
+        levels.bid_price[level] = book_top.bid_price[level];
+        levels.ask_price[level] = book_top.ask_price[level];
+        levels.bid_qty[level] = book_top.bid_qty[level];
+        levels.ask_qty[level] = book_top.ask_qty[level];
+    }
+    return levels;
 }
 
 // Function to process the file
-void process_file(const std::string &date, const std::string &feed, const std::string &symbol) {
+// With append set, bars are only built from the last stored bar second on: the input is searched for
+// the first top of that second, the bars from it are dropped from the outputs and rebuilt from the new
+// tops, so a refresh during the day costs time proportional to the data added since the last run.
+// Returns false if the input cannot be read or an output cannot be written.
+bool process_file(const std::string &date, const std::string &feed, const std::string &symbol, bool legacy_files, bool append) {
     // Convert feed to uppercase for the second occurrence
     std::string feed_upper = feed;
     std::transform(feed_upper.begin(), feed_upper.end(), feed_upper.begin(), ::toupper);
@@ -171,24 +305,85 @@ void process_file(const std::string &date, const std::string &feed, const std::s
     std::ifstream input_file(input_file_path, std::ios::binary);
     if (!input_file.is_open()) {
         std::cerr << "Error: File not found: " << input_file_path << std::endl;
-        return;
+        return false;
     }
 
     Header header;
     if (!read_header(input_file, header)) {
-        return;
+        return false;
+    }
+
+    uint32_t number_of_tops = header.number_of_tops;
+    input_file.seekg(0, std::ios::end);
+    uint64_t tops_in_file = (static_cast<uint64_t>(input_file.tellg()) - sizeof(Header)) / sizeof(BookTop);
+    if (number_of_tops > tops_in_file) {
+        std::cerr << "Warning: Header counts " << number_of_tops << " tops but the file holds " << tops_in_file << "." << std::endl;
+        number_of_tops = static_cast<uint32_t>(tops_in_file);
+    }
+
+    uint64_t resume_sec = 0;
+    if (append && !find_resume_second(output_file_path_base, symbol, legacy_files, resume_sec)) {
+        return false;
+    }
+
+    QuoteBarBuilder quote_bars;
+    uint32_t first_top = 0;
+    if (resume_sec != 0) {
+        first_top = first_top_at_or_after(input_file, number_of_tops, resume_sec * 1000000000ULL);
+        std::cout << "Resuming from second " << resume_sec << " at top " << first_top << " of " << number_of_tops << std::endl;
+        if (first_top > 0) {
+            BookTop previous_top;
+            input_file.seekg(sizeof(Header) + static_cast<std::streamoff>(first_top - 1) * sizeof(BookTop));
+            input_file.read(reinterpret_cast<char *>(&previous_top), sizeof(BookTop));
+            quote_bars.prime(previous_top.ts, quote_levels_of(previous_top));
+        }
+        for (const auto &[path, record_size] : legacy_files ? legacy_bar_files(output_file_path_base, symbol)
+                                                            : std::vector<std::pair<std::string, size_t>>()) {
+            std::string error;
+            if (!drop_bars_from(path, record_size, resume_sec, error)) {
+                std::cerr << "Error: " << error << std::endl;
+                return false;
+            }
+        }
+    }
+    input_file.clear();
+    input_file.seekg(sizeof(Header) + static_cast<std::streamoff>(first_top) * sizeof(BookTop));
+
+    if (legacy_files && !quote_bars.open(quote_bars_path(output_file_path_base, symbol), resume_sec != 0)) {
+        std::cerr << "Error: Could not open output file: " << quote_bars.path() << std::endl;
+        return false;
     }
 
     std::vector<uint64_t> timestamps;
     std::vector<std::vector<double>> bid_prices, ask_prices;
-    read_data(input_file, header.number_of_tops, timestamps, bid_prices, ask_prices);
-
-    process_and_store_bars(timestamps, bid_prices, ask_prices, output_file_path_base, symbol);
+    read_data(input_file, number_of_tops - first_top, timestamps, bid_prices, ask_prices, quote_bars);
+    bool quote_bars_ok = quote_bars.finish();
+    if (!quote_bars_ok) {
+        std::cerr << "Error: Failed writing " << quote_bars.path() << std::endl;
+    }
+    return process_and_store_bars(timestamps, bid_prices, ask_prices, quote_bars.bars(), output_file_path_base, symbol,
+                                  legacy_files, resume_sec) && quote_bars_ok;
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 4) {
-        std::cerr << "Usage: ./process_tops <date> <feed> <symbol>" << std::endl;
+    bool legacy_files = false;
+    bool append = false;
+    bool valid_flags = argc >= 4;
+    for (int i = 4; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--legacy-files") {
+            legacy_files = true;
+        } else if (flag == "--append") {
+            append = true;
+        } else {
+            valid_flags = false;
+        }
+    }
+    if (!valid_flags) {
+        std::cerr << "Usage: ./process_tops <date> <feed> <symbol> [--legacy-files] [--append]" << std::endl;
+        std::cerr << "  The bid/ask level bars and the quote bars are written to the bar container <FEED>.bars.<SYMBOL>.bin" << std::endl;
+        std::cerr << "  --legacy-files: also write them to the per-series files <FEED>.{bid,ask}_bars_L<n>/quote_bars.<SYMBOL>.bin" << std::endl;
+        std::cerr << "  --append: resume from the last stored bar and only add the bars of tops added since" << std::endl;
         return 1;
     }
 
@@ -199,7 +394,5 @@ int main(int argc, char *argv[]) {
     // Convert symbol to uppercase
     std::transform(symbol.begin(), symbol.end(), symbol.begin(), ::toupper);
     
-    process_file(date, feed, symbol);
-
-    return 0;
+    return process_file(date, feed, symbol, legacy_files, append) ? 0 : 1;
 }
\ No newline at end of file
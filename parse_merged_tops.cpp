@@ -11,6 +11,9 @@
 #include <algorithm>
 #include <thread>
 
+#include "consolidated_book.hpp"
+#include "quote_bars.hpp"
+
 #pragma pack(push, 1)
 
 struct MergedFileHeader {
@@ -20,18 +23,6 @@ struct MergedFileHeader {
     uint64_t symbol_idx;
 };
 
-struct TopLevelData {
-    int64_t bid_price;
-    int64_t ask_price;
-    uint32_t bid_qty;
-    uint32_t ask_qty;
-};
-
-struct TopsDataRecord {
-    uint64_t ts;
-    uint64_t seqno;
-    TopLevelData levels[3];
-};
 #pragma pack(pop)
 
 struct Bar {
@@ -59,13 +50,35 @@ bool read_main_header(std::ifstream &file, MergedFileHeader &header) {
     return true;
 }
 
-// Function to read data from merged tops file
+// Top levels of the consolidated book across every venue seen so far
+static void consolidated_quote_levels(const VenueQuoteTable &table, DepthLadder &bids, DepthLadder &asks, QuoteLevels &levels) {
+    build_depth_ladder(table, true, bids);
+    build_depth_ladder(table, false, asks);
+    for (int level = 0; level < QUOTE_BAR_LEVELS; ++level) {
+        bool has_bid = static_cast<size_t>(level) < bids.count;
+        bool has_ask = static_cast<size_t>(level) < asks.count;
+        levels.bid_price[level] = has_bid ? bids.price[level] : 0;
+        levels.bid_qty[level] = has_bid ? bids.quantity[level] : 0;
+        levels.ask_price[level] = has_ask ? asks.price[level] : 0;
+        levels.ask_qty[level] = has_ask ? asks.quantity[level] : 0;
+    }
+}
+
+// Function to read data from merged tops file. Each record also updates the consolidated book that
+// quote_bars is fed from: unlike the bid/ask bars, which take every venue's record as it comes,
+// mid, microprice and spread only make sense on the best bid and ask across venues.
 void read_merged_data(std::ifstream &file, uint32_t number_of_records, std::vector<uint64_t> &timestamps,
-    std::vector<std::vector<double>> &bid_prices, std::vector<std::vector<double>> &ask_prices) {
+    std::vector<std::vector<double>> &bid_prices, std::vector<std::vector<double>> &ask_prices,
+    QuoteBarBuilder &quote_bars) {
     
     bid_prices.assign(3, std::vector<double>());
     ask_prices.assign(3, std::vector<double>());
 
+    VenueQuoteTable quote_table;
+    DepthLadder bid_ladder, ask_ladder;
+    QuoteLevels quote_levels;
+    bool venue_overflow_reported = false;
+
     for (uint32_t rec_idx = 0; rec_idx < number_of_records; ++rec_idx) {
         uint64_t original_feed_id_for_record;
         file.read(reinterpret_cast<char*>(&original_feed_id_for_record), sizeof(uint64_t));
@@ -74,28 +87,42 @@ void read_merged_data(std::ifstream &file, uint32_t number_of_records, std::vect
             break;
         }
 
-        TopsDataRecord current_tops_record;
-        file.read(reinterpret_cast<char *>(&current_tops_record), sizeof(TopsDataRecord));
-        if (static_cast<size_t>(file.gcount()) < sizeof(TopsDataRecord)) {
+        VenueTopsRecord current_tops_record;
+        file.read(reinterpret_cast<char *>(&current_tops_record), sizeof(VenueTopsRecord));
+        if (static_cast<size_t>(file.gcount()) < sizeof(VenueTopsRecord)) {
             std::cerr << "Error reading TopsDataRecord " << rec_idx << std::endl;
             break;
         }
 
         timestamps.push_back(current_tops_record.ts);
 
+        const TopLevelData *record_levels[3] = {&current_tops_record.level1, &current_tops_record.level2, &current_tops_record.level3};
         for (int level = 0; level < 3; ++level) {
-            if (current_tops_record.levels[level].bid_price != 0 && current_tops_record.levels[level].bid_qty != 0) {
-                bid_prices[level].push_back(static_cast<double>(current_tops_record.levels[level].bid_price) / 1e9);
+            if (record_levels[level]->bid_price != 0 && record_levels[level]->bid_qty != 0) {
+                bid_prices[level].push_back(static_cast<double>(record_levels[level]->bid_price) / 1e9);
             } else {
                 bid_prices[level].push_back(NAN);
             }
 
-            if (current_tops_record.levels[level].ask_price != 0 && current_tops_record.levels[level].ask_qty != 0) {
-                ask_prices[level].push_back(static_cast<double>(current_tops_record.levels[level].ask_price) / 1e9);
+            if (record_levels[level]->ask_price != 0 && record_levels[level]->ask_qty != 0) {
+                ask_prices[level].push_back(static_cast<double>(record_levels[level]->ask_price) / 1e9);
             } else {
                 ask_prices[level].push_back(NAN);
             }
         }
+
+        int slot = quote_table.slot_for(original_feed_id_for_record);
+        if (slot < 0) {
+            if (!venue_overflow_reported) {
+                std::cerr << "Warning: more than " << MAX_VENUES << " venues, records of feed_id " << original_feed_id_for_record
+                          << " and any further feed_ids (first at record " << rec_idx << ") left out of quote_bars" << std::endl;
+                venue_overflow_reported = true;
+            }
+            continue;
+        }
+        quote_table.update(slot, current_tops_record);
+        consolidated_quote_levels(quote_table, bid_ladder, ask_ladder, quote_levels);
+        quote_bars.add(current_tops_record.ts, quote_levels);
     }
 }
 
@@ -194,11 +221,21 @@ void process_merged_file(const std::string &date, const std::string &symbol_arg)
         return;
     }
 
+    QuoteBarBuilder quote_bars;
+    if (!quote_bars.open(quote_bars_path(output_file_path_base, symbol))) {
+        std::cerr << "Error: Could not open output file: " << quote_bars.path() << std::endl;
+        return;
+    }
+
     std::vector<uint64_t> timestamps;
     std::vector<std::vector<double>> bid_prices, ask_prices;
-    read_merged_data(input_file, main_header.count, timestamps, bid_prices, ask_prices);
+    read_merged_data(input_file, main_header.count, timestamps, bid_prices, ask_prices, quote_bars);
     input_file.close();
 
+    if (!quote_bars.finish()) {
+        std::cerr << "Error: Failed writing " << quote_bars.path() << std::endl;
+    }
+
     if (timestamps.empty()) {
         std::cout << "No valid data read from " << input_file_path << std::endl;
         return;
@@ -1,5 +1,6 @@
 import struct
 import numpy as np
+from bar_container import bar_container_path, read_container_series
 
 # Define the binary format for fills bars
 FILLS_BAR_FORMAT = "<Qddddi"
@@ -9,6 +10,17 @@ FILLS_BAR_SIZE = struct.calcsize(FILLS_BAR_FORMAT)
 TOPS_BAR_FORMAT = "<Qdddd"
 TOPS_BAR_SIZE = struct.calcsize(TOPS_BAR_FORMAT)
 
+# Series compared for every pair, named as in the bar container, with the name of their own bar file
+BAR_SERIES_FILES = {
+    'fills': 'fills_bars',
+    'bid_L1': 'bid_bars_L1',
+    'ask_L1': 'ask_bars_L1',
+    'bid_L2': 'bid_bars_L2',
+    'ask_L2': 'ask_bars_L2',
+    'bid_L3': 'bid_bars_L3',
+    'ask_L3': 'ask_bars_L3',
+}
+
 def read_fills_bar_file(file_path):
     """Reads a binary fills bar file and extracts closing prices."""
     closing_prices = []
@@ -43,6 +55,15 @@ def read_tops_bar_file(file_path):
         print(f"Error reading file {file_path}: {e}")
     return closing_prices
 
+def read_series_closes(base_path, symbol, series, fills_flag):
+    """Reads the closing prices of one series of a symbol: from the symbol's bar container when it
+    holds the series, otherwise from the series' own bar file (written with --legacy-files)."""
+    bars = read_container_series(bar_container_path(base_path + ".", symbol), series, ['close'])
+    if bars is not None and len(bars[0]) > 0:
+        return bars[1][0].tolist()
+    file_path = f"{base_path}.{BAR_SERIES_FILES[series]}.{symbol.upper()}.bin"
+    return read_fills_bar_file(file_path) if fills_flag else read_tops_bar_file(file_path)
+
 def trim_to_same_length(list1, list2):
     """Trims two lists to the same length by evenly removing entries from the longer list."""
     len1, len2 = len(list1), len(list2)
@@ -59,27 +80,23 @@ def trim_to_same_length(list1, list2):
         list2 = [list2[i] for i in range(0, len2, step)][:len1]
     return list1, list2
 
-def calculate_correlation(file1, file2, fills_flag, min_length=10):
-    """Calculates the correlation between closing prices of two files."""
-    
-    # Checks if files are fills or tops and reads accordingly
-    if fills_flag:
-        prices1 = read_fills_bar_file(file1)
-        prices2 = read_fills_bar_file(file2)
-    else:
-        prices1 = read_tops_bar_file(file1)
-        prices2 = read_tops_bar_file(file2)
+def calculate_correlation(base_path, symbol1, symbol2, series, fills_flag, min_length=10):
+    """Calculates the correlation between closing prices of one series of two symbols."""
+    prices1 = read_series_closes(base_path, symbol1, series, fills_flag)
+    prices2 = read_series_closes(base_path, symbol2, series, fills_flag)
+    label1 = f"{symbol1.upper()} {series}"
+    label2 = f"{symbol2.upper()} {series}"
 
     # Skip if either list is empty
     if not prices1 or not prices2:
-        print(f"Skipping: Empty data in files:\n  {file1}\n  {file2}")
+        print(f"Skipping: Empty data in series:\n  {label1}\n  {label2}")
         return None
 
     # Trim lists to the same length
     prices1, prices2 = trim_to_same_length(prices1, prices2)
 
     if len(prices1) < min_length or len(prices2) < min_length:
-        print(f"Skipping after trimming (too little data):\n  {file1} ({len(prices1)} entries)\n  {file2} ({len(prices2)} entries)")
+        print(f"Skipping after trimming (too little data):\n  {label1} ({len(prices1)} entries)\n  {label2} ({len(prices2)} entries)")
         return None
     
     # Calculate correlation
@@ -109,31 +126,15 @@ if __name__ == "__main__":
     symbol2 = input("Enter second symbol: ")
 
     base_path = f"/home/vir/{date}/{feed.lower()}/bars/{feed.upper()}"
-    # Input paths for the files
-    fills_file_stock1 = f"{base_path}.fills_bars.{symbol1.upper()}.bin"
-    L1_bid_file_stock1 = f"{base_path}.bid_bars_L1.{symbol1.upper()}.bin"
-    L1_ask_file_stock1 = f"{base_path}.ask_bars_L1.{symbol1.upper()}.bin"
-    L2_bid_file_stock1 = f"{base_path}.bid_bars_L2.{symbol1.upper()}.bin"
-    L2_ask_file_stock1 = f"{base_path}.ask_bars_L2.{symbol1.upper()}.bin"
-    L3_bid_file_stock1 = f"{base_path}.bid_bars_L3.{symbol1.upper()}.bin"
-    L3_ask_file_stock1 = f"{base_path}.ask_bars_L3.{symbol1.upper()}.bin"
-
-    fills_file_stock2 = f"{base_path}.fills_bars.{symbol2.upper()}.bin"
-    L1_bid_file_stock2 = f"{base_path}.bid_bars_L1.{symbol2.upper()}.bin"
-    L1_ask_file_stock2 = f"{base_path}.ask_bars_L1.{symbol2.upper()}.bin"
-    L2_bid_file_stock2 = f"{base_path}.bid_bars_L2.{symbol2.upper()}.bin"
-    L2_ask_file_stock2 = f"{base_path}.ask_bars_L2.{symbol2.upper()}.bin"
-    L3_bid_file_stock2 = f"{base_path}.bid_bars_L3.{symbol2.upper()}.bin"
-    L3_ask_file_stock2 = f"{base_path}.ask_bars_L3.{symbol2.upper()}.bin"
 
     # Calculate correlations
-    correlation_fills = calculate_correlation(fills_file_stock1, fills_file_stock2, True)
-    correlation_L1_bid = calculate_correlation(L1_bid_file_stock1, L1_bid_file_stock2, False)
-    correlation_L1_ask = calculate_correlation(L1_ask_file_stock1, L1_ask_file_stock2, False)
-    correlation_L2_bid = calculate_correlation(L2_bid_file_stock1, L2_bid_file_stock2, False)
-    correlation_L2_ask = calculate_correlation(L2_ask_file_stock1, L2_ask_file_stock2, False)
-    correlation_L3_bid = calculate_correlation(L3_bid_file_stock1, L3_bid_file_stock2, False)
-    correlation_L3_ask = calculate_correlation(L3_ask_file_stock1, L3_ask_file_stock2, False)
+    correlation_fills = calculate_correlation(base_path, symbol1, symbol2, 'fills', True)
+    correlation_L1_bid = calculate_correlation(base_path, symbol1, symbol2, 'bid_L1', False)
+    correlation_L1_ask = calculate_correlation(base_path, symbol1, symbol2, 'ask_L1', False)
+    correlation_L2_bid = calculate_correlation(base_path, symbol1, symbol2, 'bid_L2', False)
+    correlation_L2_ask = calculate_correlation(base_path, symbol1, symbol2, 'ask_L2', False)
+    correlation_L3_bid = calculate_correlation(base_path, symbol1, symbol2, 'bid_L3', False)
+    correlation_L3_ask = calculate_correlation(base_path, symbol1, symbol2, 'ask_L3', False)
 
     # Calculate weighted correlation
     correlations = [
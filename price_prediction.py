@@ -9,6 +9,7 @@ from sklearn.linear_model import LinearRegression
 from sklearn.metrics import mean_squared_error
 import matplotlib.pyplot as plt
 from pandas.plotting import register_matplotlib_converters
+from bar_container import bar_container_path, read_container_series
 
 register_matplotlib_converters()
 
@@ -65,50 +66,54 @@ def read_bar_data(file_path, bar_format, bar_size, columns):
         print(f"Error reading bar file {file_path}: {e}")
         return pd.DataFrame(columns=['timestamp'] + columns).set_index('timestamp')
 
+def read_series_data(container_file, series, fields, legacy_file, bar_format, bar_size, columns):
+    """Reads one bar series into a pandas DataFrame: from the symbol's bar container when it holds the
+    series, otherwise from the series' own bar file (written with --legacy-files). fields are the
+    container fields of columns, in the same order."""
+    bars = read_container_series(container_file, series, fields)
+    if bars is None or len(bars[0]) == 0:
+        print(f"Reading {series} bars from: {legacy_file}")
+        return read_bar_data(legacy_file, bar_format, bar_size, columns)
+
+    print(f"Reading {series} bars from: {container_file}")
+    timestamps, values = bars
+    df = pd.DataFrame(dict(zip(columns, values)))
+    df['timestamp'] = pd.to_datetime(timestamps.astype(np.int64), unit='s', utc=True).tz_convert(ET)
+    df = df.set_index('timestamp')
+    if 'volume' in df.columns:
+        df['volume'] = df['volume'].round().astype('Int64')
+    return df
+
 def load_and_merge_data(date, feed, symbol):
     """Loads fills and L1, L2, L3 tops bar data and merges them for a specific date."""
     base_path = f"/home/vir/{date}/{feed.lower()}/bars/{feed.upper()}." # Adjust if your path differs
     print(f"--- Loading data for {date} ---")
 
-    # Define file paths for fills and all levels of tops
-    fills_file = f"{base_path}fills_bars.{symbol.upper()}.bin"
-    bid_l1_file = f"{base_path}bid_bars_L1.{symbol.upper()}.bin"
-    ask_l1_file = f"{base_path}ask_bars_L1.{symbol.upper()}.bin"
-    bid_l2_file = f"{base_path}bid_bars_L2.{symbol.upper()}.bin"
-    ask_l2_file = f"{base_path}ask_bars_L2.{symbol.upper()}.bin"
-    bid_l3_file = f"{base_path}bid_bars_L3.{symbol.upper()}.bin"
-    ask_l3_file = f"{base_path}ask_bars_L3.{symbol.upper()}.bin"
+    container_file = bar_container_path(base_path, symbol)
 
-    # Define columns based on BAR_FORMATs (excluding timestamp)
+    # Define columns based on BAR_FORMATs (excluding timestamp), with their bar container fields
     # Fills: high, low, open, close, volume
     cols_fills = ['fills_high', 'fills_low', 'fills_open', 'fills_close', 'volume']
+    fields_fills = ['high', 'low', 'open', 'close', 'volume']
     # Tops: open, high, low, close
     cols_tops = ['tops_open', 'tops_high', 'tops_low', 'tops_close']
+    fields_tops = ['open', 'high', 'low', 'close']
 
     # Read data
-    print(f"Reading fills data from: {fills_file}")
-    df_fills = read_bar_data(fills_file, BAR_FORMAT_FILLS, BAR_SIZE_FILLS, cols_fills)
-
-    print(f"Reading L1 bid data from: {bid_l1_file}")
-    df_bid_l1 = read_bar_data(bid_l1_file, BAR_FORMAT_TOPS, BAR_SIZE_TOPS, cols_tops).add_prefix('bid_L1_')
-    print(f"Reading L1 ask data from: {ask_l1_file}")
-    df_ask_l1 = read_bar_data(ask_l1_file, BAR_FORMAT_TOPS, BAR_SIZE_TOPS, cols_tops).add_prefix('ask_L1_')
-
-    print(f"Reading L2 bid data from: {bid_l2_file}")
-    df_bid_l2 = read_bar_data(bid_l2_file, BAR_FORMAT_TOPS, BAR_SIZE_TOPS, cols_tops).add_prefix('bid_L2_')
-    print(f"Reading L2 ask data from: {ask_l2_file}")
-    df_ask_l2 = read_bar_data(ask_l2_file, BAR_FORMAT_TOPS, BAR_SIZE_TOPS, cols_tops).add_prefix('ask_L2_')
-
-    print(f"Reading L3 bid data from: {bid_l3_file}")
-    df_bid_l3 = read_bar_data(bid_l3_file, BAR_FORMAT_TOPS, BAR_SIZE_TOPS, cols_tops).add_prefix('bid_L3_')
-    print(f"Reading L3 ask data from: {ask_l3_file}")
-    df_ask_l3 = read_bar_data(ask_l3_file, BAR_FORMAT_TOPS, BAR_SIZE_TOPS, cols_tops).add_prefix('ask_L3_')
-
+    df_fills = read_series_data(container_file, 'fills', fields_fills, f"{base_path}fills_bars.{symbol.upper()}.bin",
+                                BAR_FORMAT_FILLS, BAR_SIZE_FILLS, cols_fills)
+    tops_dfs = []
+    for level in range(1, 4):
+        for side in ['bid', 'ask']:
+            series = f"{side}_L{level}"
+            df_tops = read_series_data(container_file, series, fields_tops, f"{base_path}{side}_bars_L{level}.{symbol.upper()}.bin",
+                                       BAR_FORMAT_TOPS, BAR_SIZE_TOPS, cols_tops)
+            tops_dfs.append(df_tops.add_prefix(f"{series}_"))
 
     # Merge dataframes based on timestamp index
     # Use outer join to keep all timestamps, then decide how to handle NaNs
     print("Merging dataframes...")
-    all_dfs = [df_fills, df_bid_l1, df_ask_l1, df_bid_l2, df_ask_l2, df_bid_l3, df_ask_l3]
+    all_dfs = [df_fills] + tops_dfs
     # Filter out empty dataframes before merging
     all_dfs = [df for df in all_dfs if not df.empty]
 
@@ -2,17 +2,18 @@
 #include <string>
 #include <vector>
 #include <regex>
-#include <cstdlib>
-#include <sstream>
+#include <algorithm>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <limits.h>
-#include <future>
+#include <thread>
 #include <mutex>
-#include <functional>
 #include <atomic>
 
+#include "consolidated_book.hpp"
+#include "provenance.hpp"
+
 // Helper function to check if a path is a directory
 bool is_directory(const std::string& path) {
     struct stat statbuf;
@@ -28,15 +29,6 @@ bool path_exists(const std::string& path) {
     return (stat(path.c_str(), &statbuf) == 0);
 }
 
-// Helper function to check if a path is a regular file
-bool is_regular_file(const std::string& path) {
-    struct stat statbuf;
-    if (stat(path.c_str(), &statbuf) != 0) {
-        return false;
-    }
-    return S_ISREG(statbuf.st_mode);
-}
-
 // Helper function to create a directory
 bool create_directory_simple(const std::string& path) {
     if (path_exists(path)) {
@@ -68,49 +60,83 @@ void print_usage(const char* prog_name) {
     std::cerr << "Usage: " << prog_name
               << " --input-folder <path>"
               << " --output-folder <path>"
-              << " --executable-path <path_to_process_merged_tops_executable>"
+              << " [--jobs <max concurrent files, default: hardware threads>]"
+              << " [--force (rebuild outputs that are up to date)]"
+              << " [--features (also write book_features.<SYMBOL>.bin)] [--feature-bar <width, default: 1s>]"
               << std::endl;
 }
 
-// Worker function to process a single file
-bool process_file_task(
-    const std::string& executable_path,
-    const std::string& input_filepath,
-    const std::string& output_filepath,
-    const std::string& original_filename,
-    std::mutex& console_mutex) {
-
-    std::ostringstream command_stream;
-    command_stream << "\"" << executable_path << "\""
-                   << " --input-file " << "\"" << input_filepath << "\""
-                   << " --output-file " << "\"" << output_filepath << "\"";
-    std::string command = command_stream.str();
+struct FileJob {
+    std::string filename;
+    std::string input_filepath;
+    std::string output_filepath;
+    std::string features_filepath;  // empty unless --features
+    off_t input_size = 0;
+    bool up_to_date = false;
+    ConsolidationFileResult result;
+};
+
+// Consolidates one file in-process and reports its outcome. Outputs whose .prov record still
+// matches the input and options are left alone unless force_rebuild is set.
+void process_file_task(FileJob& job, const ConsolidationOptions& options, bool force_rebuild, std::mutex& console_mutex) {
+    std::vector<std::filesystem::path> output_paths = {job.output_filepath};
+    if (options.index_interval != 0) {
+        output_paths.push_back(job.output_filepath + SNAPSHOT_INDEX_SUFFIX);
+    }
+    if (!job.features_filepath.empty()) {
+        output_paths.push_back(job.features_filepath);
+    }
+    std::string params = describe_consolidation_options(options);
+    std::filesystem::path provenance_path = provenance_path_for(job.output_filepath);
+
+    if (!force_rebuild) {
+        std::optional<Provenance> current = make_provenance("process_merged_tops", CONSOLIDATED_BOOK_VERSION, params,
+                                                            {job.input_filepath}, output_paths);
+        if (current && provenance_is_current(provenance_path, *current)) {
+            job.up_to_date = true;
+            job.result.ok = true;
+            std::lock_guard<std::mutex> lock(console_mutex);
+            std::cout << "\nUp to date, skipping: " << job.filename << std::endl;
+            return;
+        }
+    }
+    remove_provenance(provenance_path);
 
     {
         std::lock_guard<std::mutex> lock(console_mutex);
-        std::cout << "\nProcessing file: " << original_filename << std::endl;
-        std::cout << "  Input: " << input_filepath << std::endl;
-        std::cout << "  Output: " << output_filepath << std::endl;
-        std::cout << "  Executing: " << command << std::endl;
+        std::cout << "\nProcessing file: " << job.filename << std::endl;
+        std::cout << "  Input: " << job.input_filepath << std::endl;
+        std::cout << "  Output: " << job.output_filepath << std::endl;
     }
 
-    int return_code = std::system(command.c_str());
+    job.result = process_merged_tops_file(job.input_filepath, job.output_filepath, "", job.features_filepath, options);
+    if (job.result.ok) {
+        std::optional<Provenance> provenance = make_provenance("process_merged_tops", CONSOLIDATED_BOOK_VERSION, params,
+                                                               {job.input_filepath}, output_paths);
+        if (!provenance || !write_provenance(provenance_path, *provenance)) {
+            std::lock_guard<std::mutex> lock(console_mutex);
+            std::cerr << "  Warning: Could not record provenance for " << job.output_filepath << std::endl;
+        }
+    }
 
-    if (return_code == 0) {
-        std::lock_guard<std::mutex> lock(console_mutex);
-        std::cout << "  Successfully processed " << original_filename << std::endl;
-        return true;
+    std::lock_guard<std::mutex> lock(console_mutex);
+    for (const auto& warning : job.result.warnings) {
+        std::cerr << "  Warning: " << warning << std::endl;
+    }
+    if (job.result.ok) {
+        std::cout << "  Successfully processed " << job.filename << " (" << job.result.snapshots_written << " snapshots)" << std::endl;
     } else {
-        std::lock_guard<std::mutex> lock(console_mutex);
-        std::cerr << "  Error processing " << original_filename << ". Executable returned code: " << return_code << std::endl;
-        return false;
+        std::cerr << "  Error processing " << job.filename << ": " << job.result.error << std::endl;
     }
 }
 
 int main(int argc, char* argv[]) {
     std::string input_folder_path_str;
     std::string output_folder_path_str;
-    std::string executable_path_str;
+    unsigned int max_jobs = std::max(1u, std::thread::hardware_concurrency());
+    bool force_rebuild = false;
+    bool write_features = false;
+    ConsolidationOptions options;
 
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
@@ -119,11 +145,32 @@ int main(int argc, char* argv[]) {
         } else if (arg == "--output-folder" && i + 1 < argc) {
             output_folder_path_str = argv[++i];
         } else if (arg == "--executable-path" && i + 1 < argc) {
-            executable_path_str = argv[++i];
+            ++i;
+            std::cerr << "Warning: --executable-path is no longer used; files are processed in-process." << std::endl;
+        } else if (arg == "--force") {
+            force_rebuild = true;
+        } else if (arg == "--features") {
+            write_features = true;
+        } else if (arg == "--feature-bar" && i + 1 < argc) {
+            std::string bar_arg = argv[++i];
+            if (!parse_duration_ns(bar_arg, options.feature_bar_ns)) {
+                std::cerr << "Error: Invalid --feature-bar width '" << bar_arg << "' (expected e.g. 1s, 100ms)." << std::endl;
+                return 1;
+            }
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            try {
+                max_jobs = static_cast<unsigned int>(std::stoul(argv[++i]));
+            } catch (const std::exception&) {
+                max_jobs = 0;
+            }
+            if (max_jobs == 0) {
+                std::cerr << "Error: --jobs must be a positive integer." << std::endl;
+                return 1;
+            }
         }
     }
 
-    if (input_folder_path_str.empty() || output_folder_path_str.empty() || executable_path_str.empty()) {
+    if (input_folder_path_str.empty() || output_folder_path_str.empty()) {
         print_usage(argv[0]);
         return 1;
     }
@@ -141,40 +188,6 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    if (!path_exists(executable_path_str) || !is_regular_file(executable_path_str)) {
-        std::string current_program_dir_str;
-        std::string arg0_str = argv[0];
-        size_t last_slash_idx = arg0_str.rfind('/');
-        if (std::string::npos != last_slash_idx) {
-            current_program_dir_str = arg0_str.substr(0, last_slash_idx);
-        } else {
-             char cwd_buf[PATH_MAX];
-             if (getcwd(cwd_buf, sizeof(cwd_buf)) != NULL) {
-                current_program_dir_str = cwd_buf;
-             }
-        }
-        
-        std::string exe_filename_str = executable_path_str;
-        last_slash_idx = executable_path_str.rfind('/');
-        if (std::string::npos != last_slash_idx) {
-            exe_filename_str = executable_path_str.substr(last_slash_idx + 1);
-        }
-        if (!current_program_dir_str.empty()) {
-            current_program_dir_str += "/";
-        }
-
-        std::string potential_exe_path_str = current_program_dir_str + exe_filename_str;
-
-        if (path_exists(potential_exe_path_str) && is_regular_file(potential_exe_path_str)) {
-            executable_path_str = potential_exe_path_str;
-            std::cout << "Info: Resolved executable path to: " << executable_path_str << std::endl;
-        } else {
-            std::cerr << "Error: Executable not found or is not a file: " << executable_path_str
-                      << " (also checked " << potential_exe_path_str << ")" << std::endl;
-            return 1;
-        }
-    }
-
     if (!create_directory_simple(output_folder_path_str)) {
         std::cerr << "Error creating output folder (or it's not a directory): " << output_folder_path_str << std::endl;
         return 1;
@@ -182,14 +195,7 @@ int main(int argc, char* argv[]) {
     std::cout << "Output folder: " << get_absolute_path_simple(output_folder_path_str) << std::endl;
 
     std::regex file_pattern("^merged_tops\\.([a-zA-Z0-9_]+)\\.bin$");
-    int processed_count = 0;
-    int skipped_count = 0;
-    std::mutex console_mutex;
-
-    std::cout << "\nProcessing files from: " << get_absolute_path_simple(input_folder_path_str) << std::endl;
-    std::cout << "Using executable: " << get_absolute_path_simple(executable_path_str) << std::endl;
-
-    std::vector<std::future<bool>> futures;
+    std::vector<FileJob> jobs;
 
     DIR* dir;
     struct dirent* ent;
@@ -200,7 +206,8 @@ int main(int argc, char* argv[]) {
 
             if (filename == "." || filename == "..") continue;
 
-            if (!is_regular_file(full_path_to_entry)) {
+            struct stat statbuf;
+            if (stat(full_path_to_entry.c_str(), &statbuf) != 0 || !S_ISREG(statbuf.st_mode)) {
                 continue;
             }
 
@@ -208,41 +215,68 @@ int main(int argc, char* argv[]) {
             if (std::regex_match(filename, match, file_pattern)) {
                 if (match.size() == 2) {
                     std::string symbol = match[1].str();
-                    std::string input_filepath_str = full_path_to_entry;
-                    std::string output_filename_str = "processed_tops." + symbol + ".bin";
-                    std::string output_filepath_str = output_folder_path_str + "/" + output_filename_str;
-
-                    futures.push_back(
-                        std::async(std::launch::async, 
-                                   process_file_task,
-                                   executable_path_str,
-                                   input_filepath_str,
-                                   output_filepath_str,
-                                   filename,
-                                   std::ref(console_mutex)
-                        )
-                    );
+                    FileJob job;
+                    job.filename = filename;
+                    job.input_filepath = full_path_to_entry;
+                    job.output_filepath = output_folder_path_str + "/processed_tops." + symbol + ".bin";
+                    if (write_features) {
+                        job.features_filepath = output_folder_path_str + "/book_features." + symbol + ".bin";
+                    }
+                    job.input_size = statbuf.st_size;
+                    jobs.push_back(std::move(job));
                 }
             }
         }
         closedir(dir);
     } else {
-        std::lock_guard<std::mutex> lock(console_mutex);
         std::cerr << "Error: Could not open input directory: " << input_folder_path_str << std::endl;
         return 1;
     }
 
-    for (auto& fut : futures) {
-        if (fut.get()) {
+    // Largest inputs first, so a big symbol picked up last does not leave the other workers idle
+    std::sort(jobs.begin(), jobs.end(),
+              [](const FileJob& a, const FileJob& b) { return a.input_size > b.input_size; });
+
+    unsigned int num_workers = static_cast<unsigned int>(std::min<size_t>(max_jobs, jobs.size()));
+    std::cout << "\nProcessing " << jobs.size() << " files from: " << get_absolute_path_simple(input_folder_path_str)
+              << " with " << num_workers << " workers" << std::endl;
+
+    std::mutex console_mutex;
+    std::atomic<size_t> next_job{0};
+    std::vector<std::thread> workers;
+    for (unsigned int w = 0; w < num_workers; ++w) {
+        workers.emplace_back([&]() {
+            for (size_t job_index = next_job++; job_index < jobs.size(); job_index = next_job++) {
+                process_file_task(jobs[job_index], options, force_rebuild, console_mutex);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    int processed_count = 0;
+    int up_to_date_count = 0;
+    int failed_count = 0;
+    for (const auto& job : jobs) {
+        if (job.up_to_date) {
+            up_to_date_count++;
+        } else if (job.result.ok) {
             processed_count++;
         } else {
-            skipped_count++;
+            failed_count++;
         }
     }
 
     std::cout << "\nBatch processing complete." << std::endl;
     std::cout << "Successfully processed: " << processed_count << " files." << std::endl;
-    std::cout << "Skipped or failed: " << skipped_count << " files." << std::endl;
+    std::cout << "Already up to date: " << up_to_date_count << " files." << std::endl;
+    std::cout << "Failed: " << failed_count << " files." << std::endl;
+    for (const auto& job : jobs) {
+        if (!job.result.ok) {
+            std::cerr << "  Failed: " << job.filename << ": " << job.result.error << std::endl;
+        }
+    }
 
-    return 0;
-}
\ No newline at end of file
+    return failed_count == 0 ? 0 : 1;
+}
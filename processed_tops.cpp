@@ -0,0 +1,150 @@
+#include "processed_tops.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <iterator>
+
+bool write_snapshot_index(const std::string& processed_tops_path, uint32_t interval,
+                          const std::vector<SnapshotIndexEntry>& entries) {
+    std::string index_path = processed_tops_path + SNAPSHOT_INDEX_SUFFIX;
+    std::ofstream index_file(index_path, std::ios::binary | std::ios::trunc);
+    if (!index_file.is_open()) {
+        std::cerr << "Error: Could not open index file for writing: " << index_path << std::endl;
+        return false;
+    }
+
+    SnapshotIndexHeader index_header;
+    index_header.magic = SNAPSHOT_INDEX_MAGIC;
+    index_header.interval = interval;
+    index_header.num_entries = static_cast<uint32_t>(entries.size());
+    index_file.write(reinterpret_cast<const char*>(&index_header), sizeof(SnapshotIndexHeader));
+    index_file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(SnapshotIndexEntry));
+    return index_file.good();
+}
+
+bool ProcessedTopsReader::open(const std::string& path, std::string& error) {
+    // Large stream buffer: decoding issues many small reads
+    stream_buffer_.resize(1 << 20);
+    file_.rdbuf()->pubsetbuf(stream_buffer_.data(), stream_buffer_.size());
+    file_.open(path, std::ios::binary);
+    if (!file_.is_open()) {
+        error = "Could not open processed tops file: " + path;
+        return false;
+    }
+
+    file_.read(reinterpret_cast<char*>(&header_), sizeof(OutputFileHeader));
+    if (static_cast<size_t>(file_.gcount()) < sizeof(OutputFileHeader)) {
+        error = "Processed tops file is too small to contain a valid header: " + path;
+        return false;
+    }
+
+    file_.seekg(0, std::ios::end);
+    file_size_ = static_cast<uint64_t>(file_.tellg());
+    file_.seekg(static_cast<std::streamoff>(OUTPUT_FILE_HEADER_SIZE), std::ios::beg);
+
+    index_.clear();
+    load_index(path + SNAPSHOT_INDEX_SUFFIX);
+    return true;
+}
+
+bool ProcessedTopsReader::load_index(const std::string& index_path) {
+    std::ifstream index_file(index_path, std::ios::binary);
+    if (!index_file.is_open()) {
+        return false;
+    }
+
+    SnapshotIndexHeader index_header;
+    index_file.read(reinterpret_cast<char*>(&index_header), sizeof(SnapshotIndexHeader));
+    if (static_cast<size_t>(index_file.gcount()) < sizeof(SnapshotIndexHeader) || index_header.magic != SNAPSHOT_INDEX_MAGIC) {
+        std::cerr << "Warning: Ignoring invalid snapshot index: " << index_path << std::endl;
+        return false;
+    }
+
+    index_.resize(index_header.num_entries);
+    index_file.read(reinterpret_cast<char*>(index_.data()), index_.size() * sizeof(SnapshotIndexEntry));
+    if (static_cast<size_t>(index_file.gcount()) < index_.size() * sizeof(SnapshotIndexEntry)) {
+        std::cerr << "Warning: Ignoring truncated snapshot index: " << index_path << std::endl;
+        index_.clear();
+        return false;
+    }
+
+    // An index left over from another version of the file would send seek() to wrong offsets: entry i must
+    // be snapshot i * interval, and every offset must fall inside this file's snapshots.
+    bool matches = index_header.interval != 0 &&
+                   index_.size() == (static_cast<uint64_t>(header_.num_snapshots) + index_header.interval - 1) / index_header.interval;
+    uint64_t previous_offset = 0;
+    for (size_t i = 0; matches && i < index_.size(); ++i) {
+        const SnapshotIndexEntry& entry = index_[i];
+        matches = entry.snapshot_number == static_cast<uint64_t>(i) * index_header.interval &&
+                  entry.byte_offset >= OUTPUT_FILE_HEADER_SIZE && entry.byte_offset < file_size_ &&
+                  (i == 0 ? entry.byte_offset == OUTPUT_FILE_HEADER_SIZE : entry.byte_offset > previous_offset);
+        previous_offset = entry.byte_offset;
+    }
+    if (!matches) {
+        std::cerr << "Warning: Ignoring snapshot index that does not match its file: " << index_path << std::endl;
+        index_.clear();
+        return false;
+    }
+    return true;
+}
+
+bool ProcessedTopsReader::read_levels(uint8_t num_levels, std::vector<ProcessedSnapshotLevel>& levels) {
+    levels.resize(num_levels);
+    for (auto& level : levels) {
+        LevelHeaderWrite lh_read;
+        file_.read(reinterpret_cast<char*>(&lh_read), sizeof(LevelHeaderWrite));
+        if (static_cast<size_t>(file_.gcount()) < sizeof(LevelHeaderWrite)) return false;
+
+        level.price = lh_read.price_at_level;
+        level.venues.resize(lh_read.num_venues);
+        size_t venue_bytes = level.venues.size() * sizeof(VenueAtLevelWrite);
+        file_.read(reinterpret_cast<char*>(level.venues.data()), venue_bytes);
+        if (static_cast<size_t>(file_.gcount()) < venue_bytes) return false;
+    }
+    return true;
+}
+
+bool ProcessedTopsReader::next(ProcessedSnapshot& snapshot) {
+    SnapshotHeaderWrite sh_read;
+    file_.read(reinterpret_cast<char*>(&sh_read), sizeof(SnapshotHeaderWrite));
+    if (static_cast<size_t>(file_.gcount()) < sizeof(SnapshotHeaderWrite)) {
+        return false;
+    }
+
+    snapshot.timestamp = sh_read.timestamp;
+    return read_levels(sh_read.num_bid_levels, snapshot.bids) &&
+           read_levels(sh_read.num_ask_levels, snapshot.asks);
+}
+
+bool ProcessedTopsReader::seek(uint64_t ts) {
+    if (!file_.is_open()) return false;
+    file_.clear();
+
+    // Last indexed snapshot at or before ts; decoding starts there instead of at the first snapshot
+    uint64_t start_offset = OUTPUT_FILE_HEADER_SIZE;
+    auto after = std::upper_bound(index_.begin(), index_.end(), ts,
+                                  [](uint64_t target, const SnapshotIndexEntry& entry) { return target < entry.timestamp; });
+    if (after != index_.begin()) {
+        start_offset = std::prev(after)->byte_offset;
+    }
+    file_.seekg(static_cast<std::streamoff>(start_offset), std::ios::beg);
+
+    std::streampos candidate = file_.tellg();
+    SnapshotHeaderWrite sh_read;
+    ProcessedSnapshot scratch;
+    while (true) {
+        std::streampos snapshot_start = file_.tellg();
+        file_.read(reinterpret_cast<char*>(&sh_read), sizeof(SnapshotHeaderWrite));
+        if (static_cast<size_t>(file_.gcount()) < sizeof(SnapshotHeaderWrite) || sh_read.timestamp > ts) {
+            break;
+        }
+        candidate = snapshot_start;
+        if (!read_levels(sh_read.num_bid_levels, scratch.bids) || !read_levels(sh_read.num_ask_levels, scratch.asks)) {
+            break;
+        }
+    }
+
+    file_.clear();
+    file_.seekg(candidate, std::ios::beg);
+    return file_.good();
+}
@@ -0,0 +1,146 @@
+#ifndef PROCESSED_TOPS_HPP
+#define PROCESSED_TOPS_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+
+// --- Constants ---
+const size_t OUTPUT_FILE_HEADER_SIZE = 24;
+const size_t SNAPSHOT_HEADER_SIZE_EXPECTED = 10;
+const size_t LEVEL_HEADER_SIZE_EXPECTED = 9;
+const size_t VENUE_AT_LEVEL_SIZE_EXPECTED = 12;
+
+const size_t MAX_VENUES = 64;
+const uint64_t PROCESSED_SNAPSHOT_FILE_FEED_ID = 0;
+const size_t NBBO_FILE_HEADER_SIZE_EXPECTED = 576;
+const size_t NBBO_RECORD_SIZE_EXPECTED = 64;
+
+// Sidecar index written next to a processed_tops file as <file>.idx
+const uint64_t SNAPSHOT_INDEX_MAGIC = 0x3130305844495450ULL; // "PTIDX001"
+const uint32_t DEFAULT_SNAPSHOT_INDEX_INTERVAL = 1024;
+const std::string SNAPSHOT_INDEX_SUFFIX = ".idx";
+
+#pragma pack(push, 1)
+
+struct OutputFileHeader {
+    uint64_t feed_id;
+    uint32_t dateint;
+    uint32_t num_snapshots;
+    uint64_t symbol_idx;
+};
+static_assert(sizeof(OutputFileHeader) == OUTPUT_FILE_HEADER_SIZE, "OutputFileHeader size mismatch");
+
+struct SnapshotHeaderWrite {
+    uint64_t timestamp;
+    uint8_t num_bid_levels;
+    uint8_t num_ask_levels;
+};
+static_assert(sizeof(SnapshotHeaderWrite) == SNAPSHOT_HEADER_SIZE_EXPECTED, "SnapshotHeaderWrite size mismatch");
+
+struct LevelHeaderWrite {
+    int64_t price_at_level;
+    uint8_t num_venues;
+};
+static_assert(sizeof(LevelHeaderWrite) == LEVEL_HEADER_SIZE_EXPECTED, "LevelHeaderWrite size mismatch");
+
+struct VenueAtLevelWrite {
+    uint32_t quantity_from_venue;
+    uint64_t feed_id_of_original_venue;
+};
+static_assert(sizeof(VenueAtLevelWrite) == VENUE_AT_LEVEL_SIZE_EXPECTED, "VenueAtLevelWrite size mismatch");
+
+#pragma pack(pop)
+
+// Header of the fixed-width NBBO stream. venue_feed_ids[i] is the feed_id behind bit i of the
+// venue masks; the header is padded to a multiple of 64 bytes so records follow it directly.
+struct NbboFileHeader {
+    uint64_t feed_id;
+    uint32_t dateint;
+    uint32_t num_records;
+    uint64_t symbol_idx;
+    uint32_t record_size;
+    uint32_t num_venues;
+    uint64_t venue_feed_ids[MAX_VENUES];
+    uint64_t reserved[4];
+};
+static_assert(sizeof(NbboFileHeader) == NBBO_FILE_HEADER_SIZE_EXPECTED, "NbboFileHeader size mismatch");
+
+// One NBBO change. Naturally aligned, so the body of the file can be mapped as NbboRecordWrite[num_records].
+// An empty side has price 0, quantity 0 and an empty mask.
+struct NbboRecordWrite {
+    uint64_t timestamp;
+    int64_t best_bid_price;
+    int64_t best_ask_price;
+    uint64_t bid_venue_mask;
+    uint64_t ask_venue_mask;
+    uint64_t bid_total_qty;
+    uint64_t ask_total_qty;
+    uint8_t bid_venue_count;
+    uint8_t ask_venue_count;
+    uint8_t padding[6];
+};
+static_assert(sizeof(NbboRecordWrite) == NBBO_RECORD_SIZE_EXPECTED, "NbboRecordWrite size mismatch");
+
+// Sidecar index: a header followed by num_entries entries, one for every `interval`-th snapshot.
+struct SnapshotIndexHeader {
+    uint64_t magic;
+    uint32_t interval;
+    uint32_t num_entries;
+};
+static_assert(sizeof(SnapshotIndexHeader) == 16, "SnapshotIndexHeader size mismatch");
+
+struct SnapshotIndexEntry {
+    uint64_t timestamp;
+    uint64_t byte_offset;
+    uint64_t snapshot_number;
+};
+static_assert(sizeof(SnapshotIndexEntry) == 24, "SnapshotIndexEntry size mismatch");
+
+// Writes <processed_tops_path>.idx; returns false if the file cannot be written
+bool write_snapshot_index(const std::string& processed_tops_path, uint32_t interval,
+                          const std::vector<SnapshotIndexEntry>& entries);
+
+// --- Reader ---
+
+struct ProcessedSnapshotLevel {
+    int64_t price = 0;
+    std::vector<VenueAtLevelWrite> venues;
+};
+
+struct ProcessedSnapshot {
+    uint64_t timestamp = 0;
+    std::vector<ProcessedSnapshotLevel> bids;
+    std::vector<ProcessedSnapshotLevel> asks;
+};
+
+// Sequential decoder for processed_tops files with time seeking through the .idx sidecar.
+// Without a sidecar, seek() falls back to scanning from the first snapshot.
+class ProcessedTopsReader {
+public:
+    // Returns false with error set if the file cannot be opened or has no valid header
+    bool open(const std::string& path, std::string& error);
+
+    const OutputFileHeader& header() const { return header_; }
+    bool has_index() const { return !index_.empty(); }
+
+    // Positions the reader so the next call to next() returns the book in force at ts, i.e. the last
+    // snapshot with timestamp <= ts, or the first snapshot when ts precedes them all.
+    bool seek(uint64_t ts);
+
+    // Decodes the snapshot at the current position. Returns false at end of file or on a truncated snapshot.
+    bool next(ProcessedSnapshot& snapshot);
+
+private:
+    bool read_levels(uint8_t num_levels, std::vector<ProcessedSnapshotLevel>& levels);
+    bool load_index(const std::string& index_path);
+
+    std::ifstream file_;
+    std::vector<char> stream_buffer_;
+    OutputFileHeader header_ = {};
+    uint64_t file_size_ = 0;
+    std::vector<SnapshotIndexEntry> index_;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#include "provenance.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <algorithm>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+std::optional<FileStamp> stamp_file(const fs::path& path) {
+    struct stat statbuf;
+    if (stat(path.c_str(), &statbuf) != 0 || !S_ISREG(statbuf.st_mode)) {
+        return std::nullopt;
+    }
+    FileStamp stamp;
+    stamp.path = path.string();
+    stamp.size = static_cast<uint64_t>(statbuf.st_size);
+    stamp.mtime_ns = static_cast<int64_t>(statbuf.st_mtim.tv_sec) * 1000000000LL + statbuf.st_mtim.tv_nsec;
+    return stamp;
+}
+
+// Stamps every path, sorted by path so the record does not depend on discovery order
+static bool stamp_files(const std::vector<fs::path>& paths, std::vector<FileStamp>& stamps) {
+    stamps.clear();
+    for (const auto& path : paths) {
+        std::optional<FileStamp> stamp = stamp_file(path);
+        if (!stamp) return false;
+        stamps.push_back(*stamp);
+    }
+    std::sort(stamps.begin(), stamps.end(),
+              [](const FileStamp& a, const FileStamp& b) { return a.path < b.path; });
+    return true;
+}
+
+std::optional<Provenance> make_provenance(const std::string& tool,
+                                          const std::string& version,
+                                          const std::string& params,
+                                          const std::vector<fs::path>& inputs,
+                                          const std::vector<fs::path>& outputs) {
+    Provenance provenance;
+    provenance.tool = tool;
+    provenance.version = version;
+    provenance.params = params;
+    if (!stamp_files(inputs, provenance.inputs) || !stamp_files(outputs, provenance.outputs)) {
+        return std::nullopt;
+    }
+    return provenance;
+}
+
+fs::path provenance_path_for(const fs::path& output) {
+    return fs::path(output.string() + PROVENANCE_SUFFIX);
+}
+
+// One "key value" line per field; paths go last on their line since they may contain spaces
+static std::string serialize_provenance(const Provenance& provenance) {
+    std::ostringstream out;
+    out << "tool " << provenance.tool << "\n";
+    out << "version " << provenance.version << "\n";
+    out << "params " << provenance.params << "\n";
+    for (const auto& input : provenance.inputs) {
+        out << "input " << input.size << " " << input.mtime_ns << " " << input.path << "\n";
+    }
+    for (const auto& output : provenance.outputs) {
+        out << "output " << output.size << " " << output.mtime_ns << " " << output.path << "\n";
+    }
+    return out.str();
+}
+
+bool provenance_is_current(const fs::path& provenance_path, const Provenance& expected) {
+    std::ifstream provenance_file(provenance_path, std::ios::binary);
+    if (!provenance_file.is_open()) {
+        return false;
+    }
+    std::string stored((std::istreambuf_iterator<char>(provenance_file)), std::istreambuf_iterator<char>());
+    return stored == serialize_provenance(expected);
+}
+
+bool write_provenance(const fs::path& provenance_path, const Provenance& provenance) {
+    std::ofstream provenance_file(provenance_path, std::ios::binary | std::ios::trunc);
+    if (!provenance_file.is_open()) {
+        return false;
+    }
+    provenance_file << serialize_provenance(provenance);
+    return provenance_file.good();
+}
+
+void remove_provenance(const fs::path& provenance_path) {
+    std::error_code ec;
+    fs::remove(provenance_path, ec);
+}
@@ -0,0 +1,54 @@
+#ifndef PROVENANCE_HPP
+#define PROVENANCE_HPP
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <filesystem>
+#include <cstdint>
+
+// --- Constants ---
+const std::string PROVENANCE_SUFFIX = ".prov";
+
+// Size and modification time (ns since the epoch) of one file as it was when the record was made
+struct FileStamp {
+    std::string path;
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+};
+
+// What an output was built from: the tool and its parameters, plus stamps of every input it read
+// and every output it produced. Stored as a small text sidecar next to the output.
+// An output is current when a freshly computed record is identical to the stored one.
+struct Provenance {
+    std::string tool;
+    std::string version;
+    std::string params;
+    std::vector<FileStamp> inputs;
+    std::vector<FileStamp> outputs;
+};
+
+// Stamp of path as it is on disk now; nullopt if it is not a regular file
+std::optional<FileStamp> stamp_file(const std::filesystem::path& path);
+
+// Stamps every input and output. Returns nullopt if any of them is missing,
+// which also means a stored record cannot be current.
+std::optional<Provenance> make_provenance(const std::string& tool,
+                                          const std::string& version,
+                                          const std::string& params,
+                                          const std::vector<std::filesystem::path>& inputs,
+                                          const std::vector<std::filesystem::path>& outputs);
+
+// <output>.prov
+std::filesystem::path provenance_path_for(const std::filesystem::path& output);
+
+// True if the record at provenance_path matches expected exactly
+bool provenance_is_current(const std::filesystem::path& provenance_path, const Provenance& expected);
+
+// Writes the record; returns false if the file cannot be written
+bool write_provenance(const std::filesystem::path& provenance_path, const Provenance& provenance);
+
+// Drops a record before its outputs are rewritten, so an interrupted run is never taken as current
+void remove_provenance(const std::filesystem::path& provenance_path);
+
+#endif
@@ -0,0 +1,199 @@
+#include "quote_bars.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+static const double QUOTE_BAR_NAN = std::numeric_limits<double>::quiet_NaN();
+
+static bool live(int64_t price, uint64_t qty) {
+    return price != 0 && qty != 0;
+}
+
+std::string quote_bars_path(const std::string& output_file_path_base, const std::string& symbol) {
+    return output_file_path_base + "quote_bars." + symbol + ".bin";
+}
+
+void QuoteBarBuilder::TimeWeightedMean::add(double value, double duration) {
+    sum += value * duration;
+    weight += duration;
+}
+
+double QuoteBarBuilder::TimeWeightedMean::mean() const {
+    return weight > 0.0 ? sum / weight : QUOTE_BAR_NAN;
+}
+
+BarSeries quote_bar_series(const std::vector<QuoteBarRecord>& bars) {
+    BarSeries series;
+    series.name = "quote";
+    series.fields = {"update_count"};
+    for (int level = 0; level < QUOTE_BAR_LEVELS; ++level) {
+        series.fields.push_back("bid_close_L" + std::to_string(level + 1));
+    }
+    for (int level = 0; level < QUOTE_BAR_LEVELS; ++level) {
+        series.fields.push_back("ask_close_L" + std::to_string(level + 1));
+    }
+    for (const char* field : {"mid_open", "mid_high", "mid_low", "mid_close", "microprice_close", "spread_close",
+                              "spread_twap", "bid_twap", "ask_twap", "bid_qty_twap", "ask_qty_twap",
+                              "bid_update_count", "ask_update_count"}) {
+        series.fields.push_back(field);
+    }
+    series.columns.resize(series.fields.size());
+    for (const QuoteBarRecord& bar : bars) {
+        series.timestamps.push_back(bar.timestamp);
+        size_t column = 0;
+        series.columns[column++].push_back(bar.update_count);
+        for (int level = 0; level < QUOTE_BAR_LEVELS; ++level) {
+            series.columns[column++].push_back(bar.bid_close[level]);
+        }
+        for (int level = 0; level < QUOTE_BAR_LEVELS; ++level) {
+            series.columns[column++].push_back(bar.ask_close[level]);
+        }
+        for (double value : {bar.mid_open, bar.mid_high, bar.mid_low, bar.mid_close, bar.microprice_close, bar.spread_close,
+                             bar.spread_twap, bar.bid_twap, bar.ask_twap, bar.bid_qty_twap, bar.ask_qty_twap,
+                             static_cast<double>(bar.bid_update_count), static_cast<double>(bar.ask_update_count)}) {
+            series.columns[column++].push_back(value);
+        }
+    }
+    return series;
+}
+
+bool QuoteBarBuilder::open(const std::string& path, bool append) {
+    path_ = path;
+    file_.open(path, std::ios::binary | (append ? std::ios::app : std::ios::trunc));
+    return file_.is_open();
+}
+
+void QuoteBarBuilder::write_pending() {
+    file_.write(reinterpret_cast<const char*>(bars_.data() + bars_written_),
+                static_cast<std::streamsize>((bars_.size() - bars_written_) * sizeof(QuoteBarRecord)));
+    bars_written_ = bars_.size();
+}
+
+QuoteBarBuilder::QuoteState QuoteBarBuilder::level1_state(const QuoteLevels& levels) {
+    QuoteState state;
+    if (live(levels.bid_price[0], levels.bid_qty[0])) {
+        state.bid_price = levels.bid_price[0];
+        state.bid_qty = levels.bid_qty[0];
+    }
+    if (live(levels.ask_price[0], levels.ask_qty[0])) {
+        state.ask_price = levels.ask_price[0];
+        state.ask_qty = levels.ask_qty[0];
+    }
+    return state;
+}
+
+void QuoteBarBuilder::prime(uint64_t ts, const QuoteLevels& levels) {
+    last_ = level1_state(levels);
+    last_ts_ = ts;
+    has_last_ = true;
+}
+
+void QuoteBarBuilder::start_bar(uint64_t bar_start_ns) {
+    bar_ = QuoteBarRecord();
+    bar_.timestamp = bar_start_ns / QUOTE_BAR_NS;
+    std::fill(bar_.bid_close, bar_.bid_close + QUOTE_BAR_LEVELS, QUOTE_BAR_NAN);
+    std::fill(bar_.ask_close, bar_.ask_close + QUOTE_BAR_LEVELS, QUOTE_BAR_NAN);
+    bar_.mid_open = bar_.mid_high = bar_.mid_low = bar_.mid_close = QUOTE_BAR_NAN;
+    bar_.microprice_close = bar_.spread_close = QUOTE_BAR_NAN;
+    bar_start_ns_ = bar_start_ns;
+    spread_twap_ = bid_twap_ = ask_twap_ = bid_qty_twap_ = ask_qty_twap_ = TimeWeightedMean();
+    has_bar_ = true;
+}
+
+// Weights the latest state by the time it held inside the current bar, up to until
+void QuoteBarBuilder::accumulate(uint64_t until) {
+    uint64_t from = std::max(last_ts_, bar_start_ns_);
+    if (!has_last_ || until <= from) return;
+    double duration = static_cast<double>(until - from);
+    bool has_bid = last_.bid_qty != 0;
+    bool has_ask = last_.ask_qty != 0;
+    if (has_bid) {
+        bid_twap_.add(last_.bid_price / 1e9, duration);
+        bid_qty_twap_.add(static_cast<double>(last_.bid_qty), duration);
+    }
+    if (has_ask) {
+        ask_twap_.add(last_.ask_price / 1e9, duration);
+        ask_qty_twap_.add(static_cast<double>(last_.ask_qty), duration);
+    }
+    if (has_bid && has_ask) {
+        spread_twap_.add(last_.ask_price / 1e9 - last_.bid_price / 1e9, duration);
+    }
+}
+
+void QuoteBarBuilder::close_bar() {
+    accumulate(bar_start_ns_ + QUOTE_BAR_NS);
+    bar_.spread_twap = spread_twap_.mean();
+    bar_.bid_twap = bid_twap_.mean();
+    bar_.ask_twap = ask_twap_.mean();
+    bar_.bid_qty_twap = bid_qty_twap_.mean();
+    bar_.ask_qty_twap = ask_qty_twap_.mean();
+    bars_.push_back(bar_);
+    has_bar_ = false;
+    if (file_.is_open() && bars_.size() - bars_written_ >= QUOTE_BAR_WRITE_BLOCK) {
+        write_pending();
+    }
+}
+
+void QuoteBarBuilder::add(uint64_t ts, const QuoteLevels& levels) {
+    uint64_t bar_start_ns = ts / QUOTE_BAR_NS * QUOTE_BAR_NS;
+    if (has_bar_ && bar_start_ns != bar_start_ns_) {
+        close_bar();
+    }
+    if (!has_bar_) {
+        start_bar(bar_start_ns);
+    }
+    accumulate(ts);
+
+    bar_.update_count++;
+    for (int level = 0; level < QUOTE_BAR_LEVELS; ++level) {
+        if (live(levels.bid_price[level], levels.bid_qty[level])) {
+            bar_.bid_close[level] = levels.bid_price[level] / 1e9;
+        }
+        if (live(levels.ask_price[level], levels.ask_qty[level])) {
+            bar_.ask_close[level] = levels.ask_price[level] / 1e9;
+        }
+    }
+
+    QuoteState state = level1_state(levels);
+    if (state.bid_price != last_.bid_price || state.bid_qty != last_.bid_qty) {
+        bar_.bid_update_count++;
+    }
+    if (state.ask_price != last_.ask_price || state.ask_qty != last_.ask_qty) {
+        bar_.ask_update_count++;
+    }
+    last_ = state;
+    last_ts_ = ts;
+    has_last_ = true;
+
+    if (state.bid_qty == 0 || state.ask_qty == 0) {
+        return;
+    }
+    double bid = state.bid_price / 1e9;
+    double ask = state.ask_price / 1e9;
+    double bid_qty = static_cast<double>(state.bid_qty);
+    double ask_qty = static_cast<double>(state.ask_qty);
+    double mid = (bid + ask) / 2.0;
+    if (std::isnan(bar_.mid_open)) {
+        bar_.mid_open = bar_.mid_high = bar_.mid_low = mid;
+    } else {
+        bar_.mid_high = std::max(bar_.mid_high, mid);
+        bar_.mid_low = std::min(bar_.mid_low, mid);
+    }
+    bar_.mid_close = mid;
+    bar_.microprice_close = (ask * bid_qty + bid * ask_qty) / (bid_qty + ask_qty);
+    bar_.spread_close = ask - bid;
+}
+
+bool QuoteBarBuilder::finish() {
+    if (has_bar_) {
+        close_bar();
+    }
+    if (!file_.is_open()) {
+        return true;
+    }
+    write_pending();
+    bool ok = file_.good();
+    file_.close();
+    return ok;
+}
@@ -0,0 +1,120 @@
+#ifndef QUOTE_BARS_HPP
+#define QUOTE_BARS_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+
+#include "bar_container.hpp"
+
+// --- Constants ---
+const int QUOTE_BAR_LEVELS = 3;
+const uint64_t QUOTE_BAR_NS = 1000000000ULL;
+const size_t QUOTE_BAR_WRITE_BLOCK = 4096;
+
+// Prices in nanos. A level is live when both its price and its quantity are non-zero.
+struct QuoteLevels {
+    int64_t bid_price[QUOTE_BAR_LEVELS];
+    int64_t ask_price[QUOTE_BAR_LEVELS];
+    uint64_t bid_qty[QUOTE_BAR_LEVELS];
+    uint64_t ask_qty[QUOTE_BAR_LEVELS];
+};
+
+#pragma pack(push, 1)
+
+// One second of quotes in one record, written for every second with at least one top. The bid/ask
+// closes are the last live price of each level in the bar, like the close of the per-level bid/ask
+// bars. Mid, microprice and spread are taken from level 1 whenever both sides are live:
+// microprice = (ask * bid_qty + bid * ask_qty) / (bid_qty + ask_qty).
+// The *_twap fields weight each level-1 state by how long it held inside the bar, i.e. until the ts
+// of the next top or the end of the bar; the state at the start of a bar carries over from the
+// previous top. bid/ask TWAPs count only the time their side was live, spread_twap only two-sided time.
+// bid_update_count/ask_update_count count the tops that changed the level-1 price or size of that side.
+// Fields without any value in the bar are NaN.
+struct QuoteBarRecord {
+    uint64_t timestamp;
+    uint32_t update_count;
+    double bid_close[QUOTE_BAR_LEVELS];
+    double ask_close[QUOTE_BAR_LEVELS];
+    double mid_open;
+    double mid_high;
+    double mid_low;
+    double mid_close;
+    double microprice_close;
+    double spread_close;
+    double spread_twap;
+    double bid_twap;
+    double ask_twap;
+    double bid_qty_twap;
+    double ask_qty_twap;
+    uint32_t bid_update_count;
+    uint32_t ask_update_count;
+};
+static_assert(sizeof(QuoteBarRecord) == 156, "QuoteBarRecord size mismatch");
+
+#pragma pack(pop)
+
+// <bars folder>/<PREFIX>.quote_bars.<SYMBOL>.bin, next to the per-level bid/ask bars
+std::string quote_bars_path(const std::string& output_file_path_base, const std::string& symbol);
+
+// Series "quote" of the bar container, one column per QuoteBarRecord field, e.g. "quote.mid_close"
+// or "quote.bid_close_L2"
+BarSeries quote_bar_series(const std::vector<QuoteBarRecord>& bars);
+
+// Builds QuoteBarRecords from a time-ordered stream of tops in the same pass as the bid/ask bars.
+// The bars are kept in bars(); they are also written to a file when one is opened.
+class QuoteBarBuilder {
+public:
+    // Returns false if the file cannot be opened. With append set, new bars go after the existing ones.
+    bool open(const std::string& path, bool append = false);
+
+    void add(uint64_t ts, const QuoteLevels& levels);
+
+    // Sets the state an append run resumes from: the last top before its first bar, which is not written again
+    void prime(uint64_t ts, const QuoteLevels& levels);
+
+    // Closes the last bar, whose final state holds until the bar's end, and writes the remaining bars
+    // to the file if one is open; returns false on a write error
+    bool finish();
+
+    const std::string& path() const { return path_; }
+    const std::vector<QuoteBarRecord>& bars() const { return bars_; }
+
+private:
+    // Sum of value * duration and of durations over the time a value was defined
+    struct TimeWeightedMean {
+        double sum = 0.0;
+        double weight = 0.0;
+        void add(double value, double duration);
+        double mean() const;
+    };
+
+    // Level-1 of the latest top; price and size are 0 on a side that is not live
+    struct QuoteState {
+        int64_t bid_price = 0;
+        int64_t ask_price = 0;
+        uint64_t bid_qty = 0;
+        uint64_t ask_qty = 0;
+    };
+
+    static QuoteState level1_state(const QuoteLevels& levels);
+    void start_bar(uint64_t bar_start_ns);
+    void close_bar();
+    void accumulate(uint64_t until);
+    void write_pending();
+
+    std::ofstream file_;
+    std::string path_;
+    std::vector<QuoteBarRecord> bars_;
+    size_t bars_written_ = 0;
+    QuoteBarRecord bar_ = {};
+    uint64_t bar_start_ns_ = 0;
+    bool has_bar_ = false;
+    TimeWeightedMean spread_twap_, bid_twap_, ask_twap_, bid_qty_twap_, ask_qty_twap_;
+    QuoteState last_;
+    uint64_t last_ts_ = 0;
+    bool has_last_ = false;
+};
+
+#endif
@@ -0,0 +1,446 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "consolidated_book.hpp"
+#include "merged_cursor.hpp"
+#include "processed_tops.hpp"
+
+// --- Constants ---
+const uint64_t NANOS_PER_SECOND = 1000000000ULL;
+const size_t OUTPUT_WRITE_BLOCK = 4096;
+
+enum TradeRule : uint8_t {
+    TRADE_RULE_NONE = 0,   // no quote and no earlier trade at another price
+    TRADE_RULE_QUOTE = 1,  // trade price above or below the prevailing mid
+    TRADE_RULE_TICK = 2    // at the mid or without a usable quote: direction of the last price change
+};
+
+#pragma pack(push, 1)
+
+// One entry of merged_fills.SYM.bin
+struct MergedFillsEntry {
+    uint64_t feed_id;
+    FillsRecord record;
+};
+static_assert(sizeof(MergedFillsEntry) == 98, "MergedFillsEntry size mismatch");
+
+// One trade of merged_fills with the NBBO in force just before it. Prices are in nanos; an empty
+// NBBO side has price 0. quote_ts is the ts of the last quote update applied, 0 before the first one.
+struct ClassifiedTradeRecord {
+    uint64_t ts;
+    uint64_t seq_no;
+    uint64_t feed_id;
+    int64_t trade_price;
+    uint32_t trade_qty;
+    int64_t bid_price;
+    int64_t ask_price;
+    uint64_t quote_ts;
+    int8_t direction;  // +1 buyer-initiated, -1 seller-initiated, 0 unknown
+    uint8_t rule;      // TradeRule
+};
+static_assert(sizeof(ClassifiedTradeRecord) == 62, "ClassifiedTradeRecord size mismatch");
+
+// Per-bar aggregate of the classified trades. The spreads are volume-weighted means over the trades
+// with a known direction and a usable NBBO (both sides present, not crossed); NaN when there are none.
+// Effective spread is 2 * direction * (price - mid), quoted spread is ask - bid, both also in bps of the mid.
+struct SpreadBarRecord {
+    uint64_t timestamp_sec;
+    uint32_t trade_count;
+    uint32_t quote_rule_count;
+    uint32_t tick_rule_count;
+    uint32_t resting_side_agreement_count;  // classified trades whose direction matches the venue's resting side
+    uint64_t volume;
+    uint64_t buy_volume;
+    uint64_t sell_volume;
+    double effective_spread;
+    double effective_spread_bps;
+    double quoted_spread_bps;
+};
+static_assert(sizeof(SpreadBarRecord) == 72, "SpreadBarRecord size mismatch");
+
+#pragma pack(pop)
+
+struct Nbbo {
+    uint64_t quote_ts = 0;
+    int64_t bid_price = 0;
+    int64_t ask_price = 0;
+
+    bool usable() const { return bid_price > 0 && ask_price > 0 && bid_price <= ask_price; }
+};
+
+// A whole input file mapped read-only
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() {
+        if (data_) munmap(const_cast<char*>(data_), size_);
+        if (fd_ != -1) close(fd_);
+    }
+
+    bool open(const std::string& path) {
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ == -1) return false;
+        struct stat sb;
+        if (fstat(fd_, &sb) == -1) return false;
+        size_ = static_cast<size_t>(sb.st_size);
+        if (size_ == 0) return true;
+        void* mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (mapped == MAP_FAILED) return false;
+        madvise(mapped, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const char*>(mapped);
+        return true;
+    }
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    int fd_ = -1;
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Number of complete entries after a 24-byte header, capped at the count the header announces
+template <typename Entry>
+size_t entries_in_file(const MappedFile& file, const std::string& path) {
+    if (file.size() < INPUT_FILE_HEADER_SIZE) {
+        return 0;
+    }
+    InputFileHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    size_t available = (file.size() - INPUT_FILE_HEADER_SIZE) / sizeof(Entry);
+    if (header.total_record_count > available) {
+        std::cerr << "Warning: " << path << " announces " << header.total_record_count << " records but holds "
+                  << available << "; using those." << std::endl;
+        return available;
+    }
+    return header.total_record_count;
+}
+
+// NBBO from the per-venue tops of merged_tops: every venue's latest top goes into a VenueQuoteTable and the
+// best live price of each side is taken over all venues and levels, only when a trade asks for it.
+class MergedTopsQuotes {
+public:
+    bool open(const std::string& path) {
+        if (!file_.open(path)) {
+            std::cerr << "Error: Could not open merged tops file: " << path << std::endl;
+            return false;
+        }
+        count_ = entries_in_file<MergedTopsEntry>(file_, path);
+        return true;
+    }
+
+    // Applies every update strictly before ts
+    void advance_to(uint64_t ts) {
+        const char* entries = file_.data() + INPUT_FILE_HEADER_SIZE;
+        MergedTopsEntry entry;
+        while (next_ < count_) {
+            std::memcpy(&entry, entries + next_ * sizeof(MergedTopsEntry), sizeof(MergedTopsEntry));
+            if (entry.record.ts >= ts) break;
+            int slot = table_.slot_for(entry.feed_id);
+            if (slot >= 0) {
+                table_.update(slot, entry.record);
+            } else if (!warned_venue_limit_) {
+                std::cerr << "Warning: More than " << MAX_VENUES << " venues; ignoring feed_id " << entry.feed_id << std::endl;
+                warned_venue_limit_ = true;
+            }
+            nbbo_.quote_ts = entry.record.ts;
+            dirty_ = true;
+            next_++;
+        }
+    }
+
+    const Nbbo& current() {
+        if (dirty_) {
+            nbbo_.bid_price = best_price(table_.bid_price, table_.bid_qty, true);
+            nbbo_.ask_price = best_price(table_.ask_price, table_.ask_qty, false);
+            dirty_ = false;
+        }
+        return nbbo_;
+    }
+
+private:
+    int64_t best_price(const int64_t (&prices)[VENUE_LEVELS][MAX_VENUES],
+                       const uint32_t (&quantities)[VENUE_LEVELS][MAX_VENUES], bool is_bid) const {
+        int64_t best = 0;
+        for (int level = 0; level < VENUE_LEVELS; ++level) {
+            for (size_t v = 0; v < table_.num_venues; ++v) {
+                int64_t price = prices[level][v];
+                if (price != 0 && quantities[level][v] > 0 &&
+                    (best == 0 || (is_bid ? price > best : price < best))) {
+                    best = price;
+                }
+            }
+        }
+        return best;
+    }
+
+    MappedFile file_;
+    size_t count_ = 0;
+    size_t next_ = 0;
+    VenueQuoteTable table_;
+    Nbbo nbbo_;
+    bool dirty_ = false;
+    bool warned_venue_limit_ = false;
+};
+
+// NBBO from the top level of each processed_tops snapshot
+class ProcessedTopsQuotes {
+public:
+    bool open(const std::string& path) {
+        std::string error;
+        if (!reader_.open(path, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return false;
+        }
+        has_pending_ = reader_.next(pending_);
+        return true;
+    }
+
+    // Applies every snapshot strictly before ts
+    void advance_to(uint64_t ts) {
+        while (has_pending_ && pending_.timestamp < ts) {
+            nbbo_.quote_ts = pending_.timestamp;
+            nbbo_.bid_price = pending_.bids.empty() ? 0 : pending_.bids.front().price;
+            nbbo_.ask_price = pending_.asks.empty() ? 0 : pending_.asks.front().price;
+            has_pending_ = reader_.next(pending_);
+        }
+    }
+
+    const Nbbo& current() const { return nbbo_; }
+
+private:
+    ProcessedTopsReader reader_;
+    ProcessedSnapshot pending_;
+    bool has_pending_ = false;
+    Nbbo nbbo_;
+};
+
+// Accumulates the trades of one bar
+struct SpreadBarState {
+    SpreadBarRecord bar = {};
+    double effective_spread_sum = 0.0;
+    double effective_spread_bps_sum = 0.0;
+    double quoted_spread_bps_sum = 0.0;
+    uint64_t spread_volume = 0;
+
+    void start(uint64_t timestamp_sec) {
+        *this = SpreadBarState();
+        bar.timestamp_sec = timestamp_sec;
+    }
+
+    SpreadBarRecord finish() const {
+        SpreadBarRecord out = bar;
+        double nan = std::numeric_limits<double>::quiet_NaN();
+        double weight = static_cast<double>(spread_volume);
+        out.effective_spread = spread_volume > 0 ? effective_spread_sum / weight : nan;
+        out.effective_spread_bps = spread_volume > 0 ? effective_spread_bps_sum / weight : nan;
+        out.quoted_spread_bps = spread_volume > 0 ? quoted_spread_bps_sum / weight : nan;
+        return out;
+    }
+};
+
+template <typename Record>
+void flush_records(std::ofstream& out, std::vector<Record>& records) {
+    out.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(Record)));
+    records.clear();
+}
+
+// Walks the fills and the quotes together: before each trade the quote source is advanced past every
+// update stamped before the trade, so the NBBO is the one in force when the trade happened (quote updates
+// with the trade's own ts are usually caused by it). Trades are labelled by the quote rule, falling back
+// to the tick rule at the mid or without a usable NBBO (Lee-Ready without a quote delay).
+template <typename QuoteSource>
+bool classify_trades(const MappedFile& fills, size_t fill_count, QuoteSource& quotes, uint64_t bar_seconds,
+                     std::ofstream& trades_out, std::ofstream& bars_out) {
+    std::vector<ClassifiedTradeRecord> trades;
+    std::vector<SpreadBarRecord> bars;
+    trades.reserve(OUTPUT_WRITE_BLOCK);
+    bars.reserve(OUTPUT_WRITE_BLOCK);
+
+    SpreadBarState state;
+    bool has_bar = false;
+    int64_t last_trade_price = 0;
+    int8_t last_tick_direction = 0;
+    bool has_last_trade = false;
+
+    const char* entries = fills.data() + INPUT_FILE_HEADER_SIZE;
+    MergedFillsEntry entry;
+    for (size_t i = 0; i < fill_count; ++i) {
+        std::memcpy(&entry, entries + i * sizeof(MergedFillsEntry), sizeof(MergedFillsEntry));
+        const FillsRecord& fill = entry.record;
+
+        quotes.advance_to(fill.ts);
+        const Nbbo& nbbo = quotes.current();
+
+        // Tick rule: direction of the last price change, carried through zero ticks
+        if (has_last_trade && fill.trade_price != last_trade_price) {
+            last_tick_direction = fill.trade_price > last_trade_price ? 1 : -1;
+        }
+        has_last_trade = true;
+        last_trade_price = fill.trade_price;
+
+        ClassifiedTradeRecord trade;
+        trade.ts = fill.ts;
+        trade.seq_no = fill.seq_no;
+        trade.feed_id = entry.feed_id;
+        trade.trade_price = fill.trade_price;
+        trade.trade_qty = fill.trade_qty;
+        trade.bid_price = nbbo.bid_price;
+        trade.ask_price = nbbo.ask_price;
+        trade.quote_ts = nbbo.quote_ts;
+        trade.direction = 0;
+        trade.rule = TRADE_RULE_NONE;
+        // Compared on twice the price so the mid stays an integer
+        int64_t doubled_price = 2 * fill.trade_price;
+        int64_t doubled_mid = nbbo.bid_price + nbbo.ask_price;
+        if (nbbo.usable() && doubled_price != doubled_mid) {
+            trade.direction = doubled_price > doubled_mid ? 1 : -1;
+            trade.rule = TRADE_RULE_QUOTE;
+        } else if (last_tick_direction != 0) {
+            trade.direction = last_tick_direction;
+            trade.rule = TRADE_RULE_TICK;
+        }
+        trades.push_back(trade);
+        if (trades.size() >= OUTPUT_WRITE_BLOCK) {
+            flush_records(trades_out, trades);
+        }
+
+        uint64_t bar_sec = fill.ts / NANOS_PER_SECOND / bar_seconds * bar_seconds;
+        if (!has_bar || bar_sec != state.bar.timestamp_sec) {
+            if (has_bar) {
+                bars.push_back(state.finish());
+                if (bars.size() >= OUTPUT_WRITE_BLOCK) {
+                    flush_records(bars_out, bars);
+                }
+            }
+            has_bar = true;
+            state.start(bar_sec);
+        }
+        SpreadBarRecord& bar = state.bar;
+        bar.trade_count++;
+        bar.volume += fill.trade_qty;
+        if (trade.rule == TRADE_RULE_QUOTE) bar.quote_rule_count++;
+        if (trade.rule == TRADE_RULE_TICK) bar.tick_rule_count++;
+        if (trade.direction > 0) bar.buy_volume += fill.trade_qty;
+        if (trade.direction < 0) bar.sell_volume += fill.trade_qty;
+        // The venue's own aggressor: a resting bid means the trade was seller-initiated
+        if (trade.direction != 0 && (trade.direction < 0) == fill.resting_side_is_bid) {
+            bar.resting_side_agreement_count++;
+        }
+        if (trade.direction != 0 && nbbo.usable() && fill.trade_qty > 0) {
+            double mid = static_cast<double>(doubled_mid) / 2e9;
+            double price = static_cast<double>(fill.trade_price) / 1e9;
+            double effective = 2.0 * trade.direction * (price - mid);
+            double quoted = static_cast<double>(nbbo.ask_price - nbbo.bid_price) / 1e9;
+            double qty = static_cast<double>(fill.trade_qty);
+            state.effective_spread_sum += effective * qty;
+            state.effective_spread_bps_sum += effective / mid * 1e4 * qty;
+            state.quoted_spread_bps_sum += quoted / mid * 1e4 * qty;
+            state.spread_volume += fill.trade_qty;
+        }
+    }
+
+    if (has_bar) {
+        bars.push_back(state.finish());
+    }
+    flush_records(trades_out, trades);
+    flush_records(bars_out, bars);
+    return trades_out.good() && bars_out.good();
+}
+
+void print_usage(const char* prog_name) {
+    std::cerr << "Usage: " << prog_name << " <date> <symbol> [--processed-tops <path>] [--bar-seconds <seconds, default: 1>]" << std::endl;
+    std::cerr << "  Joins mergedbooks/merged_fills.<SYMBOL>.bin with the NBBO of merged_tops.<SYMBOL>.bin (or of the given" << std::endl;
+    std::cerr << "  processed_tops file) and writes MERGEDBOOKS.classified_trades and MERGEDBOOKS.spread_bars to mergedbooks/bars." << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    std::string date = argv[1];
+    std::string symbol = argv[2];
+    std::transform(symbol.begin(), symbol.end(), symbol.begin(), ::toupper);
+
+    std::string processed_tops_path;
+    uint64_t bar_seconds = 1;
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--processed-tops" && i + 1 < argc) {
+            processed_tops_path = argv[++i];
+        } else if (arg == "--bar-seconds" && i + 1 < argc) {
+            try {
+                bar_seconds = std::stoull(argv[++i]);
+            } catch (const std::exception&) {
+                bar_seconds = 0;
+            }
+            if (bar_seconds == 0) {
+                std::cerr << "Error: --bar-seconds must be a positive integer." << std::endl;
+                return 1;
+            }
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::string merged_folder = "/home/vir/" + date + "/mergedbooks";
+    std::string fills_path = merged_folder + "/merged_fills." + symbol + ".bin";
+    std::string tops_path = merged_folder + "/merged_tops." + symbol + ".bin";
+    std::string trades_path = merged_folder + "/bars/MERGEDBOOKS.classified_trades." + symbol + ".bin";
+    std::string bars_path = merged_folder + "/bars/MERGEDBOOKS.spread_bars." + symbol + ".bin";
+
+    MappedFile fills;
+    if (!fills.open(fills_path)) {
+        std::cerr << "Error: Could not open merged fills file: " << fills_path << std::endl;
+        return 1;
+    }
+    size_t fill_count = entries_in_file<MergedFillsEntry>(fills, fills_path);
+
+    std::ofstream trades_out(trades_path, std::ios::binary | std::ios::trunc);
+    if (!trades_out.is_open()) {
+        std::cerr << "Error: Could not open output file for writing: " << trades_path << std::endl;
+        return 1;
+    }
+    std::ofstream bars_out(bars_path, std::ios::binary | std::ios::trunc);
+    if (!bars_out.is_open()) {
+        std::cerr << "Error: Could not open output file for writing: " << bars_path << std::endl;
+        return 1;
+    }
+
+    bool ok;
+    if (processed_tops_path.empty()) {
+        std::cout << "Classifying " << fill_count << " trades of " << fills_path << " against " << tops_path << std::endl;
+        MergedTopsQuotes quotes;
+        if (!quotes.open(tops_path)) return 1;
+        ok = classify_trades(fills, fill_count, quotes, bar_seconds, trades_out, bars_out);
+    } else {
+        std::cout << "Classifying " << fill_count << " trades of " << fills_path << " against " << processed_tops_path << std::endl;
+        ProcessedTopsQuotes quotes;
+        if (!quotes.open(processed_tops_path)) return 1;
+        ok = classify_trades(fills, fill_count, quotes, bar_seconds, trades_out, bars_out);
+    }
+    if (!ok) {
+        std::cerr << "Error occurred during writing output files." << std::endl;
+        return 1;
+    }
+
+    std::cout << "Classified trades saved to " << trades_path << std::endl;
+    std::cout << "Spread bars saved to " << bars_path << std::endl;
+    return 0;
+}